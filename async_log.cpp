@@ -0,0 +1,206 @@
+#include "async_log.h"
+#include "logger.h"
+
+#include <cerrno>
+#include <cstring>
+
+using namespace std;
+
+LogRing::LogRing(size_t capacity)
+    : enqueue_pos(0), dequeue_pos(0), dropped(0), sleeping(false)
+{
+    size_t size = 2;
+    while (size < capacity)
+    {
+        size <<= 1;
+    }
+    slots = new Slot[size];
+    mask = size - 1;
+    for (size_t i = 0; i < size; i++)
+    {
+        slots[i].sequence.store(i, memory_order_relaxed);
+        slots[i].tag = 0;
+    }
+}
+
+LogRing::~LogRing()
+{
+    delete[] slots;
+}
+
+bool LogRing::push(int tag, string &&text)
+{
+    size_t pos = enqueue_pos.load(memory_order_relaxed);
+    Slot *slot;
+    while (true)
+    {
+        slot = &slots[pos & mask];
+        size_t sequence = slot->sequence.load(memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+        if (diff == 0)
+        {
+            // ячейка свободна - занимаем номер
+            if (enqueue_pos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed))
+                break;
+        }
+        else if (diff < 0)
+        {
+            // читатель ещё не освободил ячейку круг назад: кольцо полно
+            dropped.fetch_add(1, memory_order_relaxed);
+            return false;
+        }
+        else
+        {
+            pos = enqueue_pos.load(memory_order_relaxed); // номер занял другой писатель
+        }
+    }
+
+    slot->tag = tag;
+    slot->text = std::move(text);
+    // seq_cst в паре с sleeping: либо читатель увидит ячейку, либо мы увидим, что он спит
+    slot->sequence.store(pos + 1, memory_order_seq_cst);
+
+    if (sleeping.load(memory_order_seq_cst))
+    {
+        wake();
+    }
+    return true;
+}
+
+bool LogRing::pop(int &tag, string &text)
+{
+    size_t pos = dequeue_pos.load(memory_order_relaxed);
+    Slot *slot = &slots[pos & mask];
+    if (slot->sequence.load(memory_order_acquire) != pos + 1)
+    {
+        return false;
+    }
+
+    tag = slot->tag;
+    text = std::move(slot->text);
+    slot->text.clear();
+    slot->sequence.store(pos + mask + 1, memory_order_release); // свободна для следующего круга
+    dequeue_pos.store(pos + 1, memory_order_release);
+    return true;
+}
+
+void LogRing::waitForData(chrono::milliseconds timeout)
+{
+    unique_lock<mutex> lock(mtx);
+    sleeping.store(true, memory_order_seq_cst);
+    size_t pos = dequeue_pos.load(memory_order_relaxed);
+    if (slots[pos & mask].sequence.load(memory_order_seq_cst) != pos + 1)
+    {
+        cv.wait_for(lock, timeout);
+    }
+    sleeping.store(false, memory_order_relaxed);
+}
+
+void LogRing::wake()
+{
+    lock_guard<mutex> lock(mtx);
+    cv.notify_one();
+}
+
+AsyncFileLog::AsyncFileLog(const string &path, size_t max_bytes, size_t keep_files, size_t capacity)
+    : path(path), max_bytes(max_bytes), keep_files(keep_files), ring(capacity),
+      stopping(false), file(nullptr), file_bytes(0)
+{
+}
+
+AsyncFileLog::~AsyncFileLog()
+{
+    stopping.store(true);
+    ring.wake();
+    if (writer.joinable())
+    {
+        writer.join();
+    }
+    if (file)
+    {
+        fclose(file);
+    }
+}
+
+bool AsyncFileLog::open()
+{
+    file = fopen(path.c_str(), "a");
+    if (file == nullptr)
+    {
+        LOG_ERROR(path << ": " << strerror(errno));
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    file_bytes = size > 0 ? static_cast<size_t>(size) : 0;
+
+    writer = thread(&AsyncFileLog::writer_loop, this);
+    return true;
+}
+
+bool AsyncFileLog::write(string line)
+{
+    return ring.push(0, std::move(line));
+}
+
+uint64_t AsyncFileLog::getDropped() const
+{
+    return ring.getDropped();
+}
+
+// старые файлы сдвигаются на один номер, самый старый пропадает
+void AsyncFileLog::rotate()
+{
+    fclose(file);
+    for (size_t i = keep_files; i > 1; --i)
+    {
+        string from = path + "." + to_string(i - 1);
+        string to = path + "." + to_string(i);
+        ::rename(from.c_str(), to.c_str());
+    }
+    if (keep_files > 0)
+    {
+        ::rename(path.c_str(), (path + ".1").c_str());
+    }
+    else
+    {
+        ::remove(path.c_str());
+    }
+    file = fopen(path.c_str(), "a");
+    file_bytes = 0;
+}
+
+void AsyncFileLog::writer_loop()
+{
+    int tag;
+    string line;
+    while (true)
+    {
+        // сначала stopping, потом пустое кольцо: всё, что положили до остановки, будет записано
+        bool stop = stopping.load();
+        bool wrote = false;
+        while (ring.pop(tag, line))
+        {
+            if (max_bytes > 0 && file_bytes > 0 && file_bytes + line.size() + 1 > max_bytes)
+            {
+                rotate();
+            }
+            if (file)
+            {
+                fwrite(line.data(), 1, line.size(), file);
+                fputc('\n', file);
+                file_bytes += line.size() + 1;
+            }
+            wrote = true;
+        }
+        if (wrote && file)
+        {
+            fflush(file); // пачка целиком видна читателю файла
+        }
+        if (stop)
+        {
+            return;
+        }
+        ring.waitForData(chrono::milliseconds(100));
+    }
+}
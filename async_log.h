@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// ограниченное кольцо строк: много писателей, один читатель, без блокировок.
+// Писатель занимает ячейку CAS-ом по номеру и публикует её счётчиком
+// последовательности в самой ячейке; полное кольцо не ждёт - строка
+// отбрасывается и учитывается в getDropped(). Читатель засыпает на condvar,
+// только когда кольцо пусто, и будят его, только если он действительно спит
+class LogRing
+{
+private:
+    struct Slot
+    {
+        std::atomic<size_t> sequence;
+        int tag; // уровень для консольного журнала, в файловом не нужен
+        std::string text;
+    };
+
+    Slot *slots;
+    size_t mask; // размер - степень двойки
+
+    alignas(64) std::atomic<size_t> enqueue_pos;
+    alignas(64) std::atomic<size_t> dequeue_pos;
+    alignas(64) std::atomic<uint64_t> dropped;
+
+    std::atomic<bool> sleeping; // читатель ждёт на cv
+    std::mutex mtx;
+    std::condition_variable cv;
+
+public:
+    explicit LogRing(size_t capacity);
+    ~LogRing();
+    LogRing(const LogRing &) = delete;
+    LogRing &operator=(const LogRing &) = delete;
+
+    // любой поток; false - кольцо полно, строка отброшена
+    bool push(int tag, std::string &&text);
+    // только читатель; false - кольцо пусто
+    bool pop(int &tag, std::string &text);
+
+    // читатель: уснуть, пока кольцо пусто (не дольше timeout)
+    void waitForData(std::chrono::milliseconds timeout);
+    void wake(); // разбудить читателя (остановка, flush)
+
+    size_t pushedCount() const { return enqueue_pos.load(std::memory_order_acquire); }
+    size_t poppedCount() const { return dequeue_pos.load(std::memory_order_acquire); }
+    uint64_t getDropped() const { return dropped.load(std::memory_order_relaxed); }
+};
+
+// журнал в файл, который пишет фоновый поток. Писатель только кладёт строку в
+// LogRing - файловых вызовов на его пути нет; если кольцо полно, строка
+// отбрасывается и учитывается в getDropped(), а не тормозит запрос.
+// Файл ротируется по размеру: path -> path.1 -> ... -> path.<keep_files>
+class AsyncFileLog
+{
+private:
+    std::string path;
+    size_t max_bytes;  // 0 - без ротации
+    size_t keep_files; // сколько старых файлов хранить
+
+    LogRing ring;
+    std::atomic<bool> stopping;
+
+    FILE *file; // трогает только фоновый поток (и open до его запуска)
+    size_t file_bytes;
+    std::thread writer;
+
+    void writer_loop();
+    void rotate();
+
+public:
+    AsyncFileLog(const std::string &path, size_t max_bytes, size_t keep_files = 3, size_t capacity = 8192);
+    ~AsyncFileLog(); // дописывает очередь и закрывает файл
+    AsyncFileLog(const AsyncFileLog &) = delete;
+    AsyncFileLog &operator=(const AsyncFileLog &) = delete;
+
+    bool open(); // открыть файл на дозапись и запустить фоновый поток
+
+    // строка без '\n' на конце; false - очередь полна, строка отброшена
+    bool write(std::string line);
+    uint64_t getDropped() const;
+};
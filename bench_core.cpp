@@ -0,0 +1,594 @@
+// микробенчмарки ядра: хэш-таблица, myarray, документы, условия запросов, файл коллекции
+// сборка: g++ -std=c++17 -O2 -pthread bench_core.cpp minidbms.cpp document.cpp custom_hashmap.cpp
+//         myarray.cpp utills.cpp query.cpp plan_cache.cpp result_cache.cpp snapshot.cpp rwlock.cpp binary_protocol.cpp uring.cpp metrics.cpp trace.cpp logger.cpp async_log.cpp
+//         -o bench_core
+// запуск:  bench_core [--json] [--filter подстрока] [--max-keys N] [--min-ms N]
+//          --json      - по строке JSON на замер (name, param, ops, ns_per_op, allocs_per_op,
+//                        bytes_per_op, ops_per_sec) для сравнения прогонов скриптом
+//          --max-keys  - верхний размер для хэш-таблицы и myarray (по умолчанию 1000000, до 10000000)
+//          --min-ms    - сколько минимум мерить каждый случай (по умолчанию 300)
+#include "custom_hashmap.h"
+#include "document.h"
+#include "logger.h"
+#include "minidbms.h"
+#include "myarray.h"
+#include "query.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+
+using namespace std;
+
+// ---- учёт выделений памяти: свой operator new считает вызовы потока бенчмарка ----
+
+static thread_local uint64_t t_allocs = 0;
+static thread_local uint64_t t_alloc_bytes = 0;
+
+static void *countedAlloc(size_t size)
+{
+    t_allocs++;
+    t_alloc_bytes += size;
+    void *p = malloc(size ? size : 1);
+    if (!p)
+        throw bad_alloc();
+    return p;
+}
+
+void *operator new(size_t size) { return countedAlloc(size); }
+void *operator new[](size_t size) { return countedAlloc(size); }
+void *operator new(size_t size, const nothrow_t &) noexcept
+{
+    t_allocs++;
+    t_alloc_bytes += size;
+    return malloc(size ? size : 1);
+}
+void *operator new[](size_t size, const nothrow_t &) noexcept
+{
+    t_allocs++;
+    t_alloc_bytes += size;
+    return malloc(size ? size : 1);
+}
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+void operator delete(void *p, const nothrow_t &) noexcept { free(p); }
+void operator delete[](void *p, const nothrow_t &) noexcept { free(p); }
+
+// ---- замер ----
+
+static long long nowNs()
+{
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// итог одного случая: время и выделения только внутри отрезков start/stop
+struct Measurement
+{
+    long long ns = 0;
+    uint64_t ops = 0;
+    uint64_t allocs = 0;
+    uint64_t bytes = 0;
+};
+
+// подготовка данных и очистка остаются вне замера
+class Stopwatch
+{
+private:
+    long long start_ns = 0;
+    uint64_t start_allocs = 0;
+    uint64_t start_bytes = 0;
+
+public:
+    void start()
+    {
+        start_allocs = t_allocs;
+        start_bytes = t_alloc_bytes;
+        start_ns = nowNs();
+    }
+    void stop(Measurement &m)
+    {
+        m.ns += nowNs() - start_ns;
+        m.allocs += t_allocs - start_allocs;
+        m.bytes += t_alloc_bytes - start_bytes;
+    }
+};
+
+// один проход случая; param - размер или номер варианта
+typedef void (*BenchFn)(size_t param, Measurement &m);
+
+// результат не выбрасывается компилятором
+static volatile size_t g_sink = 0;
+
+// ---- данные ----
+
+static string makeKey(size_t i)
+{
+    return to_string(i * 2654435761u % 1000000007u); // ключи не по порядку, как _id после удалений
+}
+
+static string *makeKeys(size_t n)
+{
+    string *keys = new string[n];
+    for (size_t i = 0; i < n; i++)
+        keys[i] = makeKey(i);
+    return keys;
+}
+
+static Document *makeDocument(size_t i, size_t fields)
+{
+    static const char *cities[] = {"Moscow", "Kazan", "Omsk", "Tver", "Perm", "Sochi", "Tula", "Ufa"};
+    Document *doc = new Document(to_string(i + 1));
+    doc->addField("name", "user" + to_string(i));
+    doc->addField("age", to_string(i % 90));
+    doc->addField("city", cities[i % 8]);
+    for (size_t f = 3; f < fields; f++)
+        doc->addField("field" + to_string(f), "value" + to_string(i * 31 + f));
+    return doc;
+}
+
+// заполнение вне замера; версии растут, как у записей базы
+static void fillMap(CustomHashMap &map, const string *keys, size_t n, unsigned long long &version)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        if (map.needsGrow())
+            map.grow(++version);
+        map.put(keys[i], makeDocument(i, 3), ++version);
+    }
+}
+
+// ---- CustomHashMap ----
+
+static void benchMapPut(size_t n, Measurement &m)
+{
+    string *keys = makeKeys(n);
+    Document **docs = new Document *[n];
+    for (size_t i = 0; i < n; i++)
+        docs[i] = makeDocument(i, 3);
+    CustomHashMap *map = new CustomHashMap(n * 4 / 3 + 16); // без роста: рост меряет map_resize
+
+    Stopwatch sw;
+    sw.start();
+    for (size_t i = 0; i < n; i++)
+        map->put(keys[i], docs[i], i + 1);
+    sw.stop(m);
+    m.ops += n;
+
+    delete map;
+    delete[] docs;
+    delete[] keys;
+}
+
+// цена роста таблицы на вставленный ключ (все grow() при заполнении с пустой таблицы)
+static void benchMapResize(size_t n, Measurement &m)
+{
+    string *keys = makeKeys(n);
+    Document **docs = new Document *[n];
+    for (size_t i = 0; i < n; i++)
+        docs[i] = makeDocument(i, 3);
+    CustomHashMap *map = new CustomHashMap();
+
+    Stopwatch sw;
+    unsigned long long version = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (map->needsGrow())
+        {
+            sw.start();
+            map->grow(++version);
+            sw.stop(m);
+        }
+        map->put(keys[i], docs[i], ++version);
+    }
+    m.ops += n;
+
+    delete map;
+    delete[] docs;
+    delete[] keys;
+}
+
+static void benchMapGet(size_t n, Measurement &m)
+{
+    string *keys = makeKeys(n);
+    CustomHashMap *map = new CustomHashMap();
+    unsigned long long version = 0;
+    fillMap(*map, keys, n, version);
+
+    // обход в порядке, не совпадающем с порядком вставки
+    size_t step = 7919;
+    while (n % step == 0)
+        step++;
+
+    Stopwatch sw;
+    sw.start();
+    size_t found = 0;
+    size_t index = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        index = (index + step) % n;
+        if (map->get(keys[index], version))
+            found++;
+    }
+    sw.stop(m);
+    m.ops += n;
+    g_sink = g_sink + found;
+
+    delete map;
+    delete[] keys;
+}
+
+static void benchMapGetMiss(size_t n, Measurement &m)
+{
+    string *keys = makeKeys(n);
+    CustomHashMap *map = new CustomHashMap();
+    unsigned long long version = 0;
+    fillMap(*map, keys, n, version);
+    string *missing = new string[n];
+    for (size_t i = 0; i < n; i++)
+        missing[i] = "x" + keys[i];
+
+    Stopwatch sw;
+    sw.start();
+    size_t found = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (map->get(missing[i], version))
+            found++;
+    }
+    sw.stop(m);
+    m.ops += n;
+    g_sink = g_sink + found;
+
+    delete map;
+    delete[] missing;
+    delete[] keys;
+}
+
+static void benchMapRemove(size_t n, Measurement &m)
+{
+    string *keys = makeKeys(n);
+    CustomHashMap *map = new CustomHashMap();
+    unsigned long long version = 0;
+    fillMap(*map, keys, n, version);
+
+    Stopwatch sw;
+    sw.start();
+    size_t removed = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (map->remove(keys[i], ++version))
+            removed++;
+    }
+    sw.stop(m);
+    m.ops += n;
+    g_sink = g_sink + removed;
+
+    delete map;
+    delete[] keys;
+}
+
+// ---- myarray ----
+
+static void benchArrayPush(size_t n, Measurement &m)
+{
+    string *keys = makeKeys(n); // короткие строки - в SSO, выделения только на рост массива
+    myarray *array = new myarray();
+
+    Stopwatch sw;
+    sw.start();
+    for (size_t i = 0; i < n; i++)
+        array->push(keys[i]);
+    sw.stop(m);
+    m.ops += n;
+
+    delete array;
+    delete[] keys;
+}
+
+// ---- Document ----
+
+static const size_t DOC_BATCH = 1000;
+
+static void benchDocDeserialize(size_t fields, Measurement &m)
+{
+    Document *sample = makeDocument(12345, fields);
+    string json = sample->serialize();
+    delete sample;
+    Document **parsed = new Document *[DOC_BATCH];
+
+    Stopwatch sw;
+    sw.start();
+    for (size_t i = 0; i < DOC_BATCH; i++)
+        parsed[i] = Document::deserialize(json);
+    sw.stop(m);
+    m.ops += DOC_BATCH;
+
+    for (size_t i = 0; i < DOC_BATCH; i++)
+        delete parsed[i];
+    delete[] parsed;
+}
+
+static void benchDocSerialize(size_t fields, Measurement &m)
+{
+    Document *doc = makeDocument(12345, fields);
+
+    Stopwatch sw;
+    sw.start();
+    size_t total = 0;
+    for (size_t i = 0; i < DOC_BATCH; i++)
+        total += doc->serialize().size();
+    sw.stop(m);
+    m.ops += DOC_BATCH;
+    g_sink = g_sink + total;
+
+    delete doc;
+}
+
+// ---- like_match ----
+
+struct LikeCase
+{
+    const char *label;
+    string value;
+    string pattern;
+    size_t calls; // вызовов за проход
+};
+
+// обычные шаблоны и худшие для перебора с откатом: каждая '%' пробует все позиции,
+// а хвост не совпадает никогда
+static LikeCase *likeCases(size_t &count)
+{
+    static LikeCase cases[] = {
+        {"prefix", "Alexander Petrov", "Alex%", 1000},
+        {"contains_4k", string(4096, 'x') + "needle", "%needle%", 10},
+        {"underscores", "abcdefghijklmnopqrstuvwxyz", "a________________________z", 1000},
+        {"adversarial_16", string(16, 'a'), "%a%a%a%a%b", 1},
+        {"adversarial_24", string(24, 'a'), "%a%a%a%a%b", 1},
+        {"adversarial_32", string(32, 'a'), "%a%a%a%a%b", 1},
+    };
+    count = sizeof(cases) / sizeof(cases[0]);
+    return cases;
+}
+
+static void benchLike(size_t which, Measurement &m)
+{
+    size_t count = 0;
+    const LikeCase &c = likeCases(count)[which];
+
+    Stopwatch sw;
+    sw.start();
+    size_t matched = 0;
+    for (size_t i = 0; i < c.calls; i++)
+    {
+        if (like_match(c.value, c.pattern))
+            matched++;
+    }
+    sw.stop(m);
+    m.ops += c.calls;
+    g_sink = g_sink + matched;
+}
+
+// ---- условия запросов ----
+
+struct QueryShape
+{
+    const char *label;
+    const char *json;
+};
+
+static const QueryShape QUERY_SHAPES[] = {
+    {"eq", "{\"city\":\"Kazan\"}"},
+    {"eq_two_fields", "{\"city\":\"Kazan\",\"age\":\"33\"}"},
+    {"range", "{\"age\":{\"$gt\":30,\"$lt\":60}}"},
+    {"in_8", "{\"city\":{\"$in\":[\"A\",\"B\",\"C\",\"D\",\"Omsk\",\"F\",\"G\",\"H\"]}}"},
+    {"like", "{\"name\":{\"$like\":\"user1%\"}}"},
+    {"or_and", "{\"$or\":[{\"age\":{\"$lt\":10}},{\"$and\":[{\"city\":\"Tver\"},{\"age\":{\"$gt\":50}}]}]}"},
+};
+static const size_t QUERY_SHAPE_COUNT = sizeof(QUERY_SHAPES) / sizeof(QUERY_SHAPES[0]);
+static const size_t MATCH_DOCS = 1000;
+
+static void benchMatch(size_t which, Measurement &m)
+{
+    Document **docs = new Document *[MATCH_DOCS];
+    for (size_t i = 0; i < MATCH_DOCS; i++)
+        docs[i] = makeDocument(i, 6);
+    CompiledQuery query(QUERY_SHAPES[which].json);
+    QueryParams no_params;
+
+    Stopwatch sw;
+    sw.start();
+    size_t matched = 0;
+    for (size_t i = 0; i < MATCH_DOCS; i++)
+    {
+        if (query.matches(docs[i], no_params))
+            matched++;
+    }
+    sw.stop(m);
+    m.ops += MATCH_DOCS;
+    g_sink = g_sink + matched;
+
+    for (size_t i = 0; i < MATCH_DOCS; i++)
+        delete docs[i];
+    delete[] docs;
+}
+
+// ---- файл коллекции ----
+
+static const char *BENCH_DIR = "bench_core_data";
+
+static string collectionName(size_t n)
+{
+    return "bench_" + to_string(n);
+}
+
+static MiniDBMS *makeCollection(size_t n)
+{
+    MiniDBMS *db = new MiniDBMS(collectionName(n), BENCH_DIR);
+    MiniDBMS::WriteScope batch(*db);
+    for (size_t i = 0; i < n; i++)
+        db->insertDocument(makeDocument(i, 6));
+    return db;
+}
+
+// ops - документы: ns/op - цена документа, ops/s - документов в секунду
+static void benchSave(size_t n, Measurement &m)
+{
+    MiniDBMS *db = makeCollection(n);
+
+    Stopwatch sw;
+    sw.start();
+    db->saveToDisk();
+    sw.stop(m);
+    m.ops += n;
+
+    delete db;
+}
+
+static void benchLoad(size_t n, Measurement &m)
+{
+    MiniDBMS *source = makeCollection(n);
+    source->saveToDisk();
+    delete source;
+
+    MiniDBMS *db = new MiniDBMS(collectionName(n), BENCH_DIR);
+    Stopwatch sw;
+    sw.start();
+    db->loadFromDisk();
+    sw.stop(m);
+    m.ops += n;
+
+    delete db;
+}
+
+// ---- запуск ----
+
+struct BenchCase
+{
+    string name;
+    size_t param;
+    BenchFn fn;
+    BenchCase *next;
+};
+
+static BenchCase *g_cases = nullptr;
+static BenchCase *g_casesTail = nullptr;
+
+static void addCase(const string &name, size_t param, BenchFn fn)
+{
+    BenchCase *c = new BenchCase{name, param, fn, nullptr};
+    if (g_casesTail)
+        g_casesTail->next = c;
+    else
+        g_cases = c;
+    g_casesTail = c;
+}
+
+static void report(const BenchCase &c, const Measurement &m, bool json)
+{
+    double ops = m.ops ? static_cast<double>(m.ops) : 1.0;
+    double ns_per_op = static_cast<double>(m.ns) / ops;
+    double allocs_per_op = static_cast<double>(m.allocs) / ops;
+    double bytes_per_op = static_cast<double>(m.bytes) / ops;
+    double ops_per_sec = m.ns > 0 ? static_cast<double>(m.ops) * 1e9 / static_cast<double>(m.ns) : 0.0;
+
+    if (json)
+    {
+        printf("{\"name\":\"%s\",\"param\":%zu,\"ops\":%llu,\"ns_per_op\":%.2f,\"allocs_per_op\":%.3f,"
+               "\"bytes_per_op\":%.1f,\"ops_per_sec\":%.0f}\n",
+               c.name.c_str(), c.param, static_cast<unsigned long long>(m.ops), ns_per_op, allocs_per_op,
+               bytes_per_op, ops_per_sec);
+    }
+    else
+    {
+        printf("%-28s %10zu %12.1f ns/op %9.2f allocs/op %10.1f B/op %14.0f ops/s\n",
+               c.name.c_str(), c.param, ns_per_op, allocs_per_op, bytes_per_op, ops_per_sec);
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    bool json = false;
+    string filter;
+    size_t max_keys = 1000000;
+    long long min_ns = 300LL * 1000000;
+
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--json")
+            json = true;
+        else if (arg == "--filter" && i + 1 < argc)
+            filter = argv[++i];
+        else if (arg == "--max-keys" && i + 1 < argc)
+            max_keys = static_cast<size_t>(atoll(argv[++i]));
+        else if (arg == "--min-ms" && i + 1 < argc)
+            min_ns = atoll(argv[++i]) * 1000000LL;
+        else
+        {
+            fprintf(stderr, "usage: %s [--json] [--filter substring] [--max-keys N] [--min-ms N]\n", argv[0]);
+            return 1;
+        }
+    }
+    setLogLevel(LOG_LEVEL_WARN); // INFO о загрузке коллекций не мешает выводу
+
+    for (size_t n = 1000; n <= max_keys; n *= 10)
+    {
+        addCase("map_put", n, benchMapPut);
+        addCase("map_get", n, benchMapGet);
+        addCase("map_get_miss", n, benchMapGetMiss);
+        addCase("map_remove", n, benchMapRemove);
+        addCase("map_resize", n, benchMapResize);
+    }
+    for (size_t n = 1000; n <= max_keys; n *= 10)
+        addCase("myarray_push", n, benchArrayPush);
+    addCase("doc_deserialize", 3, benchDocDeserialize);
+    addCase("doc_deserialize", 20, benchDocDeserialize);
+    addCase("doc_serialize", 3, benchDocSerialize);
+    addCase("doc_serialize", 20, benchDocSerialize);
+
+    size_t like_count = 0;
+    LikeCase *like = likeCases(like_count);
+    for (size_t i = 0; i < like_count; i++)
+        addCase(string("like_") + like[i].label, i, benchLike);
+    for (size_t i = 0; i < QUERY_SHAPE_COUNT; i++)
+        addCase(string("match_") + QUERY_SHAPES[i].label, i, benchMatch);
+    for (size_t n = 1000; n <= 100000; n *= 10)
+    {
+        addCase("disk_save", n, benchSave);
+        addCase("disk_load", n, benchLoad);
+    }
+
+    mkdir(BENCH_DIR, 0755);
+    if (!json)
+    {
+        printf("%-28s %10s %15s %19s %15s %20s\n", "case", "param", "time", "allocations", "bytes", "throughput");
+    }
+
+    for (BenchCase *c = g_cases; c; c = c->next)
+    {
+        if (!filter.empty() && c->name.find(filter) == string::npos)
+            continue;
+
+        // проходы, пока не наберётся min_ns чистого времени
+        Measurement m;
+        do
+        {
+            c->fn(c->param, m);
+        } while (m.ns < min_ns);
+        report(*c, m, json);
+    }
+
+    for (size_t n = 1000; n <= 100000; n *= 10)
+        ::remove((string(BENCH_DIR) + "/" + collectionName(n) + ".json").c_str());
+    ::rmdir(BENCH_DIR);
+    return 0;
+}
@@ -0,0 +1,128 @@
+// сравнение чтения строк из сокета: recv() по одному байту против LineReader
+// сборка: g++ -std=c++17 -O2 -pthread bench_io.cpp line_reader.cpp -o bench_io
+#include "line_reader.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+
+using namespace std;
+
+// старый способ: один системный вызов на каждый байт
+static bool readLineBytewise(int sock, string &out)
+{
+    out.clear();
+    char ch = 0;
+    while (true)
+    {
+        ssize_t n = ::recv(sock, &ch, 1, 0);
+        if (n <= 0)
+            return false;
+        if (ch == '\n')
+            return true;
+        out.push_back(ch);
+    }
+}
+
+static bool readLineBuffered(int sock, LineReader &reader, string &out)
+{
+    string_view line;
+    while (!reader.nextLine(line))
+    {
+        if (reader.fill(sock) <= 0)
+            return false;
+    }
+    out.assign(line.data(), line.size());
+    return true;
+}
+
+static void writeLines(int sock, const string &line, size_t count)
+{
+    // пачками, чтобы писатель не был узким местом
+    string chunk;
+    size_t per_chunk = line.size() >= 64 * 1024 ? 1 : (64 * 1024) / line.size();
+    for (size_t i = 0; i < per_chunk; ++i)
+        chunk += line;
+
+    size_t written = 0;
+    while (written < count)
+    {
+        size_t lines = per_chunk < count - written ? per_chunk : count - written;
+        const char *p = chunk.data();
+        size_t left = lines * line.size();
+        while (left > 0)
+        {
+            ssize_t n = ::send(sock, p, left, 0);
+            if (n <= 0)
+                return;
+            p += n;
+            left -= static_cast<size_t>(n);
+        }
+        written += lines;
+    }
+}
+
+static void run(const char *name, size_t line_size, size_t count, bool buffered)
+{
+    int sv[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+    {
+        perror("socketpair");
+        exit(1);
+    }
+
+    string line(line_size - 1, 'x');
+    line[0] = '{';
+    line[line.size() - 1] = '}';
+    line += '\n';
+
+    thread writer([&]
+                  { writeLines(sv[0], line, count); ::shutdown(sv[0], SHUT_WR); });
+
+    auto start = chrono::steady_clock::now();
+    LineReader reader;
+    string out;
+    size_t got = 0;
+    size_t bytes = 0;
+    while (buffered ? readLineBuffered(sv[1], reader, out) : readLineBytewise(sv[1], out))
+    {
+        ++got;
+        bytes += out.size() + 1;
+    }
+    double sec = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    writer.join();
+    ::close(sv[0]);
+    ::close(sv[1]);
+
+    if (got != count)
+    {
+        cerr << name << ": got " << got << " lines, expected " << count << "\n";
+        exit(1);
+    }
+    printf("%-10s line=%-8zu lines=%-8zu %12.0f lines/s %10.1f MB/s\n",
+           name, line_size, count, got / sec, bytes / sec / (1024.0 * 1024.0));
+}
+
+int main(int argc, char *argv[])
+{
+    // множитель объёма: bench_io [scale]
+    size_t scale = argc > 1 ? static_cast<size_t>(atoi(argv[1])) : 1;
+    if (scale == 0)
+        scale = 1;
+
+    const size_t sizes[] = {64, 512, 4096, 1024 * 1024};
+    for (size_t size : sizes)
+    {
+        size_t total = 8 * 1024 * 1024 * scale; // одинаковый объём данных на каждый размер
+        size_t count = total / size;
+        run("bytewise", size, count, false);
+        run("buffered", size, count, true);
+    }
+    return 0;
+}
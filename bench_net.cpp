@@ -0,0 +1,224 @@
+// сравнение сетевых реакторов сервера (--io epoll против --io uring) при множестве соединений
+// сборка: g++ -std=c++17 -O2 bench_net.cpp line_reader.cpp -o bench_net
+// запуск:  bench_net <порт> [соединений] [запросов на соединение] [глубина конвейера] [pid сервера]
+// с pid дополнительно печатается процессорное время сервера и переключения контекста на запрос
+// (по /proc) - это и есть цена системных вызовов реактора; сравнивать два запуска:
+//   db_server 7000 mydb --io epoll  и  db_server 7000 mydb --io uring
+#include "line_reader.h"
+
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+struct Client
+{
+    int fd = -1;
+    LineReader in;
+    size_t sent = 0;     // запросов отправлено
+    size_t received = 0; // ответов получено
+};
+
+// процессорное время и переключения контекста всех потоков процесса
+struct ServerUsage
+{
+    double cpu_seconds = 0;
+    long long context_switches = 0;
+};
+
+static ServerUsage readUsage(int pid)
+{
+    ServerUsage usage;
+    if (pid <= 0)
+        return usage;
+
+    ifstream stat("/proc/" + to_string(pid) + "/stat");
+    string line;
+    getline(stat, line);
+    // после ")" идут поля с третьего: utime и stime - 14-е и 15-е
+    size_t pos = line.rfind(')');
+    if (pos != string::npos)
+    {
+        const char *p = line.c_str() + pos + 2;
+        unsigned long long utime = 0, stime = 0;
+        for (int field = 3; field <= 15 && *p; ++field)
+        {
+            if (field == 14)
+                utime = strtoull(p, nullptr, 10);
+            if (field == 15)
+                stime = strtoull(p, nullptr, 10);
+            p = strchr(p, ' ');
+            if (!p)
+                break;
+            ++p;
+        }
+        usage.cpu_seconds = static_cast<double>(utime + stime) / static_cast<double>(sysconf(_SC_CLK_TCK));
+    }
+
+    string tasks = "/proc/" + to_string(pid) + "/task";
+    DIR *dir = opendir(tasks.c_str());
+    while (dir)
+    {
+        dirent *entry = readdir(dir);
+        if (!entry)
+            break;
+        if (entry->d_name[0] == '.')
+            continue;
+        ifstream status(tasks + "/" + entry->d_name + "/status");
+        while (getline(status, line))
+        {
+            if (line.compare(0, 24, "voluntary_ctxt_switches:") == 0)
+                usage.context_switches += atoll(line.c_str() + 24);
+            else if (line.compare(0, 27, "nonvoluntary_ctxt_switches:") == 0)
+                usage.context_switches += atoll(line.c_str() + 27);
+        }
+    }
+    if (dir)
+        closedir(dir);
+    return usage;
+}
+
+static int connectTo(int port)
+{
+    int sock = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    if (::connect(sock, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0)
+    {
+        perror("connect");
+        exit(1);
+    }
+    int one = 1;
+    ::setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return sock;
+}
+
+static void sendAll(int sock, const string &data)
+{
+    size_t sent = 0;
+    while (sent < data.size())
+    {
+        ssize_t n = ::send(sock, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0)
+        {
+            perror("send");
+            exit(1);
+        }
+        sent += static_cast<size_t>(n);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        cerr << "Usage: " << argv[0] << " <port> [connections] [requests_per_connection] [depth] [server_pid]\n";
+        return 1;
+    }
+    int port = atoi(argv[1]);
+    size_t connections = argc > 2 ? static_cast<size_t>(atol(argv[2])) : 200;
+    size_t per_connection = argc > 3 ? static_cast<size_t>(atol(argv[3])) : 500;
+    size_t depth = argc > 4 ? static_cast<size_t>(atol(argv[4])) : 4;
+    int server_pid = argc > 5 ? atoi(argv[5]) : 0;
+    if (connections == 0 || per_connection == 0 || depth == 0)
+    {
+        cerr << "connections, requests and depth must be positive\n";
+        return 1;
+    }
+
+    // дешёвый точечный запрос: замеряется реактор, а не исполнение
+    const string request = "{\"database\":\"bench_net\",\"operation\":\"find\",\"query\":{\"_id\":\"1\"}}\n";
+
+    Client *clients = new Client[connections];
+    int epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+    for (size_t i = 0; i < connections; ++i)
+    {
+        clients[i].fd = connectTo(port);
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.ptr = &clients[i];
+        ::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, clients[i].fd, &ev);
+    }
+
+    ServerUsage before = readUsage(server_pid);
+    auto start = chrono::steady_clock::now();
+
+    // у каждого соединения в полёте до depth запросов
+    auto refill = [&](Client &client)
+    {
+        if (client.sent != client.received || client.sent == per_connection)
+            return;
+        size_t batch = per_connection - client.sent < depth ? per_connection - client.sent : depth;
+        string out;
+        for (size_t i = 0; i < batch; ++i)
+            out += request;
+        sendAll(client.fd, out);
+        client.sent += batch;
+    };
+    for (size_t i = 0; i < connections; ++i)
+        refill(clients[i]);
+
+    size_t finished = 0;
+    epoll_event events[256];
+    while (finished < connections)
+    {
+        int n = ::epoll_wait(epoll_fd, events, 256, 10000);
+        if (n <= 0)
+        {
+            cerr << "server stopped answering\n";
+            return 1;
+        }
+        for (int e = 0; e < n; ++e)
+        {
+            Client &client = *static_cast<Client *>(events[e].data.ptr);
+            if (client.in.fill(client.fd) <= 0)
+            {
+                cerr << "server closed connection\n";
+                return 1;
+            }
+            string_view line;
+            while (client.in.nextLine(line))
+                client.received++;
+            if (client.received == per_connection)
+            {
+                ::epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client.fd, nullptr);
+                finished++;
+            }
+            refill(client);
+        }
+    }
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    ServerUsage after = readUsage(server_pid);
+    size_t total = connections * per_connection;
+
+    printf("connections=%zu depth=%zu requests=%zu: %.1f ms, %.0f req/s\n",
+           connections, depth, total, seconds * 1000.0, total / seconds);
+    if (server_pid > 0)
+    {
+        printf("server: %.2f us CPU/request, %.3f context switches/request\n",
+               (after.cpu_seconds - before.cpu_seconds) * 1e6 / total,
+               static_cast<double>(after.context_switches - before.context_switches) / total);
+    }
+
+    for (size_t i = 0; i < connections; ++i)
+        ::close(clients[i].fd);
+    delete[] clients;
+    ::close(epoll_fd);
+    return 0;
+}
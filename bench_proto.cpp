@@ -0,0 +1,289 @@
+// сравнение протоколов на живом сервере: JSON-строки против бинарных кадров
+// сборка: g++ -std=c++17 -O2 -pthread bench_proto.cpp binary_protocol.cpp line_reader.cpp document.cpp myarray.cpp utills.cpp logger.cpp async_log.cpp -o bench_proto
+// запуск:  bench_proto <порт> [документов] [запросов]
+// результаты обоих протоколов сверяются: те же документы в том же порядке
+#include "binary_protocol.h"
+#include "document.h"
+#include "line_reader.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+static const char *DB_NAME = "bench_proto";
+static const size_t PIPELINE = 64; // запросов в одной пачке отправки
+
+static int connectTo(int port)
+{
+    int sock = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    if (::connect(sock, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0)
+    {
+        perror("connect");
+        exit(1);
+    }
+    int one = 1;
+    ::setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return sock;
+}
+
+static void sendAll(int sock, const string &data)
+{
+    size_t sent = 0;
+    while (sent < data.size())
+    {
+        ssize_t n = ::send(sock, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0)
+        {
+            perror("send");
+            exit(1);
+        }
+        sent += static_cast<size_t>(n);
+    }
+}
+
+static string readLine(int sock, LineReader &reader)
+{
+    string_view line;
+    while (!reader.nextLine(line))
+    {
+        if (reader.fill(sock) <= 0)
+        {
+            cerr << "server closed connection\n";
+            exit(1);
+        }
+    }
+    return string(line);
+}
+
+static string readFrame(int sock, LineReader &reader)
+{
+    string_view frame;
+    while (!reader.nextFrame(frame))
+    {
+        if (reader.fill(sock) <= 0)
+        {
+            cerr << "server closed connection\n";
+            exit(1);
+        }
+    }
+    return string(frame);
+}
+
+// ответ бинарного протокола: статус, count и документы в JSON-виде для сверки
+struct BinaryAnswer
+{
+    uint8_t status = BIN_ERROR;
+    uint64_t count = 0;
+    string message;
+    string docs_json; // документы через запятую, как в "data" JSON-ответа
+};
+
+static BinaryAnswer decodeAnswer(const string &frame, bool with_docs)
+{
+    BinaryAnswer answer;
+    BinaryReader reader(frame);
+    string_view message;
+    if (!reader.u8(answer.status) || !reader.u64(answer.count) || !reader.str(message))
+    {
+        cerr << "bad response frame\n";
+        exit(1);
+    }
+    answer.message = string(message);
+    for (uint64_t i = 0; with_docs && i < answer.count; ++i)
+    {
+        Document *doc = Document::deserializeBinary(reader);
+        if (!doc)
+        {
+            cerr << "bad document in response\n";
+            exit(1);
+        }
+        if (i > 0)
+            answer.docs_json += ',';
+        answer.docs_json += doc->serialize();
+        delete doc;
+    }
+    return answer;
+}
+
+static string binaryQuery(BinaryOpcode opcode, uint32_t db_id, const string &query)
+{
+    string body;
+    putString(body, query);
+    return makeBinaryRequest(opcode, db_id, body);
+}
+
+static string jsonRequest(const string &operation, const string &field, const string &value)
+{
+    return "{\"database\":\"" + string(DB_NAME) + "\",\"operation\":\"" + operation + "\",\"" + field + "\":" + value + "}\n";
+}
+
+// "data":[...] из JSON-ответа без скобок
+static string jsonData(const string &response)
+{
+    size_t start = response.find("\"data\":[");
+    size_t end = response.rfind(']');
+    if (start == string::npos || end == string::npos)
+        return string();
+    start += 8;
+    return response.substr(start, end - start);
+}
+
+static double seconds_since(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        cerr << "Usage: " << argv[0] << " <port> [docs] [requests]\n";
+        return 1;
+    }
+    int port = atoi(argv[1]);
+    size_t docs = argc > 2 ? static_cast<size_t>(atol(argv[2])) : 1000;
+    size_t requests = argc > 3 ? static_cast<size_t>(atol(argv[3])) : 20000;
+
+    // бинарное соединение: приветствие, открытие базы, чистый набор документов
+    int bin = connectTo(port);
+    LineReader bin_reader;
+    sendAll(bin, string(BINARY_MAGIC, sizeof(BINARY_MAGIC)));
+    {
+        string_view ack;
+        while (bin_reader.peek().size() < sizeof(BINARY_MAGIC))
+            bin_reader.fill(bin);
+        ack = bin_reader.peek().substr(0, sizeof(BINARY_MAGIC));
+        if (ack != string_view(BINARY_MAGIC, sizeof(BINARY_MAGIC)))
+        {
+            cerr << "server does not speak the binary protocol\n";
+            return 1;
+        }
+        bin_reader.consume(sizeof(BINARY_MAGIC));
+    }
+
+    sendAll(bin, makeBinaryRequest(BIN_OPEN, 0, DB_NAME));
+    uint32_t db_id = static_cast<uint32_t>(decodeAnswer(readFrame(bin, bin_reader), false).count);
+
+    sendAll(bin, binaryQuery(BIN_DELETE, db_id, "{}"));
+    readFrame(bin, bin_reader);
+
+    string body;
+    putU32(body, static_cast<uint32_t>(docs));
+    for (size_t i = 0; i < docs; ++i)
+    {
+        Document doc;
+        doc.addField("name", "user" + to_string(i));
+        doc.addField("age", to_string(i % 90));
+        doc.addField("city", i % 2 ? "Paris" : "Berlin");
+        doc.serializeBinary(body);
+    }
+    auto start = chrono::steady_clock::now();
+    sendAll(bin, makeBinaryRequest(BIN_INSERT, db_id, body));
+    BinaryAnswer inserted = decodeAnswer(readFrame(bin, bin_reader), false);
+    printf("binary INSERT of %zu docs: %.1f ms (%s)\n", docs, seconds_since(start) * 1000.0, inserted.message.c_str());
+
+    // после вставки _id идут подряд - берём первый из самой базы
+    sendAll(bin, binaryQuery(BIN_FIND, db_id, "{}"));
+    BinaryAnswer all = decodeAnswer(readFrame(bin, bin_reader), true);
+    size_t id_pos = all.docs_json.find("\"_id\":\"");
+    long long first_id = -1;
+    for (size_t pos = id_pos; pos != string::npos; pos = all.docs_json.find("\"_id\":\"", pos + 1))
+    {
+        long long id = atoll(all.docs_json.c_str() + pos + 7);
+        if (first_id < 0 || id < first_id)
+            first_id = id;
+    }
+
+    int text = connectTo(port);
+    LineReader text_reader;
+
+    // 1. точечные FIND по _id, конвейером по PIPELINE
+    double point_time[2] = {0, 0};
+    for (int binary = 0; binary < 2; ++binary)
+    {
+        start = chrono::steady_clock::now();
+        for (size_t done = 0; done < requests;)
+        {
+            size_t batch = requests - done < PIPELINE ? requests - done : PIPELINE;
+            string out;
+            for (size_t i = 0; i < batch; ++i)
+            {
+                string query = "{\"_id\":\"" + to_string(first_id + static_cast<long long>((done + i) % docs)) + "\"}";
+                out += binary ? binaryQuery(BIN_FIND, db_id, query) : jsonRequest("find", "query", query);
+            }
+            sendAll(binary ? bin : text, out);
+            for (size_t i = 0; i < batch; ++i)
+            {
+                if (binary)
+                {
+                    if (decodeAnswer(readFrame(bin, bin_reader), false).count != 1)
+                    {
+                        cerr << "binary point FIND did not find the document\n";
+                        return 1;
+                    }
+                }
+                else
+                {
+                    readLine(text, text_reader);
+                }
+            }
+            done += batch;
+        }
+        point_time[binary] = seconds_since(start);
+    }
+    printf("point FIND x%zu:   json %8.0f req/s   binary %8.0f req/s\n",
+           requests, requests / point_time[0], requests / point_time[1]);
+
+    // 2. FIND всех документов: здесь основная разница - сериализация и экранирование
+    size_t scans = requests / 100 > 0 ? requests / 100 : 1;
+    double scan_time[2] = {0, 0};
+    string json_response, binary_response;
+    for (int binary = 0; binary < 2; ++binary)
+    {
+        start = chrono::steady_clock::now();
+        for (size_t i = 0; i < scans; ++i)
+        {
+            if (binary)
+            {
+                sendAll(bin, binaryQuery(BIN_FIND, db_id, "{}"));
+                binary_response = readFrame(bin, bin_reader);
+            }
+            else
+            {
+                sendAll(text, jsonRequest("find", "query", "{}"));
+                json_response = readLine(text, text_reader);
+            }
+        }
+        scan_time[binary] = seconds_since(start);
+    }
+    printf("FIND {} x%zu (%zu docs): json %8.1f ms   binary %8.1f ms\n",
+           scans, docs, scan_time[0] * 1000.0, scan_time[1] * 1000.0);
+
+    // сверка последнего ответа: бинарные документы обратно в JSON
+    string json_docs = jsonData(json_response);
+    string binary_docs = decodeAnswer(binary_response, true).docs_json;
+    if (json_docs != binary_docs)
+    {
+        cerr << "MISMATCH: JSON and binary FIND returned different documents\n";
+        return 1;
+    }
+    printf("results match: %zu bytes of documents\n", json_docs.size());
+
+    ::close(bin);
+    ::close(text);
+    return 0;
+}
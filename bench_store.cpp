@@ -0,0 +1,212 @@
+// многопоточная проверка и замер конкуренции хранилища MiniDBMS
+// сборка: g++ -std=c++17 -O2 -pthread bench_store.cpp minidbms.cpp document.cpp custom_hashmap.cpp
+//         myarray.cpp utills.cpp query.cpp plan_cache.cpp result_cache.cpp snapshot.cpp rwlock.cpp binary_protocol.cpp uring.cpp metrics.cpp trace.cpp logger.cpp async_log.cpp
+//         -o bench_store
+// запуск:  bench_store stress [потоки]   - параллельные записи/чтения с проверкой результата
+//          bench_store bench  [секунды]  - точечные UPDATE по _id: общая блокировка против полос
+#include "minidbms.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+
+using namespace std;
+
+static void insertDocs(MiniDBMS &db, const string &group, int count)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        db.insertQuery("{\"grp\":\"" + group + "\",\"n\":\"0\"}");
+    }
+}
+
+// _id документов группы (потоки вставляют вперемешку, поэтому берём из самих документов)
+static myarray idsOfGroup(MiniDBMS &db, const string &group)
+{
+    string json;
+    size_t count = 0;
+    db.findQueryToJsonArray("{\"grp\":\"" + group + "\"}", json, count);
+    myarray ids;
+    size_t pos = 0;
+    while ((pos = json.find("\"_id\":\"", pos)) != string::npos)
+    {
+        pos += 7;
+        size_t end = json.find('"', pos);
+        ids.push(json.substr(pos, end - pos));
+        pos = end;
+    }
+    return ids;
+}
+
+static int failures = 0;
+static mutex failures_mtx;
+
+static void fail(const string &message)
+{
+    lock_guard<mutex> lock(failures_mtx);
+    failures++;
+    if (failures <= 10)
+        cerr << "FAIL: " << message << "\n";
+}
+
+static int runStress(int threads)
+{
+    const int DOCS_PER_THREAD = 50;
+    const int ROUNDS = 200;
+
+    MiniDBMS db("stress", "/tmp");
+    for (int t = 0; t < threads; ++t)
+        insertDocs(db, "w" + to_string(t), DOCS_PER_THREAD);
+    insertDocs(db, "fixed", 100);
+
+    atomic<bool> stop{false};
+    atomic<long long> reads{0};
+
+    // писатели: каждый инкрементирует свои документы по _id, вставляет и удаляет мусор
+    thread *writers = new thread[threads];
+    for (int t = 0; t < threads; ++t)
+    {
+        writers[t] = thread([&, t]
+                            {
+            myarray ids = idsOfGroup(db, "w" + to_string(t));
+            for (int round = 0; round < ROUNDS; ++round)
+            {
+                for (size_t i = 0; i < ids.getSize(); ++i)
+                {
+                    if (db.updateQuery("{\"_id\":" + ids[i] + "}", "{\"$inc\":{\"n\":1}}") != 1)
+                        fail("update по _id " + ids[i] + " не нашёл документ");
+                }
+                // вставки растят таблицу, удаления дают сборщику работу
+                db.insertQuery("{\"grp\":\"tmp" + to_string(t) + "\"}");
+                if (round % 10 == 9)
+                    db.deleteQuery("{\"grp\":\"tmp" + to_string(t) + "\"}");
+            } });
+    }
+
+    // читатели: снимок всегда согласован - "fixed" на месте, счётчики потока одинаковы
+    thread *readers = new thread[threads];
+    for (int t = 0; t < threads; ++t)
+    {
+        readers[t] = thread([&, t]
+                            {
+            string json;
+            size_t count = 0;
+            while (!stop.load())
+            {
+                count = db.countQuery("{\"grp\":\"fixed\"}");
+                if (count != 100)
+                    fail("fixed: " + to_string(count) + " документов вместо 100");
+                db.findQueryToJsonArray("{\"grp\":\"w" + to_string(t) + "\"}", json, count);
+                if (count != DOCS_PER_THREAD)
+                    fail("w" + to_string(t) + ": " + to_string(count) + " документов");
+                reads++;
+            } });
+    }
+
+    for (int t = 0; t < threads; ++t)
+        writers[t].join();
+    stop.store(true);
+    for (int t = 0; t < threads; ++t)
+        readers[t].join();
+    delete[] writers;
+    delete[] readers;
+
+    // итог: каждый документ писателя увеличен ровно ROUNDS раз
+    for (int t = 0; t < threads; ++t)
+    {
+        size_t expected = db.countQuery("{\"grp\":\"w" + to_string(t) + "\",\"n\":" + to_string(ROUNDS) + "}");
+        if (expected != DOCS_PER_THREAD)
+            fail("w" + to_string(t) + ": только " + to_string(expected) + " документов с n=" + to_string(ROUNDS));
+    }
+
+    printf("stress: threads=%d updates=%d reads=%lld failures=%d\n",
+           threads, threads * DOCS_PER_THREAD * ROUNDS, reads.load(), failures);
+    return failures == 0 ? 0 : 1;
+}
+
+// одна точка замера: threads потоков обновляют свои документы по _id
+static double runBench(int threads, double seconds, bool global_lock)
+{
+    MiniDBMS db("bench", "/tmp");
+    for (int t = 0; t < threads; ++t)
+        insertDocs(db, "w" + to_string(t), 64);
+
+    mutex global; // как прежний DbEntry::mtx: одна блокировка на всю базу
+    atomic<bool> stop{false};
+    atomic<long long> ops{0};
+
+    thread *workers = new thread[threads];
+    for (int t = 0; t < threads; ++t)
+    {
+        workers[t] = thread([&, t]
+                            {
+            myarray ids = idsOfGroup(db, "w" + to_string(t));
+            long long local = 0;
+            size_t i = 0;
+            while (!stop.load())
+            {
+                string query = "{\"_id\":" + ids[i++ % ids.getSize()] + "}";
+                if (global_lock)
+                {
+                    lock_guard<mutex> lock(global);
+                    db.updateQuery(query, "{\"$inc\":{\"n\":1}}");
+                }
+                else
+                {
+                    db.updateQuery(query, "{\"$inc\":{\"n\":1}}");
+                }
+                local++;
+            }
+            ops += local; });
+    }
+
+    this_thread::sleep_for(chrono::duration<double>(seconds));
+    stop.store(true);
+    for (int t = 0; t < threads; ++t)
+        workers[t].join();
+    delete[] workers;
+    return ops.load() / seconds;
+}
+
+int main(int argc, char *argv[])
+{
+    string mode = argc > 1 ? argv[1] : "stress";
+
+    // insertQuery печатает каждую вставку - здесь это только шум
+    ostringstream sink;
+    streambuf *old_cout = cout.rdbuf(sink.rdbuf());
+
+    int rc = 0;
+    if (mode == "stress")
+    {
+        int threads = argc > 2 ? atoi(argv[2]) : 8;
+        rc = runStress(threads > 0 ? threads : 8);
+    }
+    else if (mode == "bench")
+    {
+        double seconds = argc > 2 ? atof(argv[2]) : 1.0;
+        printf("hardware threads: %u\n", thread::hardware_concurrency());
+        const int counts[] = {1, 2, 4, 8, 16};
+        for (int threads : counts)
+        {
+            double global_ops = runBench(threads, seconds, true);
+            double striped_ops = runBench(threads, seconds, false);
+            printf("threads=%-3d global lock %10.0f upd/s   striped %10.0f upd/s\n",
+                   threads, global_ops, striped_ops);
+        }
+    }
+    else
+    {
+        cerr << "Usage: " << argv[0] << " stress [threads] | bench [seconds]\n";
+        rc = 1;
+    }
+
+    cout.rdbuf(old_cout);
+    return rc;
+}
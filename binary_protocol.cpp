@@ -0,0 +1,130 @@
+#include "binary_protocol.h"
+
+#include <stdexcept>
+
+using namespace std;
+
+void putU16(string &out, uint16_t value)
+{
+    out.push_back(static_cast<char>(value & 0xff));
+    out.push_back(static_cast<char>(value >> 8));
+}
+
+void putU32(string &out, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i)
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+}
+
+void putU64(string &out, uint64_t value)
+{
+    for (int i = 0; i < 8; ++i)
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+}
+
+void putString(string &out, string_view value)
+{
+    if (value.size() > 0xffffffffULL)
+        throw length_error("Строка длиннее 4 ГБ");
+    putU32(out, static_cast<uint32_t>(value.size()));
+    out.append(value.data(), value.size());
+}
+
+BinaryReader::BinaryReader(string_view data)
+    : pos(data.data()), end(data.data() + data.size()), failed(false) {}
+
+bool BinaryReader::ensure(size_t size)
+{
+    if (!failed && static_cast<size_t>(end - pos) >= size)
+        return true;
+    failed = true;
+    return false;
+}
+
+bool BinaryReader::u8(uint8_t &value)
+{
+    if (!ensure(1))
+        return false;
+    value = static_cast<uint8_t>(*pos++);
+    return true;
+}
+
+bool BinaryReader::u16(uint16_t &value)
+{
+    if (!ensure(2))
+        return false;
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(pos);
+    value = static_cast<uint16_t>(p[0] | p[1] << 8);
+    pos += 2;
+    return true;
+}
+
+bool BinaryReader::u32(uint32_t &value)
+{
+    if (!ensure(4))
+        return false;
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(pos);
+    value = static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 |
+            static_cast<uint32_t>(p[2]) << 16 | static_cast<uint32_t>(p[3]) << 24;
+    pos += 4;
+    return true;
+}
+
+bool BinaryReader::u64(uint64_t &value)
+{
+    uint32_t low = 0, high = 0;
+    if (!u32(low) || !u32(high))
+        return false;
+    value = static_cast<uint64_t>(high) << 32 | low;
+    return true;
+}
+
+bool BinaryReader::str(string_view &value)
+{
+    uint32_t size = 0;
+    if (!u32(size))
+        return false;
+    if (!ensure(size))
+        return false;
+    value = string_view(pos, size);
+    pos += size;
+    return true;
+}
+
+bool BinaryReader::atEnd() const
+{
+    return !failed && pos == end;
+}
+
+bool parseBinaryRequest(string_view frame, BinaryRequest &req)
+{
+    BinaryReader reader(frame);
+    if (!reader.u8(req.opcode) || !reader.u32(req.db_id))
+        return false;
+    req.body = frame.substr(5);
+    return true;
+}
+
+string makeBinaryResponse(BinaryStatus status, uint64_t count, const string &message, const string &docs)
+{
+    string frame;
+    size_t body_size = 1 + 8 + 4 + message.size() + docs.size();
+    frame.reserve(4 + body_size);
+    putU32(frame, static_cast<uint32_t>(body_size));
+    frame.push_back(static_cast<char>(status));
+    putU64(frame, count);
+    putString(frame, message);
+    frame += docs;
+    return frame;
+}
+
+string makeBinaryRequest(BinaryOpcode opcode, uint32_t db_id, const string &body)
+{
+    string frame;
+    frame.reserve(4 + 5 + body.size());
+    putU32(frame, static_cast<uint32_t>(5 + body.size()));
+    frame.push_back(static_cast<char>(opcode));
+    putU32(frame, db_id);
+    frame += body;
+    return frame;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// бинарный протокол для сервисов (JSON-строки остаются для людей).
+// Клиент начинает соединение с BINARY_MAGIC, сервер отвечает тем же - дальше только кадры.
+// Все числа little-endian, строки - длина + байты, без экранирования.
+//
+// запрос:  [u32 длина][u8 opcode][u32 db_id][тело]
+//   BIN_OPEN                     тело: имя базы;             ответ: count = db_id для этого соединения
+//   BIN_INSERT                   тело: u32 n, n документов;  ответ: count = вставлено
+//   BIN_FIND/COUNT/DELETE        тело: str запрос (JSON-условие, как в FIND)
+//   BIN_UPDATE                   тело: str запрос, str модификаторы ($set/$unset/$inc)
+// ответ:   [u32 длина][u8 status][u64 count][str сообщение][для FIND: count документов]
+// документ: [str _id][u16 число полей][str ключ, str значение]...
+// str:      [u32 длина][байты]
+
+static const char BINARY_MAGIC[4] = {'M', 'D', 'B', '\x01'};
+
+enum BinaryOpcode : uint8_t
+{
+    BIN_OPEN = 1,
+    BIN_INSERT = 2,
+    BIN_FIND = 3,
+    BIN_COUNT = 4,
+    BIN_DELETE = 5,
+    BIN_UPDATE = 6
+};
+
+enum BinaryStatus : uint8_t
+{
+    BIN_OK = 0,
+    BIN_ERROR = 1
+};
+
+// разобранный заголовок кадра; body указывает в буфер соединения
+struct BinaryRequest
+{
+    uint8_t opcode = 0;
+    uint32_t db_id = 0;
+    std::string_view body;
+};
+
+// кадр без префикса длины (его снимает LineReader::nextFrame)
+bool parseBinaryRequest(std::string_view frame, BinaryRequest &req);
+
+// запись примитивов в конец буфера
+void putU16(std::string &out, uint16_t value);
+void putU32(std::string &out, uint32_t value);
+void putU64(std::string &out, uint64_t value);
+void putString(std::string &out, std::string_view value);
+
+// последовательное чтение тела; любой выход за границу - false и дальше только false
+class BinaryReader
+{
+private:
+    const char *pos;
+    const char *end;
+    bool failed;
+
+    bool ensure(size_t size); // осталось хотя бы size байт
+
+public:
+    explicit BinaryReader(std::string_view data);
+
+    bool u8(uint8_t &value);
+    bool u16(uint16_t &value);
+    bool u32(uint32_t &value);
+    bool u64(uint64_t &value);
+    bool str(std::string_view &value);
+
+    bool atEnd() const; // всё прочитано и без ошибок
+};
+
+// кадр ответа целиком (с префиксом длины); docs - уже закодированные документы
+std::string makeBinaryResponse(BinaryStatus status, uint64_t count, const std::string &message,
+                               const std::string &docs = std::string());
+// кадр запроса целиком (для клиентов)
+std::string makeBinaryRequest(BinaryOpcode opcode, uint32_t db_id, const std::string &body);
@@ -0,0 +1,188 @@
+#include "capture.h"
+#include "metrics.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace std;
+
+// файл захвата не ротируется (его проигрывают целиком), а очередь больше, чем у
+// журналов: при всплеске лучше занять память, чем потерять запросы
+static const size_t CAPTURE_QUEUE = 1 << 16;
+
+RequestCapture::RequestCapture(const string &path)
+    : log(path, 0, 0, CAPTURE_QUEUE), base_steady_ns(metricsNowNs()),
+      base_wall_us(chrono::duration_cast<chrono::microseconds>(
+                       chrono::system_clock::now().time_since_epoch())
+                       .count()),
+      next_connection(1)
+{
+}
+
+bool RequestCapture::open()
+{
+    return log.open();
+}
+
+uint64_t RequestCapture::newConnection()
+{
+    return next_connection.fetch_add(1);
+}
+
+// обратимое экранирование: replay должен получить исходную строку байт в байт
+static void appendEscaped(string &out, const string &text)
+{
+    for (char c : text)
+    {
+        switch (c)
+        {
+        case '"':
+            out += "\\\"";
+            break;
+        case '\\':
+            out += "\\\\";
+            break;
+        case '\n':
+            out += "\\n";
+            break;
+        case '\r':
+            out += "\\r";
+            break;
+        case '\t':
+            out += "\\t";
+            break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20)
+            {
+                char code[8];
+                snprintf(code, sizeof(code), "\\u%04x", static_cast<unsigned char>(c));
+                out += code;
+            }
+            else
+            {
+                out += c;
+            }
+        }
+    }
+}
+
+void RequestCapture::record(uint64_t connection, long long arrival_ns, const string &operation,
+                            const string &line, const string &status, size_t count,
+                            const string &response)
+{
+    // отпечаток - без '\n': replay сверяет строку ответа, как её отдаёт LineReader
+    string_view body(response);
+    if (!body.empty() && body.back() == '\n')
+        body.remove_suffix(1);
+    char hash[24];
+    snprintf(hash, sizeof(hash), "%016llx",
+             static_cast<unsigned long long>(captureResponseHash(body)));
+
+    string entry;
+    entry.reserve(128 + line.size());
+    entry += "{\"ts_us\":" + to_string(base_wall_us + (arrival_ns - base_steady_ns) / 1000);
+    entry += ",\"conn\":" + to_string(connection);
+    entry += ",\"op\":\"";
+    appendEscaped(entry, operation);
+    entry += "\",\"status\":\"";
+    appendEscaped(entry, status);
+    entry += "\",\"count\":" + to_string(count);
+    entry += ",\"hash\":\"";
+    entry += hash;
+    entry += "\",\"request\":\"";
+    appendEscaped(entry, line);
+    entry += "\"}";
+
+    log.write(std::move(entry));
+}
+
+uint64_t RequestCapture::getDropped() const
+{
+    return log.getDropped();
+}
+
+// значение после "key": - число или строка в кавычках; свой формат, поэтому
+// поля ищутся по порядку, в котором их пишет record
+static bool readNumberField(const string &line, size_t &pos, const char *key, unsigned long long &out)
+{
+    string pattern = string("\"") + key + "\":";
+    size_t at = line.find(pattern, pos);
+    if (at == string::npos)
+        return false;
+    const char *begin = line.c_str() + at + pattern.size();
+    char *end = nullptr;
+    out = strtoull(begin, &end, 10);
+    if (end == begin)
+        return false;
+    pos = static_cast<size_t>(end - line.c_str());
+    return true;
+}
+
+static bool readStringField(const string &line, size_t &pos, const char *key, string &out)
+{
+    string pattern = string("\"") + key + "\":\"";
+    size_t at = line.find(pattern, pos);
+    if (at == string::npos)
+        return false;
+    out.clear();
+    for (size_t i = at + pattern.size(); i < line.size(); i++)
+    {
+        char c = line[i];
+        if (c == '"')
+        {
+            pos = i + 1;
+            return true;
+        }
+        if (c != '\\')
+        {
+            out += c;
+            continue;
+        }
+        if (++i >= line.size())
+            return false;
+        switch (line[i])
+        {
+        case 'n':
+            out += '\n';
+            break;
+        case 'r':
+            out += '\r';
+            break;
+        case 't':
+            out += '\t';
+            break;
+        case 'u':
+            if (i + 4 >= line.size())
+                return false;
+            out += static_cast<char>(strtoul(line.substr(i + 1, 4).c_str(), nullptr, 16));
+            i += 4;
+            break;
+        default:
+            out += line[i];
+        }
+    }
+    return false;
+}
+
+bool parseCaptureLine(const string &line, CapturedRequest &out)
+{
+    size_t pos = 0;
+    unsigned long long ts_us, connection, count;
+    string hash;
+    if (!readNumberField(line, pos, "ts_us", ts_us) ||
+        !readNumberField(line, pos, "conn", connection) ||
+        !readStringField(line, pos, "op", out.operation) ||
+        !readStringField(line, pos, "status", out.status) ||
+        !readNumberField(line, pos, "count", count) ||
+        !readStringField(line, pos, "hash", hash) ||
+        !readStringField(line, pos, "request", out.request))
+    {
+        return false;
+    }
+    out.ts_us = static_cast<long long>(ts_us);
+    out.connection = connection;
+    out.count = static_cast<size_t>(count);
+    out.hash = strtoull(hash.c_str(), nullptr, 16);
+    return true;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "async_log.h"
+
+// запись рабочей нагрузки (db_server --capture): каждая строка JSON-запроса с
+// временем прихода, номером соединения и отпечатком ответа. Пишется через
+// AsyncFileLog - поток запроса только ставит строку в очередь; проигрывает replay.
+// Строка файла:
+// {"ts_us":..,"conn":..,"op":"find","status":"success","count":..,"hash":"..","request":"..."}
+
+// FNV-1a по ответу: replay сверяет ответы, не храня их целиком
+inline uint64_t captureResponseHash(std::string_view response)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (char c : response)
+    {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+class RequestCapture
+{
+private:
+    AsyncFileLog log;
+    long long base_steady_ns; // metricsNowNs() при создании
+    long long base_wall_us;   // системное время в тот же момент
+    std::atomic<uint64_t> next_connection;
+
+public:
+    explicit RequestCapture(const std::string &path);
+
+    bool open();
+
+    // номер для нового соединения в файле захвата
+    uint64_t newConnection();
+    // arrival_ns - metricsNowNs() на приходе запроса
+    void record(uint64_t connection, long long arrival_ns, const std::string &operation,
+                const std::string &line, const std::string &status, size_t count,
+                const std::string &response);
+
+    uint64_t getDropped() const;
+};
+
+// строка захвата после разбора (для replay)
+struct CapturedRequest
+{
+    long long ts_us = 0;
+    uint64_t connection = 0;
+    std::string operation;
+    std::string status;
+    size_t count = 0;
+    uint64_t hash = 0;
+    std::string request; // исходная строка запроса без '\n'
+};
+
+bool parseCaptureLine(const std::string &line, CapturedRequest &out);
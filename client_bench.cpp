@@ -0,0 +1,460 @@
+#include "client_bench.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <thread>
+
+#include "line_reader.h"
+#include "metrics.h"
+
+using namespace std;
+
+BenchConfig::BenchConfig()
+    : host("127.0.0.1"), port(0), database("mydb"),
+      connections(4), duration_s(10.0), warmup_s(0.0), rate(0.0),
+      insert_weight(10), find_weight(80), delete_weight(10),
+      keys(10000), payload_bytes(64),
+      insert_template("{\"bench_key\":\"k{key}\",\"n\":{int},\"payload\":\"{payload}\"}"),
+      find_template("{\"bench_key\":\"k{key}\"}"),
+      delete_template("{\"bench_key\":\"k{key}\"}")
+{
+}
+
+enum BenchOperation
+{
+    BENCH_INSERT,
+    BENCH_FIND,
+    BENCH_DELETE,
+    BENCH_OPERATION_COUNT
+};
+
+static const char *benchOperationName(int operation)
+{
+    static const char *names[BENCH_OPERATION_COUNT] = {"insert", "find", "delete"};
+    return names[operation];
+}
+
+bool parseBenchMix(const string &text, BenchConfig &config)
+{
+    unsigned weights[BENCH_OPERATION_COUNT];
+    size_t pos = 0;
+    for (int i = 0; i < BENCH_OPERATION_COUNT; i++)
+    {
+        size_t colon = text.find(':', pos);
+        if ((colon == string::npos) != (i == BENCH_OPERATION_COUNT - 1))
+            return false;
+        string part = text.substr(pos, colon == string::npos ? string::npos : colon - pos);
+        if (part.empty() || part.find_first_not_of("0123456789") != string::npos)
+            return false;
+        weights[i] = static_cast<unsigned>(strtoul(part.c_str(), nullptr, 10));
+        pos = colon + 1;
+    }
+    if (weights[BENCH_INSERT] + weights[BENCH_FIND] + weights[BENCH_DELETE] == 0)
+        return false;
+
+    config.insert_weight = weights[BENCH_INSERT];
+    config.find_weight = weights[BENCH_FIND];
+    config.delete_weight = weights[BENCH_DELETE];
+    return true;
+}
+
+static long long nowNs()
+{
+    return chrono::duration_cast<chrono::nanoseconds>(
+               chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// ожидание до момента по расписанию: sleep будит с опозданием на десятки мкс,
+// а опоздание клиента попало бы в задержку, поэтому последние 200 мкс - yield
+static void waitUntil(long long target_ns)
+{
+    const long long spin_ns = 200000;
+    long long now = nowNs();
+    if (target_ns - now > spin_ns)
+    {
+        this_thread::sleep_for(chrono::nanoseconds(target_ns - now - spin_ns));
+    }
+    while (nowNs() < target_ns)
+    {
+        this_thread::yield();
+    }
+}
+
+static int connectToServer(const string &host, int port)
+{
+    string address = host == "localhost" ? string("127.0.0.1") : host;
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    if (inet_pton(AF_INET, address.c_str(), &addr.sin_addr) <= 0)
+    {
+        cerr << "Invalid host/IP address: " << host << "\n";
+        return -1;
+    }
+
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0)
+    {
+        perror("socket");
+        return -1;
+    }
+    if (connect(sock, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0)
+    {
+        perror("connect");
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+// MSG_NOSIGNAL: упавший сервер - это отключение соединения, а не SIGPIPE всему клиенту
+static bool sendAll(int sock, const string &data)
+{
+    size_t sent = 0;
+    while (sent < data.size())
+    {
+        ssize_t n = ::send(sock, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+static bool receiveLine(int sock, LineReader &reader, string_view &line)
+{
+    while (!reader.nextLine(line))
+    {
+        ssize_t n = reader.fill(sock);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+    }
+    return true;
+}
+
+// состояние одного соединения; гистограммы пишет только его поток, сводит main после join
+struct BenchWorker
+{
+    const BenchConfig *config;
+    int sock;
+    unsigned index;
+    long long start_ns;   // общий старт
+    long long measure_ns; // после разогрева
+    long long end_ns;
+    long long interval_ns; // шаг расписания этого соединения; 0 - замкнутый цикл
+
+    LatencyHistogram corrected;                      // от запланированной отправки
+    LatencyHistogram raw;                            // от фактической отправки
+    LatencyHistogram by_operation[BENCH_OPERATION_COUNT]; // по расписанию; в замкнутом цикле - от отправки
+    uint64_t completed[BENCH_OPERATION_COUNT];
+    uint64_t errors;
+    long long max_lag_ns; // наибольшее отставание отправки от расписания
+    uint64_t unsent;      // запланировано, но не отправлено до конца замера
+    bool disconnected;
+
+    BenchWorker()
+        : config(nullptr), sock(-1), index(0), start_ns(0), measure_ns(0), end_ns(0), interval_ns(0),
+          errors(0), max_lag_ns(0), unsent(0), disconnected(false)
+    {
+        for (int i = 0; i < BENCH_OPERATION_COUNT; i++)
+            completed[i] = 0;
+    }
+};
+
+// подстановка {key}/{int}/{payload}; прочие фигурные скобки - обычный JSON
+static void expandTemplate(const string &pattern, const string &payload, size_t keys,
+                           mt19937_64 &random, string &out)
+{
+    size_t pos = 0;
+    while (pos < pattern.size())
+    {
+        size_t open = pattern.find('{', pos);
+        if (open == string::npos)
+        {
+            out.append(pattern, pos, string::npos);
+            return;
+        }
+        out.append(pattern, pos, open - pos);
+
+        if (pattern.compare(open, 5, "{key}") == 0)
+        {
+            out += to_string(keys ? random() % keys : 0);
+            pos = open + 5;
+        }
+        else if (pattern.compare(open, 5, "{int}") == 0)
+        {
+            out += to_string(random() % 1000);
+            pos = open + 5;
+        }
+        else if (pattern.compare(open, 9, "{payload}") == 0)
+        {
+            out += payload;
+            pos = open + 9;
+        }
+        else
+        {
+            out += '{';
+            pos = open + 1;
+        }
+    }
+}
+
+static void buildBenchRequest(const BenchConfig &config, int operation, const string &payload,
+                              mt19937_64 &random, string &out)
+{
+    out.clear();
+    out += "{\"database\":\"";
+    out += config.database;
+    out += "\",\"operation\":\"";
+    out += benchOperationName(operation);
+    out += "\",\"data\":";
+    if (operation == BENCH_INSERT)
+    {
+        out += '[';
+        expandTemplate(config.insert_template, payload, config.keys, random, out);
+        out += "],\"query\":{}";
+    }
+    else
+    {
+        out += "[],\"query\":";
+        expandTemplate(operation == BENCH_FIND ? config.find_template : config.delete_template,
+                       payload, config.keys, random, out);
+    }
+    out += "}\n";
+}
+
+// замкнутый цикл не знает, когда запрос "должен был" уйти: как recordValueWithExpectedInterval
+// в HdrHistogram, задержку больше ожидаемого интервала (средней задержки соединения)
+// дополняем записями, которые набрали бы запросы, задержанные этим
+static void recordClosedLoop(LatencyHistogram &histogram, uint64_t latency, uint64_t expected)
+{
+    histogram.record(latency);
+    if (expected == 0)
+        return;
+    for (uint64_t missed = latency > expected ? latency - expected : 0; missed >= expected; missed -= expected)
+    {
+        histogram.record(missed);
+    }
+}
+
+static void runBenchWorker(BenchWorker &worker)
+{
+    const BenchConfig &config = *worker.config;
+    mt19937_64 random(random_device{}() ^ (static_cast<uint64_t>(worker.index) << 32));
+    unsigned total_weight = config.insert_weight + config.find_weight + config.delete_weight;
+    string payload(config.payload_bytes, 'x');
+    string request;
+    LineReader reader;
+
+    uint64_t raw_sum = 0;
+    uint64_t raw_count = 0;
+    // соединения сдвинуты внутри шага, чтобы не отправлять пачкой
+    long long next_ns = worker.start_ns + (worker.interval_ns * worker.index) / config.connections;
+
+    while (true)
+    {
+        long long intended_ns;
+        if (worker.interval_ns > 0)
+        {
+            if (next_ns >= worker.end_ns)
+                break;
+            if (nowNs() >= worker.end_ns)
+            {
+                // сервер не успевал: хвост расписания так и не отправлен
+                worker.unsent = static_cast<uint64_t>((worker.end_ns - next_ns + worker.interval_ns - 1) / worker.interval_ns);
+                break;
+            }
+            waitUntil(next_ns);
+            intended_ns = next_ns;
+            next_ns += worker.interval_ns;
+        }
+        else
+        {
+            intended_ns = nowNs();
+            if (intended_ns >= worker.end_ns)
+                break;
+        }
+
+        unsigned pick = static_cast<unsigned>(random() % total_weight);
+        int operation = pick < config.insert_weight                        ? BENCH_INSERT
+                        : pick < config.insert_weight + config.find_weight ? BENCH_FIND
+                                                                           : BENCH_DELETE;
+        buildBenchRequest(config, operation, payload, random, request);
+
+        long long send_ns = nowNs();
+        string_view response;
+        if (!sendAll(worker.sock, request) || !receiveLine(worker.sock, reader, response))
+        {
+            worker.disconnected = true;
+            break;
+        }
+        long long done_ns = nowNs();
+
+        uint64_t raw = static_cast<uint64_t>(done_ns - send_ns);
+        raw_sum += raw;
+        raw_count++;
+        if (intended_ns < worker.measure_ns)
+            continue; // разогрев
+
+        if (send_ns - intended_ns > worker.max_lag_ns)
+            worker.max_lag_ns = send_ns - intended_ns;
+        worker.raw.record(raw);
+        if (worker.interval_ns > 0)
+        {
+            uint64_t latency = static_cast<uint64_t>(done_ns - intended_ns);
+            worker.corrected.record(latency);
+            worker.by_operation[operation].record(latency);
+        }
+        else
+        {
+            recordClosedLoop(worker.corrected, raw, raw_sum / raw_count);
+            worker.by_operation[operation].record(raw);
+        }
+        worker.completed[operation]++;
+        if (response.compare(0, 17, "{\"status\":\"error\"") == 0)
+            worker.errors++;
+    }
+}
+
+static void printLatencyLine(const char *label, const LatencyHistogram &histogram)
+{
+    char line[256];
+    snprintf(line, sizeof(line),
+             "%-22s p50 %9.1f  p90 %9.1f  p99 %9.1f  p99.9 %9.1f  max %9.1f  (us)\n", label,
+             histogram.percentile(0.50) / 1000.0, histogram.percentile(0.90) / 1000.0,
+             histogram.percentile(0.99) / 1000.0, histogram.percentile(0.999) / 1000.0,
+             histogram.getMax() / 1000.0);
+    cout << line;
+}
+
+int runBench(const BenchConfig &config)
+{
+    size_t count = config.connections;
+    BenchWorker *workers = new BenchWorker[count];
+    size_t connected = 0;
+    for (; connected < count; connected++)
+    {
+        workers[connected].sock = connectToServer(config.host, config.port);
+        if (workers[connected].sock < 0)
+            break;
+    }
+    if (connected < count)
+    {
+        cerr << "[Bench] connected " << connected << " of " << count << " connections\n";
+        for (size_t i = 0; i < connected; i++)
+            close(workers[i].sock);
+        delete[] workers;
+        return 1;
+    }
+
+    // все потоки стартуют по одним часам, когда соединения уже открыты
+    long long start_ns = nowNs() + 10000000;
+    long long measure_ns = start_ns + static_cast<long long>(config.warmup_s * 1e9);
+    long long end_ns = measure_ns + static_cast<long long>(config.duration_s * 1e9);
+    long long interval_ns = config.rate > 0 ? static_cast<long long>(count * 1e9 / config.rate) : 0;
+
+    cout << "[Bench] " << count << " connections to " << config.host << ":" << config.port
+         << ", " << config.duration_s << " s";
+    if (config.warmup_s > 0)
+        cout << " after " << config.warmup_s << " s warmup";
+    if (interval_ns > 0)
+        cout << ", open loop at " << config.rate << " req/s";
+    else
+        cout << ", closed loop";
+    cout << ", mix insert:find:delete " << config.insert_weight << ":" << config.find_weight << ":"
+         << config.delete_weight << "\n";
+
+    thread *threads = new thread[count];
+    for (size_t i = 0; i < count; i++)
+    {
+        BenchWorker &worker = workers[i];
+        worker.config = &config;
+        worker.index = static_cast<unsigned>(i);
+        worker.start_ns = start_ns;
+        worker.measure_ns = measure_ns;
+        worker.end_ns = end_ns;
+        worker.interval_ns = interval_ns;
+        threads[i] = thread(runBenchWorker, ref(worker));
+    }
+
+    LatencyHistogram *corrected = new LatencyHistogram;
+    LatencyHistogram *raw = new LatencyHistogram;
+    LatencyHistogram *by_operation = new LatencyHistogram[BENCH_OPERATION_COUNT];
+    uint64_t completed[BENCH_OPERATION_COUNT] = {0, 0, 0};
+    uint64_t errors = 0;
+    size_t disconnected = 0;
+    long long max_lag_ns = 0;
+    uint64_t unsent = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        threads[i].join();
+        BenchWorker &worker = workers[i];
+        close(worker.sock);
+        corrected->merge(worker.corrected);
+        raw->merge(worker.raw);
+        for (int op = 0; op < BENCH_OPERATION_COUNT; op++)
+        {
+            by_operation[op].merge(worker.by_operation[op]);
+            completed[op] += worker.completed[op];
+        }
+        errors += worker.errors;
+        if (worker.disconnected)
+            disconnected++;
+        unsent += worker.unsent;
+        if (worker.max_lag_ns > max_lag_ns)
+            max_lag_ns = worker.max_lag_ns;
+    }
+    // отключившееся соединение обрывает замер раньше срока - время берём фактическое
+    long long finished_ns = nowNs();
+    double seconds = (min(finished_ns, end_ns) - measure_ns) / 1e9;
+
+    uint64_t total = completed[BENCH_INSERT] + completed[BENCH_FIND] + completed[BENCH_DELETE];
+    cout << "[Bench] " << total << " requests (insert " << completed[BENCH_INSERT] << ", find "
+         << completed[BENCH_FIND] << ", delete " << completed[BENCH_DELETE] << "), errors " << errors;
+    if (disconnected > 0)
+        cout << ", disconnected " << disconnected;
+    cout << "\n";
+    cout << "[Bench] throughput " << (seconds > 0 ? static_cast<long long>(total / seconds) : 0)
+         << " req/s\n";
+    if (interval_ns > 0 && seconds > 0 && total / seconds < config.rate * 0.95)
+    {
+        cout << "[Bench] target rate not reached, sends lagged the schedule by up to "
+             << max_lag_ns / 1000000.0 << " ms, " << unsent << " scheduled requests never sent\n";
+    }
+
+    if (total > 0)
+    {
+        printLatencyLine(interval_ns > 0 ? "latency (scheduled)" : "latency (corrected)", *corrected);
+        printLatencyLine("latency (send-reply)", *raw);
+        for (int op = 0; op < BENCH_OPERATION_COUNT; op++)
+        {
+            if (completed[op] == 0)
+                continue;
+            string label = string("  ") + benchOperationName(op);
+            printLatencyLine(label.c_str(), by_operation[op]);
+        }
+    }
+
+    delete[] by_operation;
+    delete raw;
+    delete corrected;
+    delete[] threads;
+    delete[] workers;
+    return total > 0 ? 0 : 1;
+}
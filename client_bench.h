@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// нагрузочный режим клиента (db_client --bench): N соединений, по потоку на каждое,
+// гоняют смесь INSERT/FIND/DELETE на сгенерированных документах.
+// С --rate запросы идут по расписанию (открытый цикл) и задержка считается от
+// запланированного момента отправки - отставание клиента из-за медленного сервера
+// не прячет хвост (coordinated omission). Без --rate - замкнутый цикл
+struct BenchConfig
+{
+    std::string host;
+    int port;
+    std::string database;
+
+    std::size_t connections;
+    double duration_s;
+    double warmup_s; // первые секунды не попадают в статистику
+    double rate;     // запросов в секунду на все соединения; 0 - замкнутый цикл
+
+    // веса операций в смеси
+    unsigned insert_weight;
+    unsigned find_weight;
+    unsigned delete_weight;
+
+    // шаблоны: {key} - случайный ключ из [0, keys), {int} - число из [0, 1000),
+    // {payload} - строка из payload_bytes символов
+    std::size_t keys;
+    std::size_t payload_bytes;
+    std::string insert_template; // документ
+    std::string find_template;   // условие
+    std::string delete_template; // условие
+
+    BenchConfig();
+};
+
+// смесь в виде "insert:find:delete", например "10:80:10"
+bool parseBenchMix(const std::string &text, BenchConfig &config);
+
+// отчёт - в stdout; код возврата 0, если хотя бы один запрос выполнен
+int runBench(const BenchConfig &config);
@@ -9,159 +9,239 @@ ListNode::ListNode(const string &k, Document *v)
 CustomList::CustomList() : head(nullptr) {}
 CustomList::~CustomList()
 {
-    ListNode *current = head;
+    ListNode *current = head.load();
     while (current)
     {
-        ListNode *next = current->next;
+        ListNode *next = current->next.load();
         delete current;
         current = next;
     }
 }
 ListNode *CustomList::find(const ::string &key) const
 {
-    ListNode *current = head;
+    ListNode *current = head.load();
     while (current)
     {
         if (current->key == key)
         {
             return current;
         }
-        current = current->next;
+        current = current->next.load();
     }
     return nullptr;
 }
-Document *CustomList::remove(const ::string &key)
-{
-    ListNode *current = head;
-    ListNode *prev = nullptr;
 
-    while (current)
-    {
-        if (current->key == key)
-        {
-            if (prev)
-            {
-                prev->next = current->next;
-            }
-            else
-            {
-                head = current->next;
-            }
-
-            Document *removed_value = current->value;
-            current->value = nullptr;
-            delete current;
-            return removed_value;
-        }
-        prev = current;
-        current = current->next;
-    }
-    return nullptr;
+BucketTable::BucketTable(size_t capacity) : buckets(new CustomList[capacity]), capacity(capacity) {}
+BucketTable::~BucketTable()
+{
+    delete[] buckets;
 }
 
 CustomHashMap::CustomHashMap(size_t initial_capacity)
+    : table(nullptr), size(0), live(0), changed_version(0), memory_bytes(0), retired_head(nullptr), retired_tail(nullptr),
+      superseded_head(nullptr), superseded_tail(nullptr), garbage_since_collect(0)
 {
     if (initial_capacity == 0)
     {
         initial_capacity = DEFAULT_CAPACITY;
     }
-    capacity = initial_capacity;
-    size = 0;
-    buckets = new CustomList[capacity];
+    initial_capacity = (initial_capacity + STRIPES - 1) / STRIPES * STRIPES;
+    table.store(new BucketTable(initial_capacity));
+    memory_bytes += table_bytes(table.load());
 }
 
 CustomHashMap::~CustomHashMap()
 {
-    for (size_t i = 0; i < capacity; i++)
+    BucketTable *current_table = table.load();
+    for (size_t i = 0; i < current_table->capacity; i++)
     {
-        ListNode *current = buckets[i].head;
-
+        ListNode *current = current_table->buckets[i].head.load();
         while (current)
         {
-            delete current->value;
-            current = current->next;
+            delete_versions(current->value.load());
+            current = current->next.load();
         }
     }
-    delete[] buckets;
+    delete current_table;
+
+    // читателей уже нет - освобождаем всё отложенное
+    reclaim(NO_VERSION);
+    while (superseded_head)
+    {
+        Superseded *next = superseded_head->next;
+        delete superseded_head;
+        superseded_head = next;
+    }
 }
 
-size_t CustomHashMap::_hash(const ::string &key) const
-{ // вычисление индекса
+size_t CustomHashMap::_hash_raw(const ::string &key)
+{
     size_t hash_value = 0;
     unsigned int prime = 31;
     for (unsigned char c : key)
     {
         hash_value = hash_value * prime + c;
     }
-    return hash_value % capacity;
+    return hash_value;
 }
 
-void CustomHashMap::resize_rehash()
+size_t CustomHashMap::_hash(const ::string &key, size_t capacity)
+{ // вычисление индекса
+    return _hash_raw(key) % capacity;
+}
+
+mutex &CustomHashMap::stripeOf(const ::string &key)
 {
-    // сохраняем старые значения
-    size_t old_capacity = capacity;
-    CustomList *old_buckets = buckets;
+    return stripes[_hash_raw(trim(key)) % STRIPES];
+}
 
-    capacity *= 2;
-    size = 0;
-    buckets = new CustomList[capacity];
+void CustomHashMap::delete_versions(Document *doc)
+{
+    while (doc)
+    {
+        Document *older = doc->older.load();
+        memory_bytes -= doc->memoryUsage();
+        delete doc;
+        doc = older;
+    }
+}
 
-    for (size_t i = 0; i < old_capacity; ++i)
+size_t CustomHashMap::node_bytes(const ListNode *node)
+{
+    return sizeof(ListNode) + stringHeapBytes(node->key);
+}
+
+size_t CustomHashMap::table_bytes(const BucketTable *bucket_table)
+{
+    size_t bytes = sizeof(BucketTable) + bucket_table->capacity * sizeof(CustomList);
+    for (size_t i = 0; i < bucket_table->capacity; ++i)
     {
-        ListNode *current = old_buckets[i].head;
-        while (current)
+        for (ListNode *node = bucket_table->buckets[i].head.load(); node; node = node->next.load())
         {
-            string key = current->key;
-            Document *value = current->value;
+            bytes += node_bytes(node);
+        }
+    }
+    return bytes;
+}
 
-            current->value = nullptr;
+Document *CustomHashMap::visible(const ListNode *node, unsigned long long snapshot)
+{
+    // от новой версии к старой: первая, появившаяся не позже снимка, и есть нужная
+    for (Document *doc = node->value.load(); doc; doc = doc->older.load())
+    {
+        if (doc->begin_version <= snapshot)
+        {
+            return snapshot < doc->end_version.load() ? doc : nullptr;
+        }
+    }
+    return nullptr;
+}
 
-            // кладём в новую таблицу
-            put(key, value, false);
+bool CustomHashMap::needsGrow() const
+{
+    return (float)size.load() / table.load()->capacity >= LOAD_FACTOR;
+}
 
-            current = current->next;
-        }
+void CustomHashMap::grow(unsigned long long version)
+{
+    rebuild(table.load()->capacity * 2, version);
+}
+
+bool CustomHashMap::reserve(size_t extra_keys, unsigned long long version)
+{
+    size_t capacity = table.load()->capacity;
+    size_t needed = capacity;
+    while ((float)(size.load() + extra_keys) / needed >= LOAD_FACTOR)
+    {
+        needed *= 2; // удвоения оставляют ёмкость кратной STRIPES
+    }
+    if (needed == capacity)
+    {
+        return false;
     }
-    delete[] old_buckets; // удаление старыъ
+    rebuild(needed, version);
+    return true;
 }
 
-void CustomHashMap::put(const ::string &key, Document *value, bool delete_on_update)
+void CustomHashMap::rebuild(size_t new_capacity, unsigned long long version)
 {
-    string cleaned_key = trim(key);
-    if ((float)size / capacity >= LOAD_FACTOR)
+    // новая таблица собирается из копий узлов и публикуется целиком;
+    // читатели старой дочитывают её, пока она в списке на освобождение
+    BucketTable *old_table = table.load();
+    BucketTable *new_table = new BucketTable(new_capacity);
+
+    for (size_t i = 0; i < old_table->capacity; ++i)
     {
-        resize_rehash();
+        ListNode *current = old_table->buckets[i].head.load();
+        while (current)
+        {
+            ListNode *copy = new ListNode(current->key, current->value.load());
+            CustomList &list = new_table->buckets[_hash(copy->key, new_table->capacity)];
+            copy->next.store(list.head.load());
+            list.head.store(copy);
+
+            current = current->next.load();
+        }
     }
 
-    size_t index = _hash(cleaned_key);
-    ListNode *node = buckets[index].find(cleaned_key); // поиск узла в бакете
+    memory_bytes += table_bytes(new_table);
+    table.store(new_table);
+    retire(nullptr, nullptr, old_table, version);
+}
+
+void CustomHashMap::put(const ::string &key, Document *value, unsigned long long version)
+{
+    string cleaned_key = trim(key);
+    note_change(version);
+    value->begin_version = version;
+    value->end_version.store(NO_VERSION);
+    memory_bytes += value->memoryUsage();
+
+    BucketTable *current_table = table.load();
+    ListNode *node = current_table->buckets[_hash(cleaned_key, current_table->capacity)].find(cleaned_key); // поиск узла в бакете
 
     if (node)
     {
-        if (delete_on_update)
+        // новая версия поверх старой, старая доживает для снимков до version
+        Document *old_value = node->value.load();
+        value->older.store(old_value);
+        if (old_value)
+        {
+            if (old_value->end_version.load() == NO_VERSION)
+            {
+                old_value->end_version.store(version);
+            }
+            else
+            {
+                live++; // ключ был удалён - документ снова живой
+            }
+            note_superseded(cleaned_key, version);
+        }
+        else
         {
-            delete node->value;
+            live++;
         }
-        node->value = value;
+        node->value.store(value);
         return;
     }
-    else
-    {
-        ListNode *new_node = new ListNode(cleaned_key, value);
-        new_node->next = buckets[index].head;
-        buckets[index].head = new_node;
-        size++;
-    }
+
+    ListNode *new_node = new ListNode(cleaned_key, value);
+    CustomList &list = current_table->buckets[_hash(cleaned_key, current_table->capacity)];
+    new_node->next.store(list.head.load());
+    list.head.store(new_node); // узел полностью готов до публикации
+    size++;
+    live++;
+    memory_bytes += node_bytes(new_node);
 }
 
-Document *CustomHashMap::get(const ::string &key) const
+Document *CustomHashMap::get(const ::string &key, unsigned long long snapshot) const
 {
     string cleaned_key = trim(key);
-    size_t index = _hash(cleaned_key);
-    ListNode *node = buckets[index].find(cleaned_key);
+    const BucketTable *current_table = table.load();
+    ListNode *node = current_table->buckets[_hash(cleaned_key, current_table->capacity)].find(cleaned_key);
     if (node)
     {
-        return node->value;
+        return visible(node, snapshot);
     }
     else
     {
@@ -169,31 +249,195 @@ Document *CustomHashMap::get(const ::string &key) const
     }
 }
 
-Document *CustomHashMap::remove(const ::string &key)
+bool CustomHashMap::remove(const ::string &key, unsigned long long version)
 {
     string cleaned_key = trim(key);
-    size_t index = _hash(cleaned_key);
-    Document *removed = buckets[index].remove(cleaned_key);
-    if (removed != nullptr)
-        size--;
-    return removed;
+    BucketTable *current_table = table.load();
+    ListNode *node = current_table->buckets[_hash(cleaned_key, current_table->capacity)].find(cleaned_key);
+    if (!node)
+    {
+        return false;
+    }
+
+    // узел остаётся как "надгробие", пока удалённую версию могут видеть снимки
+    Document *current = node->value.load();
+    if (!current || current->end_version.load() != NO_VERSION)
+    {
+        return false;
+    }
+    current->end_version.store(version);
+    note_change(version);
+    live--; // узел-надгробие остаётся в size до сборки
+    note_superseded(cleaned_key, version);
+    return true;
 }
 
-size_t CustomHashMap::getSize() const
+// писатели разных полос идут параллельно и не по порядку версий - берём максимум
+void CustomHashMap::note_change(unsigned long long version)
 {
-    return size;
+    unsigned long long seen = changed_version.load();
+    while (seen < version && !changed_version.compare_exchange_weak(seen, version))
+    {
+    }
 }
 
-size_t CustomHashMap::getCapacity() const
+void CustomHashMap::note_superseded(const string &key, unsigned long long version)
 {
-    return capacity;
+    Superseded *entry = new Superseded{key, version, nullptr};
+    garbage_since_collect++;
+    lock_guard<mutex> lock(queue_mtx);
+    if (superseded_tail)
+        superseded_tail->next = entry;
+    else
+        superseded_head = entry;
+    superseded_tail = entry;
 }
 
-ListNode *CustomHashMap::getBucketHead(size_t index) const
+void CustomHashMap::retire(ListNode *node, Document *versions, BucketTable *old_table, unsigned long long tag)
 {
-    if (index < capacity)
+    Retired *entry = new Retired{node, versions, old_table, tag, nullptr};
+    garbage_since_collect++;
+    lock_guard<mutex> lock(queue_mtx);
+    if (retired_tail)
+        retired_tail->next = entry;
+    else
+        retired_head = entry;
+    retired_tail = entry;
+}
+
+void CustomHashMap::trim_key(const string &key, unsigned long long min_active, const SnapshotRegistry &snapshots)
+{
+    BucketTable *current_table = table.load();
+    CustomList &list = current_table->buckets[_hash(key, current_table->capacity)];
+
+    ListNode *prev = nullptr;
+    ListNode *node = list.head.load();
+    while (node && node->key != key)
     {
-        return buckets[index].head;
+        prev = node;
+        node = node->next.load();
     }
-    return nullptr;
+    if (!node)
+    {
+        return;
+    }
+
+    Document *newest = node->value.load();
+    if (newest && newest->end_version.load() <= min_active)
+    {
+        // ключ удалён, и ни один снимок его уже не видит - вырезаем узел целиком;
+        // читатель, стоящий на узле, всё ещё может перейти по его next
+        ListNode *after = node->next.load();
+        if (prev)
+            prev->next.store(after);
+        else
+            list.head.store(after);
+        size--; // live уменьшил ещё remove
+        // другие писатели публикуют версии параллельно со сборкой, поэтому метку
+        // берём после вырезания: все, кто мог дойти до узла, читают не новее неё
+        retire(node, newest, nullptr, snapshots.getCommitted() + 1);
+        return;
+    }
+
+    // версия, которую видит самый старый снимок, - последняя нужная; дальше читатели не ходят
+    for (Document *doc = newest; doc; doc = doc->older.load())
+    {
+        if (doc->begin_version <= min_active)
+        {
+            Document *tail = doc->older.load();
+            if (tail)
+            {
+                doc->older.store(nullptr);
+                retire(nullptr, tail, nullptr, snapshots.getCommitted() + 1);
+            }
+            return;
+        }
+    }
+}
+
+bool CustomHashMap::hasGarbage() const
+{
+    return garbage_since_collect.load() >= GC_BATCH;
+}
+
+void CustomHashMap::collect(const SnapshotRegistry &snapshots)
+{
+    unique_lock<mutex> collector(gc_mtx, try_to_lock);
+    if (!collector.owns_lock())
+    {
+        return; // уже собирает другой поток
+    }
+    garbage_since_collect.store(0);
+
+    unsigned long long min_active = snapshots.minActive();
+    while (true)
+    {
+        Superseded *entry = nullptr;
+        {
+            lock_guard<mutex> lock(queue_mtx);
+            if (!superseded_head || superseded_head->version > min_active)
+                break;
+            entry = superseded_head;
+            superseded_head = entry->next;
+            if (!superseded_head)
+                superseded_tail = nullptr;
+        }
+        {
+            lock_guard<mutex> stripe(stripeOf(entry->key));
+            trim_key(entry->key, min_active, snapshots);
+        }
+        delete entry;
+    }
+
+    reclaim(snapshots.minActive());
+}
+
+void CustomHashMap::reclaim(unsigned long long min_active)
+{
+    while (true)
+    {
+        Retired *entry = nullptr;
+        {
+            lock_guard<mutex> lock(queue_mtx);
+            if (!retired_head || retired_head->tag > min_active)
+                break;
+            entry = retired_head;
+            retired_head = entry->next;
+            if (!retired_head)
+                retired_tail = nullptr;
+        }
+        if (entry->node)
+            memory_bytes -= node_bytes(entry->node);
+        delete entry->node; // документы узла лежат в versions
+        delete_versions(entry->versions);
+        if (entry->table)
+            memory_bytes -= table_bytes(entry->table);
+        delete entry->table; // вместе с копиями узлов, сами документы живут в новой таблице
+        delete entry;
+    }
+}
+
+size_t CustomHashMap::getSize() const
+{
+    return size;
+}
+
+size_t CustomHashMap::getLiveCount() const
+{
+    return live;
+}
+
+unsigned long long CustomHashMap::getChangedVersion() const
+{
+    return changed_version;
+}
+
+size_t CustomHashMap::getMemoryUsage() const
+{
+    return memory_bytes;
+}
+
+double CustomHashMap::getLoadFactor() const
+{
+    return (double)size.load() / table.load()->capacity;
 }
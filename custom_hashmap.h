@@ -1,49 +1,157 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
 #include <string>
 #include "document.h"
+#include "snapshot.h"
 
 struct ListNode
 {
     std::string key;
-    Document *value;
-    ListNode *next;
+    std::atomic<Document *> value; // самая новая версия документа (цепочка по older)
+    std::atomic<ListNode *> next;
 
     ListNode(const std::string &k, Document *v);
 };
 class CustomList
 {
 public:
-    ListNode *head;
+    std::atomic<ListNode *> head;
 
     CustomList();
-    ~CustomList();
+    ~CustomList(); // удаляет узлы, документы не трогает
 
     ListNode *find(const std::string &key) const;
-    Document *remove(const std::string &key);
 };
 
+// массив бакетов; при росте создаётся новый, старый живёт, пока его могут читать
+struct BucketTable
+{
+    CustomList *buckets;
+    size_t capacity;
+
+    explicit BucketTable(size_t capacity);
+    ~BucketTable();
+};
+
+// хэш-таблица с версиями документов (MVCC): читатели со снимком идут без блокировок
+// и видят только свои версии; писатели разных ключей работают параллельно,
+// каждый под мьютексом своей полосы (stripe) бакетов
 class CustomHashMap
 {
 private:
-    CustomList *buckets; // цепочки
-    size_t capacity;
-    size_t size;
+    // то, что новые читатели уже не увидят, но старые снимки ещё могут читать;
+    // освобождается, когда самый старый активный снимок >= tag
+    struct Retired
+    {
+        ListNode *node;
+        Document *versions; // цепочка по older
+        BucketTable *table;
+        unsigned long long tag;
+        Retired *next;
+    };
+    // ключ, у которого в версии version старая версия вытеснена или удалена
+    struct Superseded
+    {
+        std::string key;
+        unsigned long long version;
+        Superseded *next;
+    };
+
+    std::atomic<BucketTable *> table;
+    std::atomic<size_t> size;
+    std::atomic<size_t> live; // ключи, у которых новейшая версия не удалена
+    // самая новая версия, в которой put/remove действительно меняли данные
+    std::atomic<unsigned long long> changed_version;
+    void note_change(unsigned long long version);
+    // байт под все версии документов, узлы и таблицы, включая ещё не освобождённый мусор
+    std::atomic<size_t> memory_bytes;
+
+    // бакет i принадлежит полосе i % STRIPES; ёмкость всегда кратна STRIPES,
+    // поэтому полоса ключа не меняется при росте таблицы
+    static const size_t STRIPES = 16;
+    std::mutex stripes[STRIPES];
+
+    std::mutex queue_mtx; // очереди ниже (примерно по возрастанию версии)
+    Retired *retired_head;
+    Retired *retired_tail;
+    Superseded *superseded_head;
+    Superseded *superseded_tail;
+    std::mutex gc_mtx; // сборку ведёт один поток за раз
+    // сколько мусора добавилось с прошлой сборки: собираем пачками, а не после
+    // каждой записи - проход по слотам снимков дороже самой точечной записи
+    std::atomic<size_t> garbage_since_collect;
+    static const size_t GC_BATCH = 64;
 
     static const size_t DEFAULT_CAPACITY = 16;
     static constexpr float LOAD_FACTOR = 0.75f;
 
-    size_t _hash(const std::string &key) const;
-    void resize_rehash();
+    static size_t _hash(const std::string &key, size_t capacity);
+    static size_t _hash_raw(const std::string &key);
+    void retire(ListNode *node, Document *versions, BucketTable *old_table, unsigned long long tag);
+    void note_superseded(const std::string &key, unsigned long long version);
+    void reclaim(unsigned long long min_active);
+    void trim_key(const std::string &key, unsigned long long min_active, const SnapshotRegistry &snapshots);
+    void delete_versions(Document *doc);
+    static size_t node_bytes(const ListNode *node);
+    static size_t table_bytes(const BucketTable *bucket_table); // вместе с узлами
+    void rebuild(size_t new_capacity, unsigned long long version);
 
 public:
     CustomHashMap(size_t initial_capacity = DEFAULT_CAPACITY);
     ~CustomHashMap();
+    CustomHashMap(const CustomHashMap &) = delete;
+    CustomHashMap &operator=(const CustomHashMap &) = delete;
+
+    // версия документа узла, видимая снимку (nullptr - не существует в снимке)
+    static Document *visible(const ListNode *node, unsigned long long snapshot);
+
+    // чтение: из любого потока, снимок должен быть закреплён в SnapshotRegistry
+    Document *get(const std::string &key, unsigned long long snapshot) const;
+
+    template <typename Visitor>
+    void for_each_visible(unsigned long long snapshot, Visitor visit) const
+    {
+        const BucketTable *current_table = table.load();
+        for (size_t i = 0; i < current_table->capacity; ++i)
+        {
+            for (ListNode *node = current_table->buckets[i].head.load(); node; node = node->next.load())
+            {
+                Document *doc = visible(node, snapshot);
+                if (doc)
+                {
+                    visit(doc);
+                }
+            }
+        }
+    }
+
+    // запись: вызывающий держит stripeOf(key) либо исключил всех остальных писателей;
+    // version - ещё не опубликованная версия записи
+    std::mutex &stripeOf(const std::string &key);
+    void put(const std::string &key, Document *value, unsigned long long version);
+    bool remove(const std::string &key, unsigned long long version);
 
-    void put(const std::string &key, Document *value, bool delete_on_update = true);
-    Document *get(const std::string &key) const;
-    Document *remove(const std::string &key);
+    // рост таблицы: put сам не растит, потому что трогает все полосы сразу -
+    // вызывающий должен исключить всех остальных писателей
+    bool needsGrow() const;
+    void grow(unsigned long long version);
+    // сразу ёмкость под ещё extra_keys ключей (пачка вставок): одна перестройка
+    // вместо удвоений по ходу; false - места и так хватает
+    bool reserve(size_t extra_keys, unsigned long long version);
 
-    size_t getSize() const;
-    size_t getCapacity() const;
+    // сборка мусора после публикации: обрезает версии, которые не видит ни один снимок,
+    // выкидывает удалённые ключи и освобождает память, которую уже никто не читает.
+    // Вызывающий исключает только grow (полосы ключей сборщик берёт сам)
+    bool hasGarbage() const; // набралась пачка для сборки
+    void collect(const SnapshotRegistry &snapshots);
 
-    ListNode *getBucketHead(size_t index) const;
+    size_t getSize() const; // ключи вместе с ещё не убранными удалёнными
+    size_t getLiveCount() const; // только живые документы (по последней записи)
+    // версия последнего изменения данных; записи без изменений (UPDATE/DELETE без
+    // совпадений) её не двигают - кеш результатов и сохранение на них не реагируют
+    unsigned long long getChangedVersion() const;
+    size_t getMemoryUsage() const; // приблизительно, без накладных расходов malloc
+    double getLoadFactor() const;  // ключей на бакет текущей таблицы (вызывающий держит снимок)
 };
@@ -1,8 +1,10 @@
 #include <iostream>
 #include <string>
+#include <cstdio>
 #include <cstdlib>
 #include <cctype>
 #include <algorithm>
+#include <chrono>
 #include <sys/time.h> // для struct timeval
 
 
@@ -12,6 +14,8 @@
 #include <arpa/inet.h>
 #include <unistd.h>
 #include "utills.h"
+#include "line_reader.h"
+#include "client_bench.h"
 
 
 static std::string toLower(const std::string& s) // приведение строки к нижнему регистру
@@ -92,18 +96,20 @@ bool writeAll(int sock, const std::string& data)
 }
 
 
-// чтение одной строки до '\n'
-bool readLine(int sock, std::string& out)
+// чтение одной строки до '\n': recv() большими кусками через буфер соединения
+bool readLine(int sock, LineReader& reader, std::string& out)
 {
-    out.clear();
-    char ch = 0;
-
-    while (true)
+    std::string_view line;
+    while (!reader.nextLine(line))
     {
-        ssize_t n = ::recv(sock, &ch, 1, 0);
+        ssize_t n = reader.fill(sock);
 
         if (n < 0)
         {
+            if (errno == EINTR)
+            {
+                continue;
+            }
             if (errno == EWOULDBLOCK || errno == EAGAIN)
             {
                 std::cerr << "[Client] recv timeout\n";
@@ -120,15 +126,9 @@ bool readLine(int sock, std::string& out)
             // сервер закрыл соединение
             return false;
         }
-
-        if (ch == '\n')
-        {
-            break;
-        }
-
-        out.push_back(ch);
     }
 
+    out.assign(line.data(), line.size());
     return true;
 }
 
@@ -147,16 +147,60 @@ static bool buildJsonRequestFromCommand(const std::string& line, const std::stri
     std::string rest = (spacePos == std::string::npos ? std::string() : trim(trimmed.substr(spacePos + 1))); // остальная часть
     std::string op = toLower(cmd); // приводим к индексу
 
-    if (op != "insert" && op != "find" && op != "delete")
+    // EXPLAIN <команда>: та же команда + отчёт о выполнении
+    std::string extraFields;
+    if (op == "explain")
+    {
+        std::size_t opEnd = rest.find(' ');
+        cmd = (opEnd == std::string::npos) ? rest : rest.substr(0, opEnd);
+        op = toLower(cmd);
+        rest = (opEnd == std::string::npos) ? std::string() : trim(rest.substr(opEnd + 1));
+        extraFields = "\"explain\":true,";
+    }
+
+    // PREPARE <FIND|COUNT|DELETE|UPDATE> <запрос с ?> [модификаторы]
+    bool isPrepare = (op == "prepare");
+    if (isPrepare)
+    {
+        std::size_t opEnd = rest.find(' ');
+        std::string preparedOp = toLower(opEnd == std::string::npos ? rest : rest.substr(0, opEnd));
+        if (preparedOp != "find" && preparedOp != "count" && preparedOp != "delete" && preparedOp != "update")
+        {
+            std::cerr << "PREPARE ожидает FIND, COUNT, DELETE или UPDATE\n";
+            return false;
+        }
+        extraFields += "\"command\":\"" + preparedOp + "\",";
+        op = preparedOp; // дальше разбираем как обычную команду
+        rest = (opEnd == std::string::npos) ? std::string() : trim(rest.substr(opEnd + 1));
+    }
+
+    // EXECUTE <номер> [параметры]
+    if (op == "execute")
+    {
+        std::size_t idEnd = rest.find(' ');
+        std::string statement = (idEnd == std::string::npos) ? rest : rest.substr(0, idEnd);
+        std::string params = (idEnd == std::string::npos) ? std::string("[]") : trim(rest.substr(idEnd + 1));
+        if (statement.empty() || params.empty() || params.front() != '[')
+        {
+            std::cerr << "EXECUTE ожидает номер и массив параметров: EXECUTE 1 [30]\n";
+            return false;
+        }
+
+        outJson = "{\"database\":\"" + escapeJsonString(database) + "\",\"operation\":\"execute\","
+                  "\"statement\":\"" + escapeJsonString(statement) + "\",\"params\":" + params + "}\n";
+        return true;
+    }
+
+    if (op != "insert" && op != "find" && op != "count" && op != "delete" && op != "update")
     {
         std::cerr << "Unknown command: " << cmd
-                  << " (use INSERT, FIND, DELETE)\n";
+                  << " (use INSERT, FIND, COUNT, DELETE, UPDATE, PREPARE, EXECUTE)\n";
         return false;
     }
 
-    // Для find/delete, если условия нет - считаем "{}"
+    // Для find/count/delete, если условия нет - считаем "{}"
     std::string queryJson = "{}";
-    if (op == "find" || op == "delete")
+    if (op == "find" || op == "count" || op == "delete")
     {
         if (!rest.empty())
         {
@@ -189,6 +233,25 @@ static bool buildJsonRequestFromCommand(const std::string& line, const std::stri
         queryJson = "{}"; 
     }
 
+    // UPDATE <условие> <модификаторы>: два объекта подряд
+    if (op == "update")
+    {
+        std::size_t queryEnd = (rest.empty() || rest.front() != '{') ? std::string::npos : findMatchingBracket(rest, 0);
+        if (queryEnd == std::string::npos)
+        {
+            std::cerr << "UPDATE требует условие и модификаторы: UPDATE {...} {\"$set\":{...}}\n";
+            return false;
+        }
+
+        queryJson = rest.substr(0, queryEnd + 1);
+        dataJson = trim(rest.substr(queryEnd + 1));
+        if (dataJson.empty() || dataJson.front() != '{')
+        {
+            std::cerr << "UPDATE требует модификаторы после условия.\n";
+            return false;
+        }
+    }
+
     // Собираем JSON-запрос:
     // }
     std::string json;
@@ -200,8 +263,9 @@ static bool buildJsonRequestFromCommand(const std::string& line, const std::stri
     json += "\",";
 
     json += "\"operation\":\"";
-    json += escapeJsonString(op);
+    json += escapeJsonString(isPrepare ? std::string("prepare") : op);
     json += "\",";
+    json += extraFields;
 
     json += "\"data\":";
     json += dataJson;
@@ -217,6 +281,376 @@ static bool buildJsonRequestFromCommand(const std::string& line, const std::stri
     return true;
 }
 
+// КОНВЕЙЕРНЫЙ РЕЖИМ: команды из stdin уходят пачками по depth запросов одним send(),
+// ответы читаются после отправки всей пачки; в конце - время и пропускная способность
+static int runPipeline(int sock, LineReader& reader, const std::string& database, std::size_t depth)
+{
+    std::size_t total = 0;
+    bool inputDone = false;
+    auto start = std::chrono::steady_clock::now();
+
+    while (!inputDone)
+    {
+        std::string batch;
+        std::size_t inFlight = 0;
+        std::string line;
+        while (inFlight < depth && std::getline(std::cin, line))
+        {
+            std::string lowered = toLower(trim(line));
+            if (lowered == "exit" || lowered == "quit")
+            {
+                break;
+            }
+
+            std::string reqJson;
+            if (trim(line).empty() || !buildJsonRequestFromCommand(line, database, reqJson))
+            {
+                continue;
+            }
+            batch += reqJson;
+            ++inFlight;
+        }
+        if (inFlight < depth)
+        {
+            inputDone = true; // stdin кончился или exit
+        }
+
+        if (inFlight == 0)
+        {
+            break;
+        }
+
+        if (!writeAll(sock, batch))
+        {
+            std::cerr << "Send error\n";
+            return 1;
+        }
+
+        // сервер отвечает строго в порядке запросов
+        for (std::size_t i = 0; i < inFlight; ++i)
+        {
+            std::string respLine;
+            if (!readLine(sock, reader, respLine))
+            {
+                std::cerr << "Disconnected from server\n";
+                return 1;
+            }
+            std::cout << respLine << "\n";
+        }
+        total += inFlight;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cerr << "[Client] " << total << " requests, pipeline depth " << depth << ": "
+              << seconds * 1000.0 << " ms, "
+              << (seconds > 0 ? static_cast<long long>(total / seconds) : 0) << " req/s\n";
+    return 0;
+}
+
+// ответ на пачку импорта: сколько документов принято, ошибки - в stderr (первая - целиком)
+static bool readImportResponse(int sock, LineReader& reader, std::size_t& accepted, std::size_t& errors)
+{
+    std::string respLine;
+    if (!readLine(sock, reader, respLine))
+    {
+        std::cerr << "Disconnected from server\n";
+        return false;
+    }
+    if (respLine.compare(0, 17, "{\"status\":\"error\"") == 0)
+    {
+        if (errors == 0)
+        {
+            std::cerr << "[Client] import error: " << respLine << "\n";
+        }
+        ++errors;
+        return true;
+    }
+    std::size_t at = respLine.find("\"count\":");
+    if (at != std::string::npos)
+    {
+        accepted += std::strtoull(respLine.c_str() + at + 8, nullptr, 10);
+    }
+    return true;
+}
+
+// пачка импорта закрывается и по размеру: крупные документы не должны собирать
+// запросы в сотни мегабайт (у сервера лимит на строку запроса)
+static const std::size_t IMPORT_BATCH_BYTES = 4 * 1024 * 1024;
+
+// ИМПОРТ: документы из файла (JSON Lines или один JSON-массив) уходят пачками по batch
+// штук (но не больше IMPORT_BATCH_BYTES) операцией import - сервер не переписывает файл базы на каждую пачку. До depth пачек
+// в полёте, в конце один save. Файл читается кусками, документы вырезаются по скобкам
+// без разбора полей
+static int runImport(int sock, LineReader& reader, const std::string& database, const std::string& path,
+                     std::size_t batch, std::size_t depth)
+{
+    FILE* in = std::fopen(path.c_str(), "rb");
+    if (in == nullptr)
+    {
+        std::perror(path.c_str());
+        return 1;
+    }
+
+    const std::string prefix = "{\"database\":\"" + escapeJsonString(database) + "\",\"operation\":\"import\",\"data\":[";
+    std::string request = prefix;
+    std::size_t inBatch = 0;  // документов в собираемой пачке
+    std::size_t inFlight = 0; // пачек без ответа
+    std::size_t documents = 0;
+    std::size_t batches = 0;
+    std::size_t accepted = 0;
+    std::size_t errors = 0;
+    bool ok = true;
+    auto start = std::chrono::steady_clock::now();
+
+    auto sendBatch = [&]() -> bool
+    {
+        request += "],\"query\":{}}\n";
+        if (inFlight >= depth)
+        {
+            if (!readImportResponse(sock, reader, accepted, errors))
+            {
+                return false;
+            }
+            --inFlight;
+        }
+        if (!writeAll(sock, request))
+        {
+            return false;
+        }
+        ++inFlight;
+        ++batches;
+        request = prefix;
+        inBatch = 0;
+        return true;
+    };
+
+    int base = -1;      // вложенность документов: 0 - JSON Lines, 1 - внутри массива
+    int level = 0;
+    bool inString = false;
+    bool escaped = false;
+    unsigned long long offset = 0;
+    char* buffer = new char[1 << 20];
+    std::size_t n;
+    while (ok && (n = std::fread(buffer, 1, 1 << 20, in)) > 0)
+    {
+        for (std::size_t i = 0; i < n && ok; ++i, ++offset)
+        {
+            char c = buffer[i];
+            if (level <= base || base < 0)
+            {
+                // между документами: пробелы, запятые и скобки массива
+                if (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == ',')
+                {
+                    continue;
+                }
+                if (base < 0 && c == '[')
+                {
+                    base = 1;
+                    level = 1;
+                    continue;
+                }
+                if (base < 0)
+                {
+                    base = 0;
+                }
+                if (c == ']' && base == 1 && level == 1)
+                {
+                    level = 0;
+                    continue;
+                }
+                if (c != '{' || level != base)
+                {
+                    std::cerr << path << ": unexpected '" << c << "' at byte " << offset << "\n";
+                    ok = false;
+                    break;
+                }
+                if (inBatch > 0)
+                {
+                    request += ',';
+                }
+                request += '{';
+                ++level;
+                continue;
+            }
+
+            // внутри документа: переводы строк сервер принял бы за конец запроса
+            request += (c == '\n' || c == '\r') ? ' ' : c;
+            if (inString)
+            {
+                if (escaped)
+                {
+                    escaped = false;
+                }
+                else if (c == '\\')
+                {
+                    escaped = true;
+                }
+                else if (c == '"')
+                {
+                    inString = false;
+                }
+            }
+            else if (c == '"')
+            {
+                inString = true;
+            }
+            else if (c == '{' || c == '[')
+            {
+                ++level;
+            }
+            else if ((c == '}' || c == ']') && --level == base)
+            {
+                ++documents;
+                ++inBatch;
+                if ((inBatch >= batch || request.size() >= IMPORT_BATCH_BYTES) && !sendBatch())
+                {
+                    ok = false;
+                }
+            }
+        }
+    }
+    delete[] buffer;
+    std::fclose(in);
+
+    if (ok && level > base && base >= 0)
+    {
+        std::cerr << path << ": unterminated document at the end of file\n";
+        ok = false;
+    }
+    if (ok && inBatch > 0)
+    {
+        ok = sendBatch();
+    }
+    // уже отправленные пачки дочитываем в любом случае: save должен увидеть их все
+    while (inFlight > 0 && readImportResponse(sock, reader, accepted, errors))
+    {
+        --inFlight;
+    }
+    if (inFlight > 0)
+    {
+        return 1;
+    }
+
+    std::string save = "{\"database\":\"" + escapeJsonString(database) + "\",\"operation\":\"save\"}\n";
+    std::string respLine;
+    if (!writeAll(sock, save) || !readLine(sock, reader, respLine))
+    {
+        std::cerr << "Disconnected from server\n";
+        return 1;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cerr << "[Client] imported " << accepted << " of " << documents << " documents in " << batches
+              << " batches: " << seconds * 1000.0 << " ms, "
+              << (seconds > 0 ? static_cast<long long>(accepted / seconds) : 0) << " docs/s";
+    if (errors > 0)
+    {
+        std::cerr << ", " << errors << " batches failed";
+    }
+    std::cerr << "\n";
+    return ok && errors == 0 ? 0 : 1;
+}
+
+// ЭКСПОРТ: результат FIND пишется в файл по документу, без промежуточного разбора -
+// JSON Lines или один JSON-массив (jsonArray)
+static int runExport(int sock, LineReader& reader, const std::string& database, const std::string& path,
+                     const std::string& query, bool jsonArray)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::string request = "{\"database\":\"" + escapeJsonString(database) +
+                          "\",\"operation\":\"find\",\"data\":[],\"query\":" + query + "}\n";
+    std::string respLine;
+    if (!writeAll(sock, request) || !readLine(sock, reader, respLine))
+    {
+        std::cerr << "Disconnected from server\n";
+        return 1;
+    }
+    std::size_t data = respLine.find("\"data\":[");
+    if (respLine.compare(0, 19, "{\"status\":\"success\"") != 0 || data == std::string::npos)
+    {
+        std::cerr << "[Client] export failed: " << respLine << "\n";
+        return 1;
+    }
+
+    FILE* out = std::fopen(path.c_str(), "wb");
+    if (out == nullptr)
+    {
+        std::perror(path.c_str());
+        return 1;
+    }
+    std::setvbuf(out, nullptr, _IOFBF, 1 << 20);
+
+    if (jsonArray)
+    {
+        std::fputs("[\n", out);
+    }
+    std::size_t documents = 0;
+    int level = 0;
+    bool inString = false;
+    bool escaped = false;
+    std::size_t docStart = 0;
+    for (std::size_t i = data + 8; i < respLine.size(); ++i)
+    {
+        char c = respLine[i];
+        if (inString)
+        {
+            if (escaped)
+                escaped = false;
+            else if (c == '\\')
+                escaped = true;
+            else if (c == '"')
+                inString = false;
+            continue;
+        }
+        if (c == '"')
+        {
+            inString = true;
+        }
+        else if (c == '{' || c == '[')
+        {
+            if (level++ == 0)
+            {
+                docStart = i;
+            }
+        }
+        else if (c == '}' || c == ']')
+        {
+            if (level == 0)
+            {
+                break; // конец массива data
+            }
+            if (--level == 0)
+            {
+                if (jsonArray && documents > 0)
+                {
+                    std::fputs(",\n", out);
+                }
+                std::fwrite(respLine.data() + docStart, 1, i + 1 - docStart, out);
+                if (!jsonArray)
+                {
+                    std::fputc('\n', out);
+                }
+                ++documents;
+            }
+        }
+    }
+    if (jsonArray)
+    {
+        std::fputs(documents > 0 ? "\n]\n" : "]\n", out);
+    }
+    bool written = std::fclose(out) == 0;
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cerr << "[Client] exported " << documents << " documents to " << path << ": "
+              << seconds * 1000.0 << " ms\n";
+    if (!written)
+    {
+        std::perror(path.c_str());
+        return 1;
+    }
+    return 0;
+}
+
 int main(int argc, char* argv[])
 {
     std::string host;
@@ -224,6 +658,14 @@ int main(int argc, char* argv[])
     std::string database = "mydb";
     std::string onceCommand;
     bool onceMode = false; // режим одного запроса
+    std::size_t pipelineDepth = 0; // 0 - интерактивный режим
+    bool benchMode = false; // нагрузочный режим
+    std::string importPath;  // файл для импорта
+    std::string exportPath;  // файл для экспорта
+    std::string exportQuery = "{}";
+    bool exportArray = false; // экспорт одним JSON-массивом вместо JSON Lines
+    std::size_t importBatch = 1000; // документов в одном запросе import
+    BenchConfig bench;
 
  
     for (int i = 1; i < argc; ++i)
@@ -247,6 +689,107 @@ int main(int argc, char* argv[])
             onceMode = true;
             onceCommand = argv[++i];
         }
+        else if (arg == "--pipeline" && i + 1 < argc)
+        {
+            int depth = std::atoi(argv[++i]);
+            if (depth <= 0)
+            {
+                std::cerr << "--pipeline ожидает положительное число запросов\n";
+                return 1;
+            }
+            pipelineDepth = static_cast<std::size_t>(depth);
+        }
+        else if (arg == "--import" && i + 1 < argc)
+        {
+            importPath = argv[++i];
+        }
+        else if (arg == "--export" && i + 1 < argc)
+        {
+            exportPath = argv[++i];
+        }
+        else if (arg == "--query" && i + 1 < argc)
+        {
+            exportQuery = argv[++i];
+        }
+        else if (arg == "--format" && i + 1 < argc)
+        {
+            std::string format = argv[++i];
+            if (format != "jsonl" && format != "json")
+            {
+                std::cerr << "--format ожидает jsonl или json\n";
+                return 1;
+            }
+            exportArray = (format == "json");
+        }
+        else if (arg == "--batch" && i + 1 < argc)
+        {
+            int batch = std::atoi(argv[++i]);
+            if (batch <= 0)
+            {
+                std::cerr << "--batch ожидает положительное число документов\n";
+                return 1;
+            }
+            importBatch = static_cast<std::size_t>(batch);
+        }
+        else if (arg == "--bench")
+        {
+            benchMode = true;
+        }
+        else if (arg == "--connections" && i + 1 < argc)
+        {
+            int connections = std::atoi(argv[++i]);
+            if (connections <= 0)
+            {
+                std::cerr << "--connections ожидает положительное число\n";
+                return 1;
+            }
+            bench.connections = static_cast<std::size_t>(connections);
+        }
+        else if (arg == "--duration" && i + 1 < argc)
+        {
+            bench.duration_s = std::atof(argv[++i]);
+            if (bench.duration_s <= 0)
+            {
+                std::cerr << "--duration ожидает положительное число секунд\n";
+                return 1;
+            }
+        }
+        else if (arg == "--warmup" && i + 1 < argc)
+        {
+            bench.warmup_s = std::atof(argv[++i]);
+        }
+        else if (arg == "--rate" && i + 1 < argc)
+        {
+            bench.rate = std::atof(argv[++i]); // 0 - замкнутый цикл
+        }
+        else if (arg == "--mix" && i + 1 < argc)
+        {
+            if (!parseBenchMix(argv[++i], bench))
+            {
+                std::cerr << "--mix ожидает веса insert:find:delete, например 10:80:10\n";
+                return 1;
+            }
+        }
+        else if (arg == "--keys" && i + 1 < argc)
+        {
+            bench.keys = static_cast<std::size_t>(std::atoll(argv[++i]));
+        }
+        else if (arg == "--payload" && i + 1 < argc)
+        {
+            bench.payload_bytes = static_cast<std::size_t>(std::atoll(argv[++i]));
+        }
+        else if (arg == "--insert-doc" && i + 1 < argc)
+        {
+            bench.insert_template = argv[++i];
+        }
+        else if (arg == "--find-query" && i + 1 < argc)
+        {
+            bench.find_template = argv[++i];
+        }
+        else if (arg == "--delete-query" && i + 1 < argc)
+        {
+            bench.delete_template = argv[++i];
+        }
         else
         {
             std::cerr << "Неизвестный аргумент: " << arg << "\n";
@@ -254,6 +797,18 @@ int main(int argc, char* argv[])
         }
     }
 
+    // НАГРУЗОЧНЫЙ РЕЖИМ: свои соединения, по одному на поток
+    if (benchMode)
+    {
+        if (!host.empty())
+        {
+            bench.host = host;
+        }
+        bench.port = port;
+        bench.database = database;
+        return runBench(bench);
+    }
+
     // создаём сокет
     int sock = socket(AF_INET, SOCK_STREAM, 0);
     if (sock < 0)
@@ -304,6 +859,8 @@ int main(int argc, char* argv[])
     std::cout << "Connected to " << host << ":" << port
               << " (database: " << database << ")\n";
 
+    LineReader reader; // буфер ответов сервера на всё соединение
+
     // РЕЖИМ ОДНОГО ЗАПРОСА
     if (onceMode)
     {
@@ -323,7 +880,7 @@ int main(int argc, char* argv[])
         }
 
         std::string respLine;
-        if (!readLine(sock, respLine)) // читаем ответ
+        if (!readLine(sock, reader, respLine)) // читаем ответ
         {
             std::cerr << "Disconnected from server\n";
             close(sock);
@@ -335,6 +892,28 @@ int main(int argc, char* argv[])
         return 0;
     }
 
+    if (!importPath.empty())
+    {
+        // --pipeline здесь - сколько пачек в полёте
+        int rc = runImport(sock, reader, database, importPath, importBatch, pipelineDepth > 0 ? pipelineDepth : 4);
+        close(sock);
+        return rc;
+    }
+
+    if (!exportPath.empty())
+    {
+        int rc = runExport(sock, reader, database, exportPath, exportQuery, exportArray);
+        close(sock);
+        return rc;
+    }
+
+    if (pipelineDepth > 0)
+    {
+        int rc = runPipeline(sock, reader, database, pipelineDepth);
+        close(sock);
+        return rc;
+    }
+
     // ИНТЕРАКТИВНЫЙ РЕЖИМ
     while (true)
     {
@@ -371,7 +950,7 @@ int main(int argc, char* argv[])
         }
 
         std::string respLine;
-        if (!readLine(sock, respLine))
+        if (!readLine(sock, reader, respLine))
         {
             std::cerr << "Disconnected from server\n";
             close(sock);
@@ -0,0 +1,342 @@
+#include "db_registry.h"
+#include "logger.h"
+
+#include <malloc.h>
+
+#include <chrono>
+#include <future>
+
+using namespace std;
+
+struct DbRegistry::Entry
+{
+    string name;
+    Stripe *stripe;
+    // загруженная база; читается без блокировки, меняется под stripe->mtx
+    atomic<MiniDBMS *> db;
+    atomic<int> users;           // живые DbHandle
+    atomic<long long> last_used; // для LRU, steady_clock в нс
+    // ниже - под stripe->mtx
+    bool busy;                           // идёт загрузка или выгрузка
+    shared_future<MiniDBMS *> finished;  // её окончание (для ждущих)
+    Entry *next;                         // цепочка в полосе
+};
+
+static long long now_ns()
+{
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+DbHandle::DbHandle(DbRegistry *registry, DbRegistry::Entry *entry, MiniDBMS *db) : registry(registry), entry(entry), db(db) {}
+
+DbHandle::DbHandle(DbHandle &&other) noexcept : registry(other.registry), entry(other.entry), db(other.db)
+{
+    other.entry = nullptr;
+}
+
+DbHandle::~DbHandle()
+{
+    if (entry)
+    {
+        registry->release(entry);
+    }
+}
+
+DbRegistry::DbRegistry(DbSetup setup) : setup(setup), memory_budget(0) {}
+
+DbRegistry::~DbRegistry()
+{
+    for (size_t i = 0; i < STRIPES; i++)
+    {
+        Entry *current = stripes[i].head;
+        while (current)
+        {
+            Entry *next = current->next;
+            delete current->db.load();
+            delete current;
+            current = next;
+        }
+    }
+}
+
+DbRegistry::Stripe &DbRegistry::stripe_of(const string &name)
+{
+    size_t hash_value = 0;
+    for (unsigned char c : name)
+    {
+        hash_value = hash_value * 31 + c;
+    }
+    return stripes[hash_value % STRIPES];
+}
+
+DbRegistry::Entry *DbRegistry::find(Stripe &stripe, const string &name)
+{
+    for (Entry *current = stripe.head; current; current = current->next)
+    {
+        if (current->name == name)
+        {
+            return current;
+        }
+    }
+    return nullptr;
+}
+
+DbRegistry::Entry *DbRegistry::lookup(const string &name)
+{
+    Stripe &stripe = stripe_of(name);
+    lock_guard<mutex> lock(stripe.mtx);
+    Entry *entry = find(stripe, name);
+    if (entry == nullptr)
+    {
+        entry = new Entry;
+        entry->name = name;
+        entry->stripe = &stripe;
+        entry->db.store(nullptr);
+        entry->users.store(0);
+        entry->last_used.store(0);
+        entry->busy = false;
+        entry->next = stripe.head;
+        stripe.head = entry;
+    }
+    return entry;
+}
+
+DbHandle DbRegistry::get(const string &name)
+{
+    return acquire(lookup(name));
+}
+
+// быстрый путь без блокировок: сначала отмечаемся в users, потом читаем db.
+// Выгрузка делает наоборот (обнуляет db, потом проверяет users), поэтому
+// хотя бы одна сторона увидит другую и база не пропадёт из-под запроса
+DbHandle DbRegistry::acquire(Entry *entry)
+{
+    entry->users.fetch_add(1);
+    MiniDBMS *db = entry->db.load();
+    if (db)
+    {
+        entry->last_used.store(now_ns(), memory_order_relaxed);
+        return DbHandle(this, entry, db);
+    }
+    entry->users.fetch_sub(1);
+    return acquire_slow(entry);
+}
+
+DbHandle DbRegistry::acquire_slow(Entry *entry)
+{
+    unique_lock<mutex> lock(entry->stripe->mtx);
+    while (true)
+    {
+        MiniDBMS *db = entry->db.load();
+        if (db)
+        {
+            entry->users.fetch_add(1);
+            entry->last_used.store(now_ns(), memory_order_relaxed);
+            return DbHandle(this, entry, db);
+        }
+        if (!entry->busy)
+        {
+            db = load(entry, lock);
+            return DbHandle(this, entry, db);
+        }
+
+        // базу грузит или выгружает другой поток - ждём и смотрим заново
+        shared_future<MiniDBMS *> finished = entry->finished;
+        lock.unlock();
+        finished.get(); // исключение загрузчика пробрасывается и сюда
+        lock.lock();
+    }
+}
+
+// загрузка вне блокировки полосы: остальные базы полосы в это время доступны.
+// Вызывается под lock, возвращает базу уже закреплённой за вызывающим
+MiniDBMS *DbRegistry::load(Entry *entry, unique_lock<mutex> &lock)
+{
+    promise<MiniDBMS *> loader;
+    entry->busy = true;
+    entry->finished = loader.get_future().share();
+    lock.unlock();
+
+    MiniDBMS *db = nullptr;
+    try
+    {
+        db = new MiniDBMS(entry->name);
+        if (setup)
+        {
+            setup(*db);
+        }
+        db->loadFromDisk();
+    }
+    catch (...)
+    {
+        delete db;
+        // запись остаётся в полосе пустой (db == nullptr): на неё могут ссылаться
+        // сессии бинарного протокола, удалить её под ними нельзя.
+        // Следующий запрос к этому имени попробует открыть базу заново
+        lock.lock();
+        entry->busy = false;
+        lock.unlock();
+        loader.set_exception(current_exception());
+        throw;
+    }
+
+    lock.lock();
+    entry->users.fetch_add(1);
+    entry->last_used.store(now_ns(), memory_order_relaxed);
+    entry->db.store(db);
+    entry->busy = false;
+    lock.unlock();
+    loader.set_value(db);
+
+    // новая база могла вывести за бюджет - освобождаем место за счёт остальных
+    enforceBudget();
+    return db;
+}
+
+void DbRegistry::release(Entry *entry)
+{
+    entry->users.fetch_sub(1);
+
+    // базы растут и от записей, поэтому бюджет проверяется и без загрузок
+    static thread_local unsigned releases = 0;
+    if (++releases % BUDGET_CHECK_EVERY == 0)
+    {
+        enforceBudget();
+    }
+}
+
+void DbRegistry::setMemoryBudget(size_t bytes)
+{
+    memory_budget.store(bytes);
+}
+
+size_t DbRegistry::getMemoryBudget() const
+{
+    return memory_budget.load();
+}
+
+size_t DbRegistry::scan(Entry *&victim)
+{
+    size_t total = 0;
+    victim = nullptr;
+    long long victim_used = 0;
+    for (size_t i = 0; i < STRIPES; i++)
+    {
+        lock_guard<mutex> lock(stripes[i].mtx);
+        for (Entry *current = stripes[i].head; current; current = current->next)
+        {
+            MiniDBMS *db = current->db.load();
+            if (db == nullptr)
+            {
+                continue;
+            }
+            total += db->memoryUsage(); // под блокировкой полосы базу не выгрузят
+            long long used = current->last_used.load(memory_order_relaxed);
+            if (current->users.load() == 0 && (victim == nullptr || used < victim_used))
+            {
+                victim = current;
+                victim_used = used;
+            }
+        }
+    }
+    return total;
+}
+
+size_t DbRegistry::getMemoryUsage()
+{
+    Entry *victim;
+    return scan(victim);
+}
+
+void DbRegistry::enforceBudget()
+{
+    size_t budget = memory_budget.load();
+    if (budget == 0)
+    {
+        return;
+    }
+    unique_lock<mutex> evicting(evict_mtx, try_to_lock);
+    if (!evicting.owns_lock())
+    {
+        return; // уже выгружает другой поток
+    }
+
+    while (true)
+    {
+        Entry *victim;
+        if (scan(victim) <= budget || victim == nullptr)
+        {
+            return; // в бюджете или выгружать некого: всё занято запросами
+        }
+        if (!evict(victim))
+        {
+            return; // базу только что взяли или её не удалось сохранить - попробуем при следующей проверке
+        }
+    }
+}
+
+// база уходит из памяти: новые запросы к ней ждут окончания выгрузки и грузят её заново
+bool DbRegistry::evict(Entry *victim)
+{
+    unique_lock<mutex> lock(victim->stripe->mtx);
+    if (victim->users.load() != 0)
+    {
+        return false;
+    }
+    MiniDBMS *db = victim->db.exchange(nullptr);
+    if (db == nullptr)
+    {
+        return false;
+    }
+    if (victim->users.load() != 0)
+    {
+        // запрос успел взять базу между проверками - оставляем
+        victim->db.store(db);
+        return false;
+    }
+
+    promise<MiniDBMS *> unloader;
+    victim->busy = true;
+    victim->finished = unloader.get_future().share();
+    lock.unlock();
+
+    size_t bytes = db->memoryUsage();
+    // обычно уже сохранена последней записью - тогда ничего не пишет
+    if (!db->saveToDisk())
+    {
+        // несохранённые изменения есть только в памяти - база остаётся загруженной
+        LOG_ERROR("ERROR: База " << victim->name << " не выгружена: не удалось сохранить на диск");
+        lock.lock();
+        victim->db.store(db);
+        victim->busy = false;
+        lock.unlock();
+        unloader.set_value(db);
+        return false;
+    }
+    delete db;
+    malloc_trim(0); // вернуть освободившееся системе, а не держать в куче процесса
+    LOG_INFO("INFO: База " << victim->name << " выгружена из памяти ("
+             << bytes / (1024 * 1024) << " МБ)");
+
+    lock.lock();
+    victim->busy = false;
+    lock.unlock();
+    unloader.set_value(nullptr);
+    return true;
+}
+
+void DbRegistry::forEachLoaded(const function<void(const string &name, MiniDBMS &db)> &visit)
+{
+    for (size_t i = 0; i < STRIPES; i++)
+    {
+        lock_guard<mutex> lock(stripes[i].mtx);
+        for (Entry *current = stripes[i].head; current; current = current->next)
+        {
+            MiniDBMS *db = current->db.load();
+            if (db)
+            {
+                visit(current->name, *db);
+            }
+        }
+    }
+}
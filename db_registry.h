@@ -0,0 +1,102 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <string>
+
+#include "minidbms.h"
+
+class DbHandle;
+
+// открытые базы сервера по имени.
+// Таблица разбита на полосы со своими мьютексами: поиск одной базы не ждёт другие.
+// Загрузка с диска идёт вне всех блокировок - кто пришёл за той же базой во время
+// загрузки, ждёт её future, запросы к остальным базам идут как обычно.
+// С бюджетом памяти давно не используемые базы (LRU) сохраняются и выгружаются,
+// следующее обращение загружает их заново
+class DbRegistry
+{
+public:
+    // настройка только что созданной базы до загрузки (кеши, способ записи)
+    typedef void (*DbSetup)(MiniDBMS &db);
+
+    // запись реестра: создаётся при первом обращении к имени и живёт, пока жив реестр,
+    // поэтому на неё можно ссылаться дольше запроса (таблица баз бинарного протокола).
+    // Ни выгрузка, ни неудачная загрузка запись не удаляют - у неё только обнуляется db
+    struct Entry;
+
+private:
+    struct Stripe
+    {
+        std::mutex mtx;
+        Entry *head = nullptr;
+    };
+
+    static const size_t STRIPES = 64;
+    // как часто (в отпущенных ручках на поток) пересчитывать память под бюджет
+    static const unsigned BUDGET_CHECK_EVERY = 256;
+
+    Stripe stripes[STRIPES];
+    DbSetup setup;
+    std::atomic<size_t> memory_budget; // 0 - без ограничения
+    std::mutex evict_mtx;              // выгрузкой занимается один поток
+
+    Stripe &stripe_of(const std::string &name);
+    static Entry *find(Stripe &stripe, const std::string &name); // под stripe.mtx
+    DbHandle acquire_slow(Entry *entry);
+    MiniDBMS *load(Entry *entry, std::unique_lock<std::mutex> &lock);
+    void release(Entry *entry);
+    size_t scan(Entry *&victim); // память загруженных баз + самая давняя свободная
+    bool evict(Entry *victim);
+
+    friend class DbHandle;
+
+public:
+    explicit DbRegistry(DbSetup setup = nullptr);
+    ~DbRegistry();
+    DbRegistry(const DbRegistry &) = delete;
+    DbRegistry &operator=(const DbRegistry &) = delete;
+
+    // запись по имени без загрузки базы
+    Entry *lookup(const std::string &name);
+    // база записи, при необходимости загруженная; первый запросивший грузит её сам.
+    // Ошибка загрузки доходит до всех ждавших, запись остаётся пустой,
+    // следующий запрос попробует снова
+    DbHandle acquire(Entry *entry);
+    DbHandle get(const std::string &name);
+
+    // общий бюджет памяти баз в байтах, 0 - не выгружать
+    void setMemoryBudget(size_t bytes);
+    size_t getMemoryBudget() const;
+    size_t getMemoryUsage();
+    // выгрузить свободные базы сверх бюджета, начиная с давно не использованных
+    void enforceBudget();
+
+    // обход загруженных баз (для статистики); visit вызывается под блокировкой полосы,
+    // поэтому база не выгрузится посреди обхода, но и ждать внутри нельзя
+    void forEachLoaded(const std::function<void(const std::string &name, MiniDBMS &db)> &visit);
+};
+
+// база, закреплённая на время запроса: пока ручка жива, реестр её не выгрузит
+class DbHandle
+{
+private:
+    DbRegistry *registry;
+    DbRegistry::Entry *entry;
+    MiniDBMS *db;
+
+    friend class DbRegistry;
+    DbHandle(DbRegistry *registry, DbRegistry::Entry *entry, MiniDBMS *db);
+
+public:
+    DbHandle(DbHandle &&other) noexcept;
+    ~DbHandle();
+    DbHandle(const DbHandle &) = delete;
+    DbHandle &operator=(const DbHandle &) = delete;
+    DbHandle &operator=(DbHandle &&) = delete;
+
+    MiniDBMS *operator->() const { return db; }
+    MiniDBMS &operator*() const { return *db; }
+};
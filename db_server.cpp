@@ -1,119 +1,54 @@
 #include "minidbms.h"
+#include "binary_protocol.h"
 #include "protocol.h"
 #include "request_handler.h"
+#include "db_registry.h"
+#include "logger.h"
+#include "event_loop.h"
+#include "metrics.h"
+#include "server_stats.h"
+#include "slow_log.h"
+#include "capture.h"
+#include "trace.h"
+#include "uring_loop.h"
+#include "session.h"
 
-#include <arpa/inet.h>
-#include <netinet/in.h>
-#include <sys/socket.h>
-#include <unistd.h>
-#include <sys/time.h> // для struct timeval
 #include <atomic>
-
-
-
 #include <cerrno>
 #include <csignal>
 #include <cstring>
 #include <iostream>
-#include <mutex>
 #include <string>
 #include <thread>
 
 using namespace std;
 
-struct DbEntry
-{
-    string name;   // имя базы
-    MiniDBMS* db;       // указатель на объект базы
-    mutex mtx;     // мьютекс НА КОНКРЕТНУЮ БД
-    DbEntry* next;      // односвязный список
-};
-
-static DbEntry* g_dbList = nullptr;
-static mutex g_dbListMutex;
+// бюджет кеша результатов FIND на каждую базу (0 - выключен)
+static size_t g_resultCacheBytes = 0;
+// файлы баз пишутся через io_uring (включается вместе с --io uring)
+static bool g_uringFileWrites = false;
 // счетчик активных клиентов
 static std::atomic<int> g_activeClients{0};
-// максимально допустимое количество одновременно обслуживаемых клиентов
-static constexpr int MAX_CLIENTS = 16;
+// сколько соединений отклонено из-за лимита
+static std::atomic<long long> g_refusedClients{0};
+// максимально допустимое количество одновременно обслуживаемых клиентов (по умолчанию)
+static constexpr int MAX_CLIENTS = 10000;
 
-
-
-// чтение строки из сокета
-static bool readLine(int sock, std::string& out)
+// настройки сервера для каждой открываемой базы
+static void setupDatabase(MiniDBMS& db)
 {
-    out.clear();
-    char ch = 0;
-
-    while (true)
-    {
-        ssize_t n = ::recv(sock, &ch, 1, 0);
-
-        if (n < 0)
-        {
-            if (errno == EWOULDBLOCK || errno == EAGAIN)
-            {
-                std::cerr << "[Server] recv timeout\n";
-            }
-            else
-            {
-                std::perror("[Server] recv error");
-            }
-            return false;
-        }
-
-        if (n == 0)
-        {
-            // Клиент закрыл соединение
-            return false;
-        }
-
-        if (ch == '\n')
-        {
-            break;
-        }
-
-        out.push_back(ch);
-    }
-    return true;
+    db.setResultCacheBudget(g_resultCacheBytes);
+    db.setUringWrites(g_uringFileWrites);
 }
 
-
-// отправка всей строки
-static bool writeAll(int sock, const std::string& data)
-{
-    const char* buf = data.c_str();
-    size_t total = data.size();
-    size_t sent = 0;
-
-    while (sent < total)
-    {
-        ssize_t n = ::send(sock, buf + sent, total - sent, 0);
-
-        if (n < 0)
-        {
-            if (errno == EWOULDBLOCK || errno == EAGAIN)
-            {
-                std::cerr << "[Server] send timeout\n";
-            }
-            else
-            {
-                std::perror("[Server] send error");
-            }
-            return false;
-        }
-
-        if (n == 0)
-        {
-            // очень редкий случай, но на всякий:
-            std::cerr << "[Server] send returned 0\n";
-            return false;
-        }
-
-        sent += static_cast<size_t>(n);
-    }
-
-    return true;
-}
+// открытые базы: загрузка одной не останавливает запросы к остальным
+static DbRegistry g_databases(setupDatabase);
+// для stats и HTTP-метрик
+static const ServerState g_serverState{g_activeClients, g_refusedClients, g_databases};
+// журнал медленных запросов (nullptr - выключен)
+static SlowQueryLog* g_slowLog = nullptr;
+// запись входящих JSON-запросов для replay (nullptr - выключена)
+static RequestCapture* g_capture = nullptr;
 
 
 // вытащить строковое поле: "key":"value" для работы с клиентом
@@ -243,6 +178,20 @@ static bool extractJsonValueField(const string& json, const string& key, string&
     return false;
 }
 
+// логическое поле: "key":true
+static bool extractJsonBoolField(const string& json, const string& key)
+{
+    string pattern = "\"" + key + "\"";
+    size_t pos = json.find(pattern);
+    if (pos == string::npos)
+    {
+        return false;
+    }
+
+    size_t start = json.find_first_not_of(" \t\n\r:", pos + pattern.size());
+    return start != string::npos && json.compare(start, 4, "true") == 0;
+}
+
 // разбор JSON-строки запроса в Request
 static bool parseJsonRequest(const string& line, Request& req)
 {
@@ -269,6 +218,17 @@ static bool parseJsonRequest(const string& line, Request& req)
         req.query_json = query_value;
     }
 
+    req.explain = extractJsonBoolField(line, "explain");
+
+    // подготовленные запросы
+    extractJsonStringField(line, "command", req.command);
+    extractJsonStringField(line, "statement", req.statement);
+    string params_value;
+    if (extractJsonValueField(line, "params", params_value))
+    {
+        req.params_json = params_value;
+    }
+
     return true;
 }
 
@@ -337,6 +297,13 @@ static string serializeResponseToJson(const Response& resp)
         json += resp.data;
     }
 
+    // отчёт EXPLAIN
+    if (resp.has_stats)
+    {
+        json += ",\"explain\":";
+        json += statsToJson(resp.stats);
+    }
+
     json += "}";
     json += "\n";
 
@@ -344,189 +311,527 @@ static string serializeResponseToJson(const Response& resp)
 }
 
 
-static DbEntry* getOrCreateDbEntry(const string& dbName) // получение или создание записи базы
+static Response errorResponse(const string& message)
+{
+    Response resp;
+    resp.status  = "error";
+    resp.message = message;
+    resp.count   = 0;
+    resp.data    = "[]";
+    return resp;
+}
+
+// prepare: разбираем запрос один раз и запоминаем его для этого соединения
+static Response prepareStatement(const Request& req, ClientSession& session)
+{
+    if (req.command != "find" && req.command != "count" && req.command != "delete" && req.command != "update")
+    {
+        return errorResponse("prepare поддерживает find, count, delete, update");
+    }
+
+    DbHandle db = g_databases.get(req.database);
+    // только разбор запроса в кеш планов, данные не трогаем - блокировка не нужна
+    int paramCount = db->prepareQuery(req.query_json.empty() ? "{}" : req.query_json);
+
+    PreparedStatement* stmt = new PreparedStatement;
+    stmt->database   = req.database;
+    stmt->operation  = req.command;
+    stmt->query_json = req.query_json.empty() ? "{}" : req.query_json;
+    stmt->data_json  = req.data_json;
+    session.addStatement(stmt); // id и место в LRU соединения
+
+    string id = to_string(stmt->id);
+    Response resp;
+    resp.status  = "success";
+    resp.message = "Prepared statement " + id;
+    resp.count   = 0;
+    resp.data    = "[{\"statement\":\"" + id + "\",\"params\":\"" + to_string(paramCount) + "\"}]";
+    return resp;
+}
+
+// stats: счётчики и задержки сервера, база в запросе не нужна
+static Response statsResponse()
+{
+    Response resp;
+    resp.status  = "success";
+    resp.message = "Server stats";
+    resp.count   = 1;
+    resp.data    = "[" + statsToJson(g_serverState) + "]";
+    return resp;
+}
+
+// trace: command start / stop включает и выключает запись, без команды - выгрузка
+// событий в формате Chrome trace_event (JSON-массив в data)
+static Response traceResponse(const string& command)
+{
+    Response resp;
+    resp.status = "success";
+    resp.data   = "[]";
+    if (command == "start")
+    {
+        setTracing(true);
+        resp.message = "Tracing started";
+    }
+    else if (command == "stop")
+    {
+        setTracing(false);
+        resp.message = "Tracing stopped";
+    }
+    else if (command.empty() || command == "dump")
+    {
+        resp.data    = traceToChromeJson(&resp.count);
+        resp.message = "Trace events: " + to_string(resp.count);
+    }
+    else
+    {
+        return errorResponse("trace ожидает command start, stop или dump");
+    }
+    return resp;
+}
+
+// разбор и выполнение одной строки; op - под какую операцию записать задержку,
+// counters - счётчики выполнения для журнала медленных запросов (может быть nullptr)
+static Response executeRequestLine(ClientSession& session, const string& line, Request& req,
+                                   MetricHistogram& op, QueryStats* counters)
 {
-    lock_guard<mutex> lock(g_dbListMutex);
+    bool parsed;
+    {
+        TraceScope parse(TRACE_PARSE);
+        parsed = parseJsonRequest(line, req);
+    }
+    if (!parsed)
+    {
+        // Некорректный JSON-запрос 
+        return errorResponse("Invalid request JSON format");
+    }
+
+    if (req.operation == "stats")
+    {
+        op = OP_STATS;
+        return statsResponse();
+    }
+
+    if (req.operation == "trace")
+    {
+        op = OP_STATS;
+        return traceResponse(req.command);
+    }
+
+    if (req.operation == "prepare")
+    {
+        op = OP_PREPARE;
+        return prepareStatement(req, session);
+    }
 
-    // ищем уже существующую запись
-    DbEntry* current = g_dbList;
-    while (current != nullptr)
+    if (req.operation == "execute")
     {
-        if (current->name == dbName)
+        PreparedStatement* stmt = session.findStatement(req.statement);
+        if (stmt == nullptr)
         {
-            return current;
+            return errorResponse("Неизвестный statement: " + req.statement);
         }
-        current = current->next;
-    }
 
-    // не нашли - создаём новую базу
-    MiniDBMS* db = new MiniDBMS(dbName);
-    db->loadFromDisk();
+        // подставляем сохранённый запрос, параметры берём из execute
+        req.database   = stmt->database;
+        req.operation  = stmt->operation;
+        req.query_json = stmt->query_json;
+        req.data_json  = stmt->data_json;
+    }
 
-    DbEntry* entry = new DbEntry;
-    entry->name = dbName;
-    entry->db   = db;
-    entry->next = g_dbList; // вставляем в начало списка
+    op = histogramForOperation(req.operation);
 
-    g_dbList = entry;
+    // Получаем (или открываем) нужную базу
+    // ручка держит базу в памяти до конца запроса
+    long long lookup_start = tracingEnabled() ? metricsNowNs() : 0;
+    DbHandle db = g_databases.get(req.database);
+    if (lookup_start)
+        traceSpan(TRACE_DB_LOOKUP, lookup_start, metricsNowNs());
 
-    return entry;
+    // чтения идут по снимку, записи разных _id - параллельно: блокировки берёт сама БД
+    TraceScope execute(TRACE_EXECUTE);
+    return processRequest(req, *db, counters);
 }
 
-
-// обработка клиента
-static void handleClient(int clientSock)
+// обработка одной строки запроса (вызывается из пула воркеров)
+static string handleRequestLine(ClientSession& session, const string& line)
 {
-    string line; // буфер для чтения строк
+    long long start = metricsNowNs();
+    MetricHistogram op = OP_OTHER;
+    Request req;
+    QueryStats counters;
+    Response resp = executeRequestLine(session, line, req, op, g_slowLog ? &counters : nullptr);
+
+    // Сериализуем ответ в JSON
+    string json;
+    {
+        TraceScope serialize(TRACE_SERIALIZE_RESPONSE);
+        json = serializeResponseToJson(resp);
+    }
+
+    // счётчики своего потока - без общих блокировок
+    long long elapsed = metricsNowNs() - start;
+    recordLatency(op, elapsed);
+    if (tracingEnabled())
+        traceSpan(TRACE_REQUEST, start, start + elapsed, op);
+    addCounter(REQUESTS_JSON, 1);
+    addCounter(BYTES_IN, line.size() + 1);
+    addCounter(BYTES_OUT, json.size());
+    if (resp.status == "error")
+    {
+        addCounter(REQUEST_ERRORS, 1);
+    }
 
-    while (readLine(clientSock, line)) // читаем запросы построчно
+    if (g_slowLog)
     {
-        if (line.empty())
+        if (const char* kind = g_slowLog->classify(elapsed))
         {
-            continue;
+            SlowQueryEntry entry;
+            entry.duration_ns    = elapsed;
+            entry.database       = req.database;
+            entry.operation      = req.operation;
+            entry.query_json     = req.query_json;
+            entry.counters       = counters.access_path.empty() ? nullptr : &counters;
+            entry.docs_returned  = resp.count;
+            entry.response_bytes = json.size();
+            g_slowLog->record(kind, entry);
         }
+    }
 
-        Request req;
-        if (!parseJsonRequest(line, req))
+    if (g_capture)
+    {
+        // запросы одного соединения выполняются по очереди - номер назначается без гонок
+        if (session.capture_id == 0)
         {
-            // Некорректный JSON-запрос 
-            Response resp;
-            resp.status  = "error";
-            resp.message = "Invalid request JSON format";
-            resp.count   = 0;
-            resp.data    = "[]";
-
-            string out = serializeResponseToJson(resp);
-            (void)writeAll(clientSock, out);
-            continue;
+            session.capture_id = g_capture->newConnection();
         }
+        g_capture->record(session.capture_id, start, req.operation, line, resp.status, resp.count, json);
+    }
+    return json;
+}
+
+// операция кадра для гистограммы задержек
+static MetricHistogram histogramForOpcode(uint8_t opcode)
+{
+    switch (opcode)
+    {
+    case BIN_INSERT: return OP_INSERT;
+    case BIN_FIND:   return OP_FIND;
+    case BIN_COUNT:  return OP_COUNT;
+    case BIN_DELETE: return OP_DELETE;
+    case BIN_UPDATE: return OP_UPDATE;
+    default:         return OP_OTHER;
+    }
+}
 
-        // Получаем (или создаём) запись для нужной базы
-        DbEntry* entry = getOrCreateDbEntry(req.database);
+// один кадр бинарного протокола: база берётся из таблицы соединения,
+// без поиска по имени и без разбора JSON-обёртки
+static string executeBinaryFrame(ClientSession& session, string_view frame, QueryStats* counters)
+{
+    BinaryRequest req;
+    bool parsed;
+    {
+        TraceScope parse(TRACE_PARSE);
+        parsed = parseBinaryRequest(frame, req);
+    }
+    if (!parsed)
+    {
+        return makeBinaryResponse(BIN_ERROR, 0, "Короткий кадр");
+    }
 
-        Response resp;
+    if (req.opcode == BIN_OPEN)
+    {
+        string name(req.body);
+        if (name.empty())
         {
-            // Блокируем КОНКРЕТНУЮ БД на время операции
-            lock_guard<mutex> dbLock(entry->mtx);
-            resp = processRequest(req, *entry->db);
+            return makeBinaryResponse(BIN_ERROR, 0, "BIN_OPEN ожидает имя базы");
         }
 
-        // Сериализуем ответ в JSON и отправляем
-        string out = serializeResponseToJson(resp);
-        if (!writeAll(clientSock, out))
+        BinaryDatabase* entry = session.findDatabase(name);
+        if (entry == nullptr)
         {
-            // Ошибка отправки - выходим из цикла и закрываем сокет
-            break;
+            entry = new BinaryDatabase;
+            entry->id   = session.next_database_id++;
+            entry->name = name;
+            entry->db   = g_databases.lookup(name);
+            entry->next = session.binary_databases;
+            session.binary_databases = entry;
         }
+        g_databases.acquire(entry->db); // загружаем сразу: ошибку открытия увидит BIN_OPEN
+        return makeBinaryResponse(BIN_OK, entry->id, "Opened " + name);
     }
 
-    ::close(clientSock);
+    BinaryDatabase* entry = session.findDatabase(req.db_id);
+    if (entry == nullptr)
+    {
+        return makeBinaryResponse(BIN_ERROR, 0, "Неизвестный db_id: " + to_string(req.db_id));
+    }
+    // по записи реестра - без поиска по имени; выгруженная база загрузится заново
+    long long lookup_start = tracingEnabled() ? metricsNowNs() : 0;
+    DbHandle db = g_databases.acquire(entry->db);
+    if (lookup_start)
+        traceSpan(TRACE_DB_LOOKUP, lookup_start, metricsNowNs());
+    TraceScope execute(TRACE_EXECUTE);
+    return processBinaryRequest(req, *db, counters);
 }
 
-
-int main(int argc, char* argv[])
+// имя операции кадра для журнала медленных запросов
+static const char* binaryOperationName(uint8_t opcode)
 {
-    if (argc < 3) // порт и имя бд
+    switch (opcode)
     {
-        cerr << "Usage: " << argv[0]
-                  << " <port> <default_db_name>\n";
-        return 1;
+    case BIN_OPEN:   return "open";
+    case BIN_INSERT: return "insert";
+    case BIN_FIND:   return "find";
+    case BIN_COUNT:  return "count";
+    case BIN_DELETE: return "delete";
+    case BIN_UPDATE: return "update";
+    default:         return "unknown";
     }
+}
 
-    int port = stoi(argv[1]);
-    string defaultDbName = argv[2];
+// подробности кадра собираются только для строк, которые попадут в журнал
+static void logBinaryFrame(const char* kind, ClientSession& session, string_view frame,
+                           const string& response, long long elapsed, const QueryStats& counters)
+{
+    SlowQueryEntry entry;
+    entry.duration_ns    = elapsed;
+    entry.response_bytes = response.size();
+    entry.counters       = counters.access_path.empty() ? nullptr : &counters;
 
-    // заранее подгружаем дефолтную БД
+    BinaryRequest req;
+    if (parseBinaryRequest(frame, req))
     {
-        DbEntry* entry = getOrCreateDbEntry(defaultDbName);
-        (void)entry; // чтобы не было предупреждения
+        entry.operation = binaryOperationName(req.opcode);
+        if (req.opcode == BIN_OPEN)
+        {
+            entry.database = string(req.body);
+        }
+        else if (BinaryDatabase* db = session.findDatabase(req.db_id))
+        {
+            entry.database = db->name;
+        }
+
+        // у FIND/COUNT/DELETE/UPDATE тело начинается со строки-условия
+        string_view query;
+        BinaryReader body(req.body);
+        if (req.opcode != BIN_OPEN && req.opcode != BIN_INSERT && body.str(query))
+        {
+            entry.query_json = query.empty() ? string("{}") : string(query);
+        }
     }
 
-    int listenSock = ::socket(AF_INET, SOCK_STREAM, 0); // создаём слушающий сокет tcp
-    if (listenSock < 0) // ошибка
+    // ответ: длина, статус, count
+    uint64_t count = 0;
+    BinaryReader reply(string_view(response).substr(response.size() >= 5 ? 5 : response.size()));
+    if (reply.u64(count))
     {
-        perror("socket"); // вывод ошибки
-        return 1;
+        entry.docs_returned = static_cast<size_t>(count);
     }
+    g_slowLog->record(kind, entry);
+}
 
-    sockaddr_in addr{}; // заполняем адрес
-    addr.sin_family = AF_INET; // IPv4
-    addr.sin_addr.s_addr = INADDR_ANY; // слушаем на всех интерфейсах
-    addr.sin_port = htons(static_cast<uint16_t>(port)); // порт
-
-    if (::bind(listenSock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) // привязываем сокет к адресу
+static string handleBinaryFrame(ClientSession& session, string_view frame)
+{
+    long long start = metricsNowNs();
+    QueryStats counters;
+    string response = executeBinaryFrame(session, frame, g_slowLog ? &counters : nullptr);
+
+    // кадр без префикса длины: opcode - первый байт; в ответе статус идёт после длины
+    long long elapsed = metricsNowNs() - start;
+    MetricHistogram op = histogramForOpcode(frame.empty() ? 0 : static_cast<uint8_t>(frame[0]));
+    recordLatency(op, elapsed);
+    if (tracingEnabled())
+        traceSpan(TRACE_REQUEST, start, start + elapsed, op);
+    addCounter(REQUESTS_BINARY, 1);
+    addCounter(BYTES_IN, frame.size() + 4);
+    addCounter(BYTES_OUT, response.size());
+    if (response.size() > 4 && static_cast<uint8_t>(response[4]) == BIN_ERROR)
     {
-        perror("bind");
-        ::close(listenSock);
-        return 1;
+        addCounter(REQUEST_ERRORS, 1);
     }
 
-    if (::listen(listenSock, 16) < 0) // начинаем слушать сокет макс 16
+    if (g_slowLog)
     {
-        perror("listen");
-        ::close(listenSock);
-        return 1;
+        if (const char* kind = g_slowLog->classify(elapsed))
+        {
+            logBinaryFrame(kind, session, frame, response, elapsed, counters);
+        }
     }
+    return response;
+}
 
-    cout << "Server listening on port " << port << endl;
 
-    while (true) // ждем клиента 
+int main(int argc, char* argv[])
 {
-    sockaddr_in clientAddr{};
-    socklen_t clientLen = sizeof(clientAddr);
+    if (argc < 3) // порт и имя бд
+    {
+        cerr << "Usage: " << argv[0]
+                  << " <port> <default_db_name> [--result-cache-mb N] [--memory-budget-mb N] [--metrics-port N] [--workers N] [--max-connections N]"
+                  << " [--io epoll|uring] [--slow-query-ms N] [--slow-query-sample P] [--slow-query-log PATH]"
+                  << " [--slow-query-log-mb N] [--log-level debug|info|warn|error|off] [--trace] [--capture FILE]\n";
+        return 1;
+    }
 
-    int clientSock = ::accept(
-        listenSock,
-        reinterpret_cast<sockaddr*>(&clientAddr),
-        &clientLen
-    );
+    int port = stoi(argv[1]);
+    string defaultDbName = argv[2];
+    size_t workers = thread::hardware_concurrency();
+    size_t maxConnections = MAX_CLIENTS;
+    string ioBackend = "epoll";
+    int metricsPort = 0; // 0 - без HTTP-метрик
+    long long slowQueryMs = -1; // -1 - журнал медленных запросов выключен
+    double slowQuerySample = 0;
+    string slowQueryPath = "slow_query.log";
+    size_t slowQueryFileBytes = 64 * 1024 * 1024;
+    string capturePath; // пусто - без записи нагрузки
+
+    for (int i = 3; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg == "--result-cache-mb" && i + 1 < argc)
+        {
+            g_resultCacheBytes = static_cast<size_t>(stoul(argv[++i])) * 1024 * 1024;
+        }
+        else if (arg == "--memory-budget-mb" && i + 1 < argc)
+        {
+            // сверх бюджета давно не используемые базы выгружаются из памяти
+            g_databases.setMemoryBudget(static_cast<size_t>(stoul(argv[++i])) * 1024 * 1024);
+        }
+        else if (arg == "--metrics-port" && i + 1 < argc)
+        {
+            metricsPort = stoi(argv[++i]);
+        }
+        else if (arg == "--slow-query-ms" && i + 1 < argc)
+        {
+            slowQueryMs = stoll(argv[++i]);
+        }
+        else if (arg == "--slow-query-sample" && i + 1 < argc)
+        {
+            // доля обычных запросов, которые тоже попадут в журнал (0..1)
+            slowQuerySample = stod(argv[++i]);
+        }
+        else if (arg == "--slow-query-log" && i + 1 < argc)
+        {
+            slowQueryPath = argv[++i];
+        }
+        else if (arg == "--slow-query-log-mb" && i + 1 < argc)
+        {
+            slowQueryFileBytes = static_cast<size_t>(stoul(argv[++i])) * 1024 * 1024;
+        }
+        else if (arg == "--capture" && i + 1 < argc)
+        {
+            capturePath = argv[++i];
+        }
+        else if (arg == "--log-level" && i + 1 < argc)
+        {
+            LogLevel level;
+            if (!parseLogLevel(argv[++i], level))
+            {
+                cerr << "Unknown log level: " << argv[i] << " (debug, info, warn, error or off)\n";
+                return 1;
+            }
+            setLogLevel(level);
+        }
+        else if (arg == "--trace")
+        {
+            // трасса с самого старта; иначе - операцией trace start
+            setTracing(true);
+        }
+        else if (arg == "--workers" && i + 1 < argc)
+        {
+            workers = static_cast<size_t>(stoul(argv[++i]));
+        }
+        else if (arg == "--max-connections" && i + 1 < argc)
+        {
+            maxConnections = static_cast<size_t>(stoul(argv[++i]));
+        }
+        else if (arg == "--io" && i + 1 < argc)
+        {
+            ioBackend = argv[++i];
+            if (ioBackend != "epoll" && ioBackend != "uring")
+            {
+                cerr << "Unknown I/O backend: " << ioBackend << " (epoll or uring)\n";
+                return 1;
+            }
+        }
+        else
+        {
+            cerr << "Unknown argument: " << arg << "\n";
+            return 1;
+        }
+    }
+    if (workers == 0)
+    {
+        workers = 4;
+    }
 
-    if (clientSock < 0) // ошибка accept
+    if (ioBackend == "uring")
     {
-        perror("accept");
-        continue;
+        if (UringServer::supported())
+        {
+            g_uringFileWrites = true;
+        }
+        else
+        {
+            LOG_WARN("[Server] io_uring is not available, falling back to epoll");
+            ioBackend = "epoll";
+        }
     }
 
-    // проверяем, не превышен ли лимит активных клиентов
-    if (g_activeClients.load() >= MAX_CLIENTS)
+    if (slowQueryMs >= 0 || slowQuerySample > 0)
     {
-        std::cerr << "[Server] Too many clients (" << g_activeClients.load()
-                  << "), refusing new connection\n";
-        ::close(clientSock);
-        continue;
+        g_slowLog = new SlowQueryLog(slowQueryPath, slowQueryFileBytes,
+                                     slowQueryMs >= 0 ? slowQueryMs * 1000000 : -1, slowQuerySample);
+        if (!g_slowLog->open())
+        {
+            return 1;
+        }
+        LOG_INFO("Slow query log: " << slowQueryPath);
     }
 
-    // увеличиваем счетчик активных клиентов
-    g_activeClients++;
+    if (!capturePath.empty())
+    {
+        g_capture = new RequestCapture(capturePath);
+        if (!g_capture->open())
+        {
+            return 1;
+        }
+        LOG_INFO("Capturing requests to " << capturePath);
+    }
 
-    // настраиваем таймауты для избежания зависаний recv/send
-    struct timeval tv;
-    tv.tv_sec = 5;  // 5 секунд
-    tv.tv_usec = 0;
+    // заранее подгружаем дефолтную БД
+    g_databases.get(defaultDbName);
 
-    /*if (::setsockopt(clientSock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0)
+    if (metricsPort > 0)
     {
-        perror("setsockopt SO_RCVTIMEO");
+        if (!startMetricsListener(metricsPort, g_serverState))
+        {
+            return 1;
+        }
+        LOG_INFO("Metrics on http://127.0.0.1:" << metricsPort << "/metrics");
     }
-    if (::setsockopt(clientSock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) < 0)
-    {
-        perror("setsockopt SO_SNDTIMEO");
-    }*/
 
-    // запускаем поток, который по завершении уменьшит счетчик активных клиентов
-    std::thread t(
-        [](int sock)
+    // io_uring-реактор: меньше системных вызовов на запрос при множестве соединений
+    if (ioBackend == "uring")
+    {
+        UringServer server(handleRequestLine, handleBinaryFrame, workers, maxConnections, g_activeClients, g_refusedClients);
+        if (!server.listen(port))
         {
-            handleClient(sock);
-            g_activeClients--;
-        },
-        clientSock);
-
-    t.detach();
-}
+            return 1;
+        }
 
+        LOG_INFO("Server listening on port " << port << " (" << workers << " workers, io_uring)");
+        server.run();
+        return 0;
+    }
 
+    // epoll-реактор + фиксированный пул воркеров вместо потока на клиента
+    EpollServer server(handleRequestLine, handleBinaryFrame, workers, maxConnections, g_activeClients, g_refusedClients);
+    if (!server.listen(port))
+    {
+        return 1;
+    }
 
-    close(listenSock);// закрываем слушающий сокет
+    LOG_INFO("Server listening on port " << port << " (" << workers << " workers)");
+    server.run();
     return 0;
 }
@@ -1,12 +1,30 @@
 #include "document.h"
-#include <iostream>
+#include "binary_protocol.h"
+#include "logger.h"
+#include <stdexcept>
 
 using namespace std;
 
-Document::Document(string id) : _id(id)
+Document::Document(string id) : _id(id), begin_version(0), end_version(NO_VERSION), older(nullptr)
 { // _id = id
 }
 
+Document *Document::clone() const
+{
+    Document *copy = new Document(_id);
+    for (size_t i = 0; i < keys.getSize(); i++)
+    {
+        copy->keys.push(keys[i]);
+        copy->values.push(values[i]);
+    }
+    return copy;
+}
+
+size_t Document::memoryUsage() const
+{
+    return sizeof(Document) + stringHeapBytes(_id) + keys.memoryUsage() + values.memoryUsage();
+}
+
 void Document::addField(const string &key, const string &value) // добавление файла
 {
     for (size_t i = 0; i < keys.getSize(); i++)
@@ -33,6 +51,20 @@ bool Document::getField(const string &key, string &out) const // ищем зна
     return false;
 }
 
+bool Document::removeField(const string &key)
+{
+    for (size_t i = 0; i < keys.getSize(); i++)
+    {
+        if (keys[i] == key)
+        {
+            keys.erase(i);
+            values.erase(i);
+            return true;
+        }
+    }
+    return false;
+}
+
 string Document::serialize() const // создание json
 {
     string json = "{";
@@ -48,6 +80,50 @@ string Document::serialize() const // создание json
     return json;
 }
 
+void Document::serializeBinary(string &out) const
+{
+    size_t fields = 0;
+    for (size_t i = 0; i < keys.getSize(); i++)
+    {
+        if (keys[i] != "_id")
+            fields++;
+    }
+    if (fields > 0xffff)
+        throw length_error("Слишком много полей для бинарного документа");
+
+    putString(out, _id);
+    putU16(out, static_cast<uint16_t>(fields));
+    for (size_t i = 0; i < keys.getSize(); i++)
+    {
+        if (keys[i] == "_id")
+            continue;
+        putString(out, keys[i]);
+        putString(out, values[i]);
+    }
+}
+
+Document *Document::deserializeBinary(BinaryReader &reader)
+{
+    string_view id;
+    uint16_t fields = 0;
+    if (!reader.str(id) || !reader.u16(fields))
+        return nullptr;
+
+    Document *doc = new Document(string(id));
+    for (uint16_t i = 0; i < fields; i++)
+    {
+        string_view key, value;
+        if (!reader.str(key) || !reader.str(value))
+        {
+            delete doc;
+            return nullptr;
+        }
+        if (key != "_id") // _id задаётся только заголовком, как и в JSON - первым
+            doc->addField(string(key), string(value));
+    }
+    return doc;
+}
+
 Document *Document::deserialize(const std::string &json_line) // мини парсер
 {
     string s = trim(json_line); // очищаем строку
@@ -69,7 +145,7 @@ Document *Document::deserialize(const std::string &json_line) // мини пар
             break;
         if (s[i] != '"')
         {
-            cerr << "Ошибка корректности файла\n";
+            LOG_ERROR("Ошибка корректности файла");
             delete doc;
             return nullptr;
         }
@@ -78,7 +154,7 @@ Document *Document::deserialize(const std::string &json_line) // мини пар
         size_t key_end = s.find('"', key_start);
         if (key_end == string::npos)
         {
-            cerr << "Ошибка корректности файла\n";
+            LOG_ERROR("Ошибка корректности файла");
             delete doc;
             return nullptr;
         }
@@ -91,7 +167,7 @@ Document *Document::deserialize(const std::string &json_line) // мини пар
 
         if (i >= s.size() - 1 || s[i] != ':')
         {
-            cerr << "Ошибка корректности файла\n";
+            LOG_ERROR("Ошибка корректности файла");
             delete doc;
             return nullptr;
         }
@@ -108,7 +184,7 @@ Document *Document::deserialize(const std::string &json_line) // мини пар
             size_t val_end = s.find('"', val_start);
             if (val_end == string::npos)
             {
-                cerr << "Ошибка корректности файла\n";
+                LOG_ERROR("Ошибка корректности файла");
                 delete doc;
                 return nullptr;
             }
@@ -124,7 +200,7 @@ Document *Document::deserialize(const std::string &json_line) // мини пар
             size_t val_end = s.find_first_of(",}", val_start);
             if (val_end == string::npos)
             {
-                cerr << "Ошибка корректности файла\n";
+                LOG_ERROR("Ошибка корректности файла");
                 delete doc;
                 return nullptr;
             }
@@ -152,4 +228,81 @@ Document *Document::deserialize(const std::string &json_line) // мини пар
         return nullptr;
     }
     return doc;
-}
\ No newline at end of file
+}
+
+static bool isFieldGap(char c)
+{
+    return c == ' ' || c == '\t' || c == ',' || c == '\n' || c == '\r';
+}
+
+// поля объекта до его '}' включительно; false - битый объект
+static bool parseFields(const string &s, size_t &i, Document *doc)
+{
+    while (true)
+    {
+        while (i < s.size() && isFieldGap(s[i]))
+            ++i;
+        if (i >= s.size())
+            return false;
+        if (s[i] == '}')
+        {
+            ++i;
+            return true;
+        }
+        if (s[i] != '"')
+            return false;
+
+        size_t key_end = s.find('"', i + 1);
+        if (key_end == string::npos)
+            return false;
+        string key = s.substr(i + 1, key_end - i - 1);
+        i = key_end + 1;
+
+        while (i < s.size() && isFieldGap(s[i]))
+            ++i;
+        if (i >= s.size() || s[i] != ':')
+            return false;
+        ++i;
+        while (i < s.size() && isFieldGap(s[i]))
+            ++i;
+        if (i >= s.size())
+            return false;
+
+        string value;
+        if (s[i] == '"')
+        {
+            size_t val_end = s.find('"', i + 1);
+            if (val_end == string::npos)
+                return false;
+            value = s.substr(i + 1, val_end - i - 1);
+            i = val_end + 1;
+        }
+        else
+        {
+            size_t val_end = s.find_first_of(",}", i);
+            if (val_end == string::npos)
+                return false;
+            value = trim(s.substr(i, val_end - i));
+            i = val_end;
+        }
+
+        if (key != "_id")
+            doc->addField(key, value);
+    }
+}
+
+Document *Document::parseObject(const string &text, size_t &pos)
+{
+    if (pos >= text.size() || text[pos] != '{')
+        return nullptr;
+
+    Document *doc = new Document();
+    size_t i = pos + 1;
+    if (!parseFields(text, i, doc))
+    {
+        delete doc;
+        return nullptr;
+    }
+    pos = i;
+    return doc;
+}
@@ -1,13 +1,25 @@
 #pragma once
 
+#include <atomic>
 #include <string>
 #include "myarray.h"
 #include "utills.h"
 
+class BinaryReader;
+
+// версия "ещё не удалён" для end_version
+static const unsigned long long NO_VERSION = ~0ULL;
+
 class Document
 {
 public:
     std::string _id; // id документа
+
+    // MVCC: документ после публикации не меняется, изменение = новая версия.
+    // Версия видна снимку S, если begin_version <= S < end_version
+    unsigned long long begin_version;
+    std::atomic<unsigned long long> end_version;
+    std::atomic<Document *> older; // предыдущая версия того же _id
 private:
     myarray keys; // ключи(name, city)
     myarray values;
@@ -19,7 +31,19 @@ public:
 
     void addField(const std::string &key, const std::string &value); // добавление полей
     bool getField(const std::string &key, std::string &out) const;   // проверка ключа
+    bool removeField(const std::string &key);                        // удаление поля
+
+    Document *clone() const;       // копия полей для новой версии
+    std::size_t memoryUsage() const; // байт под объект и его поля (для учёта памяти базы)
 
     std::string serialize() const; // возвращаем файл строкой
     static Document *deserialize(const std::string &json_line);
+    // объект из большего текста (массив вставки) с позиции pos на '{': поля сразу в
+    // документ, без копии объекта; pos сдвигается за '}'. Разбор как у deserialize,
+    // "_id" из текста пропускается - его выдаёт база. nullptr - битый объект
+    static Document *parseObject(const std::string &text, std::size_t &pos);
+
+    // бинарный вид для binary_protocol.h: без экранирования и поиска кавычек
+    void serializeBinary(std::string &out) const;
+    static Document *deserializeBinary(BinaryReader &reader); // nullptr - битые данные
 };
\ No newline at end of file
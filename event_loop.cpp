@@ -0,0 +1,601 @@
+#include "event_loop.h"
+#include "binary_protocol.h"
+#include "logger.h"
+#include "trace.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+using namespace std;
+
+// метки для epoll_event.data.ptr, чтобы отличать служебные дескрипторы от соединений
+static char LISTEN_TAG;
+static char WAKE_TAG;
+
+// ответ вместо строки длиннее MAX_REQUEST_BYTES (формат как у serializeResponseToJson)
+static const char TOO_LARGE_RESPONSE[] =
+    "{\"status\":\"error\",\"message\":\"request too large\",\"count\":0,\"data\":[]}\n";
+
+Connection::Connection(int fd)
+    : fd(fd), protocol(PROTO_UNKNOWN), out_head(nullptr), out_tail(nullptr), out_sent(0), out_pending(0),
+      busy(false), peer_closed(false), broken(false), skipping(false), rejected(0),
+      registered(false), reading(false), writing(false), closed(false), done_next(nullptr) {}
+
+Connection::~Connection()
+{
+    while (out_head)
+    {
+        OutChunk *next = out_head->next;
+        delete out_head;
+        out_head = next;
+    }
+}
+
+// дописать готовые ответы [head..tail] в очередь соединения
+void Connection::enqueueOutput(OutChunk *head, OutChunk *tail, size_t bytes)
+{
+    if (out_tail)
+        out_tail->next = head;
+    else
+        out_head = head;
+    out_tail = tail;
+    out_pending += bytes;
+}
+
+int Connection::gatherOutput(iovec *iov, int max) const
+{
+    int count = 0;
+    size_t skip = out_sent;
+    for (OutChunk *chunk = out_head; chunk && count < max; chunk = chunk->next)
+    {
+        iov[count].iov_base = const_cast<char *>(chunk->data.data()) + skip;
+        iov[count].iov_len = chunk->data.size() - skip;
+        skip = 0;
+        ++count;
+    }
+    return count;
+}
+
+// отправленные ответы снимаем с очереди, последний мог уйти не целиком
+void Connection::consumeOutput(size_t sent)
+{
+    out_pending -= sent;
+    while (sent > 0)
+    {
+        size_t rest = out_head->data.size() - out_sent;
+        if (sent < rest)
+        {
+            out_sent += sent;
+            break;
+        }
+        sent -= rest;
+        OutChunk *done = out_head;
+        out_head = done->next;
+        out_sent = 0;
+        delete done;
+    }
+    if (!out_head)
+        out_tail = nullptr;
+}
+
+// первые байты соединения: BINARY_MAGIC - бинарные кадры (отвечаем тем же), иначе JSON-строки
+void Connection::checkInput()
+{
+    if (broken)
+        return;
+
+    checkSize();
+    // ошибки за выброшенные строки - строго после ответов на запросы перед ними,
+    // поэтому только когда воркер свободен (новых запросов он до этого не получит)
+    while (rejected > 0 && !busy)
+    {
+        OutChunk *error = new OutChunk{string(TOO_LARGE_RESPONSE, sizeof(TOO_LARGE_RESPONSE) - 1), nullptr};
+        enqueueOutput(error, error, error->data.size());
+        --rejected;
+    }
+
+    if (protocol == PROTO_UNKNOWN)
+    {
+        string_view head = in.peek();
+        if (head.empty())
+            return;
+
+        size_t n = head.size() < sizeof(BINARY_MAGIC) ? head.size() : sizeof(BINARY_MAGIC);
+        if (memcmp(head.data(), BINARY_MAGIC, n) != 0)
+        {
+            protocol = PROTO_TEXT;
+            return;
+        }
+        if (n < sizeof(BINARY_MAGIC))
+            return; // ждём остаток приветствия
+
+        in.consume(sizeof(BINARY_MAGIC));
+        protocol = PROTO_BINARY;
+        OutChunk *ack = new OutChunk{string(BINARY_MAGIC, sizeof(BINARY_MAGIC)), nullptr};
+        enqueueOutput(ack, ack, ack->data.size());
+    }
+
+    size_t frame_size = 0;
+    if (protocol == PROTO_BINARY && in.peekFrameSize(frame_size) && frame_size > MAX_REQUEST_BYTES)
+    {
+        LOG_WARN("[Server] frame too large, closing connection");
+        broken = true;
+    }
+}
+
+// строка длиннее MAX_REQUEST_BYTES не буферизуется: всё до её '\n' выбрасываем,
+// клиент получает ошибку, соединение остаётся рабочим
+void Connection::checkSize()
+{
+    // бинарные кадры длиннее лимита отсекает checkInput по объявленной длине
+    if (!skipping && protocol != PROTO_BINARY && in.buffered() > MAX_REQUEST_BYTES && !hasRequest())
+    {
+        LOG_WARN("[Server] request too large, skipping it");
+        skipping = true;
+        ++rejected;
+    }
+
+    if (skipping)
+    {
+        string_view head = in.peek();
+        if (head.empty())
+            return;
+        const void *nl = memchr(head.data(), '\n', head.size());
+        if (!nl)
+        {
+            in.consume(head.size());
+            return;
+        }
+        in.consume(static_cast<size_t>(static_cast<const char *>(nl) - head.data()) + 1);
+        skipping = false;
+    }
+}
+
+bool Connection::hasRequest()
+{
+    if (protocol == PROTO_BINARY)
+        return in.hasFrame();
+    return protocol == PROTO_TEXT && in.hasLine();
+}
+
+// входное обратное давление - только на полные запросы: неполную строку дочитываем,
+// иначе запрос больше MAX_PENDING_INPUT не пришёл бы никогда
+bool Connection::wantsInput()
+{
+    if (peer_closed || out_pending >= MAX_PENDING_OUTPUT)
+        return false;
+    return in.buffered() < MAX_PENDING_INPUT || !hasRequest();
+}
+
+// выполняем все полные запросы, накопленные в буфере, по порядку
+// (клиент может слать запросы конвейером, не дожидаясь ответов)
+size_t Connection::runBatch(LineHandler handler, FrameHandler frame_handler, OutChunk *&head, OutChunk *&tail)
+{
+    bool binary = false;
+    {
+        lock_guard<mutex> lock(mtx);
+        binary = protocol == PROTO_BINARY;
+        if (binary)
+            in.detachFrames(batch);
+        else
+            in.detachLines(batch);
+    }
+
+    head = nullptr;
+    tail = nullptr;
+    size_t bytes = 0;
+    string_view request;
+    while (binary ? batch.nextFrame(request) : batch.nextLine(request))
+    {
+        if (!binary && request.empty())
+            continue;
+
+        string response = binary ? frame_handler(session, request)
+                                 : handler(session, string(request));
+        if (!response.empty())
+        {
+            OutChunk *chunk = new OutChunk{std::move(response), nullptr};
+            bytes += chunk->data.size();
+            if (tail)
+                tail->next = chunk;
+            else
+                head = chunk;
+            tail = chunk;
+        }
+    }
+    return bytes;
+}
+
+EpollServer::EpollServer(LineHandler handler, FrameHandler frame_handler, size_t workers, size_t max_connections,
+                         atomic<int> &active_connections, atomic<long long> &refused_connections)
+    : handler(handler), frame_handler(frame_handler), pool(workers), max_connections(max_connections),
+      listen_fd(-1), epoll_fd(-1), wake_fd(-1), done_head(nullptr), closed_head(nullptr),
+      active_connections(active_connections), refused_connections(refused_connections) {}
+
+EpollServer::~EpollServer()
+{
+    free_closed();
+    if (listen_fd >= 0)
+        ::close(listen_fd);
+    if (wake_fd >= 0)
+        ::close(wake_fd);
+    if (epoll_fd >= 0)
+        ::close(epoll_fd);
+}
+
+bool EpollServer::listen(int port)
+{
+    listen_fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0); // слушающий сокет tcp
+    if (listen_fd < 0)
+    {
+        LOG_ERROR("socket: " << strerror(errno));
+        return false;
+    }
+
+    int reuse = 1;
+    ::setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;                          // IPv4
+    addr.sin_addr.s_addr = INADDR_ANY;                  // слушаем на всех интерфейсах
+    addr.sin_port = htons(static_cast<uint16_t>(port)); // порт
+
+    if (::bind(listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0)
+    {
+        LOG_ERROR("bind: " << strerror(errno));
+        return false;
+    }
+
+    if (::listen(listen_fd, SOMAXCONN) < 0)
+    {
+        LOG_ERROR("listen: " << strerror(errno));
+        return false;
+    }
+
+    epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+    wake_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll_fd < 0 || wake_fd < 0)
+    {
+        LOG_ERROR("epoll/eventfd: " << strerror(errno));
+        return false;
+    }
+
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.ptr = &LISTEN_TAG;
+    ::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev);
+
+    ev.events = EPOLLIN;
+    ev.data.ptr = &WAKE_TAG;
+    ::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev);
+    return true;
+}
+
+void EpollServer::run()
+{
+    const int MAX_EVENTS = 256;
+    epoll_event events[MAX_EVENTS];
+    traceThreadName("epoll loop");
+
+    while (true)
+    {
+        int n = ::epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            LOG_ERROR("epoll_wait: " << strerror(errno));
+            return;
+        }
+
+        for (int i = 0; i < n; ++i)
+        {
+            void *tag = events[i].data.ptr;
+            if (tag == &LISTEN_TAG)
+            {
+                accept_all();
+                continue;
+            }
+            if (tag == &WAKE_TAG)
+            {
+                drain_done_queue();
+                continue;
+            }
+
+            Connection *conn = static_cast<Connection *>(tag);
+            if (conn->closed)
+                continue; // закрыто раньше в этой же пачке
+            uint32_t ev = events[i].events;
+            if (ev & (EPOLLERR | EPOLLHUP))
+            {
+                lock_guard<mutex> lock(conn->mtx);
+                conn->broken = true;
+            }
+            else
+            {
+                if (ev & EPOLLIN)
+                    on_readable(conn);
+                if (ev & EPOLLOUT)
+                    on_writable(conn);
+            }
+            after_io(conn);
+        }
+        free_closed();
+    }
+}
+
+void EpollServer::accept_all()
+{
+    while (true)
+    {
+        sockaddr_in clientAddr{};
+        socklen_t clientLen = sizeof(clientAddr);
+        int fd = ::accept4(listen_fd, reinterpret_cast<sockaddr *>(&clientAddr), &clientLen,
+                           SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return;
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            LOG_ERROR("accept: " << strerror(errno));
+            return;
+        }
+
+        // проверяем, не превышен ли лимит активных клиентов
+        if (static_cast<size_t>(active_connections.load()) >= max_connections)
+        {
+            refused_connections++;
+            LOG_WARN("[Server] Too many clients (" << active_connections.load()
+                     << "), refusing new connection");
+            ::close(fd);
+            continue;
+        }
+
+        int one = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        Connection *conn = new Connection(fd);
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.ptr = conn;
+        if (::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0)
+        {
+            LOG_ERROR("epoll_ctl: " << strerror(errno));
+            ::close(fd);
+            delete conn;
+            continue;
+        }
+        conn->registered = true;
+        conn->reading = true;
+        active_connections++;
+    }
+}
+
+void EpollServer::on_readable(Connection *conn)
+{
+    // recv() идёт прямо в буфер соединения, поэтому под его мьютексом
+    lock_guard<mutex> lock(conn->mtx);
+    TraceScope span(TRACE_SOCKET_READ);
+    size_t received = 0;
+    while (true)
+    {
+        ssize_t n = conn->in.fill(conn->fd);
+        if (n > 0)
+        {
+            received += static_cast<size_t>(n);
+            span.setValue(received);
+            conn->checkSize();
+            if (conn->in.freeSpace() > 0 || !conn->wantsInput())
+                return; // сокет вычитан или запросов уже достаточно
+            continue;
+        }
+
+        if (n == 0)
+        {
+            conn->peer_closed = true; // клиент закрыл соединение, допишем ответы
+            return;
+        }
+        if (errno == EINTR)
+            continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            LOG_WARN("[Server] recv error: " << strerror(errno));
+            conn->broken = true;
+        }
+        return;
+    }
+}
+
+void EpollServer::on_writable(Connection *conn)
+{
+    lock_guard<mutex> lock(conn->mtx);
+    if (!flush(conn))
+        conn->broken = true;
+}
+
+// отправляем сколько примет сокет: вся очередь ответов одним sendmsg() без склейки;
+// остаток уйдёт по EPOLLOUT
+bool EpollServer::flush(Connection *conn)
+{
+    if (!conn->out_head)
+        return true;
+
+    TraceScope span(TRACE_SOCKET_WRITE);
+    size_t sent = 0;
+    while (conn->out_head)
+    {
+        iovec iov[MAX_IOV];
+        msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = static_cast<size_t>(conn->gatherOutput(iov, MAX_IOV));
+        ssize_t n = ::sendmsg(conn->fd, &msg, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return true;
+            LOG_WARN("[Server] send error: " << strerror(errno));
+            return false;
+        }
+        conn->consumeOutput(static_cast<size_t>(n));
+        sent += static_cast<size_t>(n);
+        span.setValue(sent);
+    }
+    return true;
+}
+
+// общий шаг после любого события: отправить ответы, отдать запросы воркеру, закрыть
+void EpollServer::after_io(Connection *conn)
+{
+    bool close_now = false;
+    {
+        lock_guard<mutex> lock(conn->mtx);
+
+        if (!conn->broken && !flush(conn))
+            conn->broken = true;
+
+        conn->checkInput();
+
+        if (conn->broken)
+        {
+            if (conn->registered)
+            {
+                // убираем из epoll сразу, иначе EPOLLHUP будет приходить, пока воркер занят
+                ::epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, nullptr);
+                conn->registered = false;
+                conn->reading = false;
+                conn->writing = false;
+            }
+            close_now = !conn->busy; // иначе закроем, когда воркер вернёт соединение
+        }
+        else
+        {
+            bool has_request = conn->hasRequest();
+            if (!conn->busy && has_request)
+            {
+                conn->busy = true;
+                pool.submit([this, conn]
+                            { process(conn); });
+            }
+
+            bool output_pending = conn->out_pending > 0;
+            if (!conn->busy && conn->peer_closed && !has_request && !output_pending)
+            {
+                close_now = true;
+            }
+            else
+            {
+                update_interest(conn);
+            }
+        }
+    }
+
+    if (close_now)
+        destroy(conn);
+}
+
+void EpollServer::update_interest(Connection *conn)
+{
+    bool want_read = conn->wantsInput();
+    bool want_write = conn->out_pending > 0;
+
+    if (want_read == conn->reading && want_write == conn->writing)
+        return;
+
+    epoll_event ev{};
+    ev.events = (want_read ? static_cast<uint32_t>(EPOLLIN) : 0u) | (want_write ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+    ev.data.ptr = conn;
+    ::epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev);
+    conn->reading = want_read;
+    conn->writing = want_write;
+}
+
+// поток пула
+void EpollServer::process(Connection *conn)
+{
+    OutChunk *head = nullptr;
+    OutChunk *tail = nullptr;
+    size_t bytes = conn->runBatch(handler, frame_handler, head, tail);
+
+    // ответы всей пачки отправляем сразу отсюда, не дожидаясь реактора;
+    // что не влезло в сокет, допишет реактор по EPOLLOUT
+    if (head)
+    {
+        lock_guard<mutex> lock(conn->mtx);
+        conn->enqueueOutput(head, tail, bytes);
+        if (!conn->broken && !flush(conn))
+            conn->broken = true;
+    }
+
+    // busy снимает реактор, когда заберёт соединение из очереди
+    {
+        lock_guard<mutex> lock(done_mtx);
+        conn->done_next = done_head;
+        done_head = conn;
+    }
+    uint64_t one = 1;
+    ssize_t written = ::write(wake_fd, &one, sizeof(one));
+    (void)written;
+}
+
+void EpollServer::drain_done_queue()
+{
+    uint64_t counter = 0;
+    ssize_t got = ::read(wake_fd, &counter, sizeof(counter));
+    (void)got;
+
+    Connection *list = nullptr;
+    {
+        lock_guard<mutex> lock(done_mtx);
+        list = done_head;
+        done_head = nullptr;
+    }
+
+    while (list)
+    {
+        Connection *conn = list;
+        list = list->done_next;
+        conn->done_next = nullptr;
+        {
+            lock_guard<mutex> lock(conn->mtx);
+            conn->busy = false;
+        }
+        after_io(conn);
+    }
+}
+
+// сокет закрываем сразу, а объект - только после всей пачки: в events[] ещё могут
+// быть события этого соединения с указателем на него
+void EpollServer::destroy(Connection *conn)
+{
+    if (conn->registered)
+        ::epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, nullptr);
+    ::close(conn->fd);
+    conn->closed = true;
+    conn->done_next = closed_head;
+    closed_head = conn;
+    active_connections--;
+}
+
+void EpollServer::free_closed()
+{
+    while (closed_head)
+    {
+        Connection *conn = closed_head;
+        closed_head = conn->done_next;
+        delete conn;
+    }
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <sys/uio.h>
+
+#include "line_reader.h"
+#include "session.h"
+#include "worker_pool.h"
+
+// пока ответы не ушли клиенту, новые запросы не читаем (обратное давление)
+static const size_t MAX_PENDING_OUTPUT = 8 * 1024 * 1024;
+// сколько непрочитанных полных запросов держим в буфере, пока воркер занят
+// (неполную строку дочитываем всегда - до MAX_REQUEST_BYTES)
+static const size_t MAX_PENDING_INPUT = 8 * 1024 * 1024;
+// одна строка запроса не может быть больше (bulk insert): длиннее - ответ с ошибкой
+static const size_t MAX_REQUEST_BYTES = 256 * 1024 * 1024;
+// сколько ответов отдаём ядру за один sendmsg()
+static const int MAX_IOV = 256;
+
+// обработчик одной строки запроса, возвращает строку ответа (с '\n')
+typedef std::string (*LineHandler)(ClientSession &session, const std::string &line);
+// обработчик бинарного кадра (тело без длины), возвращает кадр ответа целиком
+typedef std::string (*FrameHandler)(ClientSession &session, std::string_view frame);
+
+// готовый ответ в очереди на отправку: ответы не склеиваются в один буфер,
+// а уходят одним sendmsg() со списком кусков
+struct OutChunk
+{
+    std::string data;
+    OutChunk *next;
+};
+
+// одно клиентское соединение: сокет + буферы (общее для epoll- и io_uring-реактора)
+struct Connection
+{
+    int fd;
+
+    // JSON-строки или бинарные кадры: решается по первым байтам соединения
+    enum Protocol
+    {
+        PROTO_UNKNOWN,
+        PROTO_TEXT,
+        PROTO_BINARY
+    };
+
+    std::mutex mtx;       // защищает буферы и флаги ниже (реактор <-> воркер)
+    Protocol protocol;
+    LineReader in;        // прочитано из сокета, ещё не обработано
+    OutChunk *out_head;   // готовые ответы, ещё не отправленные (FIFO)
+    OutChunk *out_tail;
+    size_t out_sent;      // сколько байт out_head уже ушло
+    size_t out_pending;   // всего неотправленных байт в очереди
+    bool busy;            // запросы соединения сейчас выполняет воркер
+    bool peer_closed;     // клиент закрыл свою сторону
+    bool broken;          // ошибка сокета - соединение надо закрыть
+    bool skipping;        // выбрасываем хвост слишком длинной строки до '\n'
+    size_t rejected;      // ответов "request too large", ещё не поставленных в очередь
+
+    // состояние подписки epoll (трогает только поток реактора)
+    bool registered;
+    bool reading;
+    bool writing;
+    bool closed; // сокет закрыт, удаление - после текущей пачки событий epoll
+
+    LineReader batch;      // строки, отданные воркеру (трогает только воркер, пока busy)
+    ClientSession session; // prepared statements и т.п.
+    Connection *done_next; // очередь "воркер закончил" для реактора / список закрытых
+
+    explicit Connection(int fd);
+    ~Connection();
+    Connection(const Connection &) = delete;
+    Connection &operator=(const Connection &) = delete;
+
+    // дальше - под mtx
+    void enqueueOutput(OutChunk *head, OutChunk *tail, size_t bytes); // дописать ответы [head..tail]
+    int gatherOutput(iovec *iov, int max) const; // неотправленные ответы для sendmsg()
+    void consumeOutput(size_t sent);             // снять отправленное с очереди
+    void checkInput();   // согласование протокола и лимит размера кадра (может выставить broken)
+    void checkSize();    // после чтения: строку длиннее MAX_REQUEST_BYTES выбросить с ответом-ошибкой
+    bool hasRequest();   // в буфере есть полный запрос
+    bool wantsInput();   // читать дальше или ждать, пока уйдут ответы / освободится воркер
+
+    // поток пула, без mtx: выполнить все запросы из batch, ответы - списком [head..tail]
+    size_t runBatch(LineHandler handler, FrameHandler frame_handler, OutChunk *&head, OutChunk *&tail);
+};
+
+// однопоточный epoll-реактор: принимает соединения и читает/пишет сокеты,
+// а сами запросы выполняет фиксированный пул воркеров
+class EpollServer
+{
+private:
+    LineHandler handler;
+    FrameHandler frame_handler;
+    WorkerPool pool;
+    size_t max_connections;
+
+    int listen_fd;
+    int epoll_fd;
+    int wake_fd; // eventfd: воркер сообщает реактору о готовых ответах
+
+    std::mutex done_mtx;
+    Connection *done_head; // соединения, обработанные воркерами
+    Connection *closed_head; // закрытые в текущей пачке событий (только поток реактора)
+
+    std::atomic<int> &active_connections;
+    std::atomic<long long> &refused_connections;
+
+    void accept_all();
+    void on_readable(Connection *conn);
+    void on_writable(Connection *conn);
+    void drain_done_queue();
+
+    void process(Connection *conn); // выполняется в потоке пула
+    bool flush(Connection *conn);   // false - ошибка записи
+    void after_io(Connection *conn);
+    void update_interest(Connection *conn);
+    void destroy(Connection *conn);
+    void free_closed();
+
+public:
+    EpollServer(LineHandler handler, FrameHandler frame_handler, size_t workers, size_t max_connections,
+                std::atomic<int> &active_connections, std::atomic<long long> &refused_connections);
+    ~EpollServer();
+    EpollServer(const EpollServer &) = delete;
+    EpollServer &operator=(const EpollServer &) = delete;
+
+    bool listen(int port);
+    void run(); // цикл реактора, не возвращается
+};
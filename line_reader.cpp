@@ -0,0 +1,221 @@
+#include "line_reader.h"
+
+#include <sys/socket.h>
+#include <cstring>
+#include <utility>
+
+using namespace std;
+
+// меньше этого свободного места recv() не делаем - сначала сдвигаем или растим буфер
+static const size_t MIN_READ_CHUNK = 16 * 1024;
+
+LineReader::LineReader(size_t initial_capacity)
+    : buf(nullptr), capacity(0),
+      initial_capacity(initial_capacity < MIN_READ_CHUNK ? MIN_READ_CHUNK : initial_capacity),
+      start(0), end(0), scanned(0)
+{
+}
+
+LineReader::~LineReader()
+{
+    delete[] buf;
+}
+
+void LineReader::make_room(size_t min_free)
+{
+    if (capacity - end >= min_free)
+        return;
+
+    size_t used = end - start;
+    if (start > 0 && capacity - used >= min_free)
+    {
+        // сдвигаем хвост в начало вместо роста
+        memmove(buf, buf + start, used);
+    }
+    else
+    {
+        size_t new_capacity = capacity == 0 ? initial_capacity : capacity * 2;
+        while (new_capacity - used < min_free)
+            new_capacity *= 2;
+        char *new_buf = new char[new_capacity];
+        if (used > 0)
+            memcpy(new_buf, buf + start, used);
+        delete[] buf;
+        buf = new_buf;
+        capacity = new_capacity;
+    }
+    scanned -= start;
+    end = used;
+    start = 0;
+}
+
+ssize_t LineReader::fill(int fd, int flags)
+{
+    make_room(MIN_READ_CHUNK);
+    ssize_t n = ::recv(fd, buf + end, capacity - end, flags);
+    if (n > 0)
+        end += static_cast<size_t>(n);
+    return n;
+}
+
+void LineReader::append(const char *data, size_t size)
+{
+    make_room(size);
+    memcpy(buf + end, data, size);
+    end += size;
+}
+
+bool LineReader::hasLine()
+{
+    if (scanned >= end)
+        return false;
+    const void *nl = memchr(buf + scanned, '\n', end - scanned);
+    if (!nl)
+    {
+        scanned = end;
+        return false;
+    }
+    scanned = static_cast<size_t>(static_cast<const char *>(nl) - buf);
+    return true;
+}
+
+bool LineReader::nextLine(string_view &line)
+{
+    if (!hasLine())
+        return false;
+
+    // hasLine() оставил scanned на позиции '\n'
+    line = string_view(buf + start, scanned - start);
+    start = scanned + 1;
+    scanned = start;
+    if (start == end)
+    {
+        start = 0; // буфер пуст - следующие данные снова с начала
+        end = 0;
+        scanned = 0;
+    }
+    return true;
+}
+
+size_t LineReader::detachLines(LineReader &batch)
+{
+    if (start == end)
+        return 0;
+    const void *last = memrchr(buf + start, '\n', end - start);
+    if (!last)
+    {
+        scanned = end;
+        return 0;
+    }
+    return detach_until(static_cast<size_t>(static_cast<const char *>(last) - buf) + 1, batch);
+}
+
+// всё до cut уходит в пустой batch вместе с буфером, хвост копируется в новый
+size_t LineReader::detach_until(size_t cut, LineReader &batch)
+{
+    // batch пуст - его буфер становится нашим, наш со строками уходит ему
+    swap(buf, batch.buf);
+    swap(capacity, batch.capacity);
+    batch.start = start;
+    batch.end = cut;
+    batch.scanned = start;
+
+    size_t tail = end - batch.end;
+    start = 0;
+    end = 0;
+    scanned = 0;
+    if (tail > 0)
+    {
+        make_room(tail);
+        memcpy(buf, batch.buf + batch.end, tail);
+    }
+    end = tail;
+    return batch.end - batch.start;
+}
+
+bool LineReader::peekFrameSize(size_t &size) const
+{
+    if (end - start < 4)
+        return false;
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(buf + start);
+    size = static_cast<size_t>(p[0]) | static_cast<size_t>(p[1]) << 8 |
+           static_cast<size_t>(p[2]) << 16 | static_cast<size_t>(p[3]) << 24;
+    return true;
+}
+
+bool LineReader::frame_at(size_t pos, size_t &frame_end) const
+{
+    if (end - pos < 4)
+        return false;
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(buf + pos);
+    size_t size = static_cast<size_t>(p[0]) | static_cast<size_t>(p[1]) << 8 |
+                  static_cast<size_t>(p[2]) << 16 | static_cast<size_t>(p[3]) << 24;
+    if (end - pos - 4 < size)
+        return false;
+    frame_end = pos + 4 + size;
+    return true;
+}
+
+bool LineReader::hasFrame() const
+{
+    size_t frame_end = 0;
+    return frame_at(start, frame_end);
+}
+
+bool LineReader::nextFrame(string_view &frame)
+{
+    size_t frame_end = 0;
+    if (!frame_at(start, frame_end))
+        return false;
+
+    frame = string_view(buf + start + 4, frame_end - start - 4);
+    start = frame_end;
+    scanned = start;
+    if (start == end)
+    {
+        start = 0;
+        end = 0;
+        scanned = 0;
+    }
+    return true;
+}
+
+size_t LineReader::detachFrames(LineReader &batch)
+{
+    // кадры идут подряд: шагаем по длинам до последнего полного
+    size_t cut = start;
+    size_t frame_end = 0;
+    while (frame_at(cut, frame_end))
+        cut = frame_end;
+    if (cut == start)
+        return 0;
+    return detach_until(cut, batch);
+}
+
+string_view LineReader::peek() const
+{
+    return string_view(buf + start, end - start);
+}
+
+void LineReader::consume(size_t n)
+{
+    start += n < end - start ? n : end - start;
+    if (scanned < start)
+        scanned = start;
+    if (start == end)
+    {
+        start = 0;
+        end = 0;
+        scanned = 0;
+    }
+}
+
+size_t LineReader::buffered() const
+{
+    return end - start;
+}
+
+size_t LineReader::freeSpace() const
+{
+    return capacity - end;
+}
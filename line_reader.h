@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+#include <sys/types.h>
+
+// буферизованное чтение строк из сокета: recv() большими кусками прямо в буфер,
+// поиск '\n' через memchr, строки отдаются как string_view без копирования.
+// Тот же буфер читает и бинарные кадры: [u32 длина тела, little-endian][тело]
+class LineReader
+{
+private:
+    char *buf;
+    size_t capacity;
+    size_t initial_capacity; // буфер выделяется при первом fill() - простаивающие соединения памяти не держат
+    size_t start;   // начало непрочитанных данных
+    size_t end;     // конец данных
+    size_t scanned; // до этой позиции '\n' уже искали - повторно не сканируем
+
+    void make_room(size_t min_free);
+    size_t detach_until(size_t cut, LineReader &batch);
+    bool frame_at(size_t pos, size_t &frame_end) const; // полный кадр с позиции pos
+
+public:
+    explicit LineReader(size_t initial_capacity = 64 * 1024);
+    ~LineReader();
+    LineReader(const LineReader &) = delete;
+    LineReader &operator=(const LineReader &) = delete;
+
+    // один recv() в свободное место буфера, результат как у recv()
+    ssize_t fill(int fd, int flags = 0);
+    // данные, прочитанные не нами (io_uring кладёт их в свои буферы)
+    void append(const char *data, size_t size);
+
+    // следующая полная строка без '\n'; view живёт до следующего fill()
+    bool nextLine(std::string_view &line);
+    bool hasLine();
+
+    // забрать все полные строки в пустой batch (буферы меняются местами, копируется
+    // только хвост неполной строки); возвращает число переданных байт
+    size_t detachLines(LineReader &batch);
+
+    // то же для бинарных кадров; frame - тело без длины
+    bool nextFrame(std::string_view &frame);
+    bool hasFrame() const;
+    size_t detachFrames(LineReader &batch);
+    // объявленная длина тела первого кадра (false - не пришли даже 4 байта длины)
+    bool peekFrameSize(size_t &size) const;
+
+    // первые байты без разбора (согласование протокола) и пропуск n байт
+    std::string_view peek() const;
+    void consume(size_t n);
+
+    size_t buffered() const;  // байт в буфере (включая неполную строку)
+    size_t freeSpace() const; // сколько ещё влезло бы в буфер без сдвига и роста
+};
@@ -1,39 +1,331 @@
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <mutex>
 #include <string>
 
+#include "logger.h"
+#include "metrics.h"
 #include "minidbms.h"
 #include "protocol.h"
 #include "request_handler.h"
+#include "utills.h"
+#include "worker_pool.h"
 
-int main()
+// запрос из операции и остатка строки (общий для диалога и пакетного режима)
+static Request makeRequest(const std::string& op, const std::string& json, bool explain)
 {
+    Request req;
+    req.database   = "mydb";
+    req.operation  = op;
+    req.query_json = json;
+    req.explain    = explain;
+
+    if (op == "update") { // update {условие} {модификаторы}
+        std::size_t queryEnd = (!json.empty() && json[0] == '{') ? findMatchingBracket(json, 0) : std::string::npos;
+        if (queryEnd != std::string::npos) {
+            req.query_json = json.substr(0, queryEnd + 1);
+            req.data_json  = json.substr(queryEnd + 1);
+        }
+    }
+    return req;
+}
+
+static void printResponse(const Response& resp)
+{
+    std::cout << "[" << resp.status << "] " << resp.message << "\n";
+    if (!resp.data.empty()) {
+        std::cout << resp.data << "\n";
+    }
+    if (resp.has_stats) {
+        std::cout << "explain: " << statsToJson(resp.stats) << "\n";
+    }
+}
+
+// одна строка сценария пакетного режима
+struct Statement {
+    std::size_t line;   // номер строки в файле
+    Request req;
+    bool checkpoint;    // "checkpoint" - записать файл базы сейчас
+    bool read_only;     // find/count: можно выполнять параллельно с соседними чтениями
+    Response resp;
+    long long ns;       // время выполнения
+};
+
+struct BatchOptions {
+    std::string script;
+    std::size_t parallel = 1;         // потоков для подряд идущих чтений
+    std::size_t checkpoint_every = 0; // записывать файл после каждых N изменений, 0 - только в конце
+    bool quiet = false;               // без ответов, только ошибки и отчёт
+};
+
+// разбор сценария: строки как в диалоге ("find {...}", "explain find {...}"),
+// пустые строки и '#' пропускаются, exit/quit - конец сценария
+static bool loadScript(const std::string& path, Statement*& statements, std::size_t& count)
+{
+    std::ifstream in(path);
+    if (!in) {
+        std::perror(path.c_str());
+        return false;
+    }
+
+    std::size_t capacity = 1024;
+    statements = new Statement[capacity];
+    count = 0;
+
+    std::string line;
+    std::size_t lineNo = 0;
+    while (std::getline(in, line)) {
+        ++lineNo;
+        std::string text = trim(line);
+        if (text.empty() || text[0] == '#') {
+            continue;
+        }
+
+        std::size_t opEnd = text.find(' ');
+        std::string op = text.substr(0, opEnd);
+        std::string rest = opEnd == std::string::npos ? std::string() : trim(text.substr(opEnd + 1));
+        if (op == "exit" || op == "quit") {
+            break;
+        }
+        bool explain = false;
+        if (op == "explain") {
+            explain = true;
+            opEnd = rest.find(' ');
+            op = rest.substr(0, opEnd);
+            rest = opEnd == std::string::npos ? std::string() : trim(rest.substr(opEnd + 1));
+        }
+
+        if (count == capacity) {
+            Statement* grown = new Statement[capacity * 2];
+            for (std::size_t i = 0; i < count; ++i) {
+                grown[i] = std::move(statements[i]);
+            }
+            delete[] statements;
+            statements = grown;
+            capacity *= 2;
+        }
+
+        Statement& st = statements[count++];
+        st.line = lineNo;
+        st.checkpoint = (op == "checkpoint");
+        st.req = makeRequest(op, rest, explain);
+        st.req.persist = false; // файл пишется на checkpoint и в конце
+        st.read_only = (op == "find" || op == "count");
+        st.ns = 0;
+    }
+    return true;
+}
+
+static void runStatement(MiniDBMS& db, Statement& st)
+{
+    long long start = metricsNowNs();
+    st.resp = processRequest(st.req, db);
+    st.ns = metricsNowNs() - start;
+}
+
+// подряд идущие чтения [from, to) на пуле: снимки MVCC не мешают друг другу,
+// порядок вывода всё равно по сценарию
+static void runReadsParallel(MiniDBMS& db, WorkerPool& pool, Statement* statements, std::size_t from, std::size_t to)
+{
+    std::atomic<std::size_t> next{from};
+    std::size_t workers = pool.getThreadCount();
+    std::size_t running = workers;
+    std::mutex mtx;
+    std::condition_variable done;
+
+    for (std::size_t w = 0; w < workers; ++w) {
+        pool.submit([&]() {
+            for (std::size_t i = next.fetch_add(1); i < to; i = next.fetch_add(1)) {
+                runStatement(db, statements[i]);
+            }
+            std::lock_guard<std::mutex> lock(mtx);
+            if (--running == 0) {
+                done.notify_one();
+            }
+        });
+    }
+
+    std::unique_lock<std::mutex> lock(mtx);
+    done.wait(lock, [&]() { return running == 0; });
+}
+
+static const std::size_t MAX_READ_RUN = 1024;
+
+// ПАКЕТНЫЙ РЕЖИМ: весь сценарий в памяти базы, файл базы пишется на checkpoint
+// (или каждые checkpoint_every изменений) и один раз в конце, а не после каждой записи
+static int runBatch(MiniDBMS& db, const BatchOptions& options)
+{
+    Statement* statements = nullptr;
+    std::size_t count = 0;
+    if (!loadScript(options.script, statements, count)) {
+        return 1;
+    }
+
+    WorkerPool* pool = options.parallel > 1 ? new WorkerPool(options.parallel) : nullptr;
+    LatencyHistogram* latency = new LatencyHistogram[HISTOGRAM_COUNT];
+    std::size_t errors[HISTOGRAM_COUNT] = {};
+    std::size_t totalErrors = 0;
+    std::size_t shownErrors = 0;
+    std::size_t saves = 0;
+    long long saveNs = 0;
+    std::size_t changes = 0; // изменений с последней записи файла
+
+    auto save = [&]() {
+        long long start = metricsNowNs();
+        db.saveToDisk();
+        saveNs += metricsNowNs() - start;
+        ++saves;
+        changes = 0;
+    };
+
+    long long start = metricsNowNs();
+    std::size_t i = 0;
+    while (i < count) {
+        // отрезок: либо подряд идущие чтения (ответы держатся до вывода - не больше
+        // MAX_READ_RUN), либо одна запись / checkpoint
+        std::size_t end = i + 1;
+        if (statements[i].read_only) {
+            while (end < count && end - i < MAX_READ_RUN && statements[end].read_only) {
+                ++end;
+            }
+        }
+
+        if (statements[i].checkpoint) {
+            save();
+        } else if (pool && end - i > 1) {
+            runReadsParallel(db, *pool, statements, i, end);
+        } else {
+            for (std::size_t j = i; j < end; ++j) {
+                runStatement(db, statements[j]);
+            }
+        }
+
+        for (std::size_t j = i; j < end; ++j) {
+            Statement& st = statements[j];
+            if (st.checkpoint) {
+                if (!options.quiet) {
+                    std::cout << "[success] checkpoint\n";
+                }
+                continue;
+            }
+
+            MetricHistogram op = histogramForOperation(st.req.operation);
+            latency[op].record(static_cast<uint64_t>(st.ns));
+            if (st.resp.status == "error") {
+                ++errors[op];
+                ++totalErrors;
+                if (options.quiet && shownErrors < 10) {
+                    ++shownErrors;
+                    std::cerr << options.script << ":" << st.line << ": " << st.resp.message << "\n";
+                }
+            } else if (!st.read_only) {
+                ++changes;
+            }
+            if (!options.quiet) {
+                logFlush();
+                printResponse(st.resp);
+            }
+            st.resp = Response{}; // найденные документы больше не нужны
+        }
+
+        if (options.checkpoint_every > 0 && changes >= options.checkpoint_every) {
+            save();
+        }
+        i = end;
+    }
+    if (changes > 0 || saves == 0) {
+        save();
+    }
+    double seconds = (metricsNowNs() - start) / 1e9;
+    logFlush();
+
+    char buffer[160];
+    std::snprintf(buffer, sizeof(buffer), "[Batch] %zu statements from %s in %.1f ms (%.0f stmt/s), %zu errors, %zu saves (%.1f ms)\n",
+                  count, options.script.c_str(), seconds * 1000.0, seconds > 0 ? count / seconds : 0.0,
+                  totalErrors, saves, saveNs / 1e6);
+    std::cerr << buffer;
+    std::snprintf(buffer, sizeof(buffer), "[Batch] %-10s %8s %7s %10s %9s %9s %9s %9s\n",
+                  "operation", "count", "errors", "total ms", "mean us", "p50 us", "p99 us", "max us");
+    std::cerr << buffer;
+    for (int op = OP_INSERT; op <= OP_OTHER; ++op) {
+        const LatencyHistogram& h = latency[op];
+        if (h.getCount() == 0) {
+            continue;
+        }
+        std::snprintf(buffer, sizeof(buffer), "[Batch] %-10s %8llu %7zu %10.1f %9.1f %9.1f %9.1f %9.1f\n",
+                      histogramName(static_cast<MetricHistogram>(op)),
+                      static_cast<unsigned long long>(h.getCount()), errors[op], h.getSum() / 1e6,
+                      h.getSum() / 1e3 / h.getCount(), h.percentile(0.5) / 1e3, h.percentile(0.99) / 1e3,
+                      h.getMax() / 1e3);
+        std::cerr << buffer;
+    }
+
+    delete[] latency;
+    delete pool;
+    delete[] statements;
+    return totalErrors == 0 ? 0 : 2;
+}
+
+int main(int argc, char* argv[])
+{
+    BatchOptions batch;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--batch" && i + 1 < argc) {
+            batch.script = argv[++i];
+        } else if (arg == "--parallel" && i + 1 < argc) {
+            int threads = std::atoi(argv[++i]);
+            if (threads <= 0) {
+                std::cerr << "--parallel ожидает положительное число потоков\n";
+                return 1;
+            }
+            batch.parallel = static_cast<std::size_t>(threads);
+        } else if (arg == "--checkpoint-every" && i + 1 < argc) {
+            batch.checkpoint_every = static_cast<std::size_t>(std::atoll(argv[++i]));
+        } else if (arg == "--quiet") {
+            batch.quiet = true;
+        } else {
+            std::cerr << "Unknown argument: " << arg
+                      << " (--batch FILE [--parallel N] [--checkpoint-every N] [--quiet])\n";
+            return 1;
+        }
+    }
+
     MiniDBMS db("mydb");    // имя базы
     db.loadFromDisk();      // загрузка при старте
 
+    if (!batch.script.empty()) {
+        return runBatch(db, batch);
+    }
+
     while (true) {
+        logFlush(); // сообщения базы - до приглашения, как при синхронном выводе
         std::cout << "> ";
         std::string op;
         if (!(std::cin >> op)) {
             break; // EOF / ошибка
         }
 
+        bool explain = false;
+        if (op == "explain") { // explain find {...}
+            explain = true;
+            if (!(std::cin >> op)) {
+                break;
+            }
+        }
+
         std::string json;
         std::getline(std::cin, json); // забираем остаток строки
         if (!json.empty() && json[0] == ' ') {
             json.erase(0, 1); // убираем ведущий пробел
         }
 
-        Request req;
-        req.database   = "mydb";
-        req.operation  = op;
-        req.query_json = json;
-
-        Response resp = processRequest(req, db);
-
-        std::cout << "[" << resp.status << "] " << resp.message << "\n";
-        if (!resp.data.empty()) {
-            std::cout << resp.data << "\n";
-        }
+        Response resp = processRequest(makeRequest(op, json, explain), db);
+        printResponse(resp);
     }
 
     return 0;
@@ -0,0 +1,133 @@
+#include "logger.h"
+#include "async_log.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+using namespace std;
+
+atomic<int> g_logLevel{LOG_LEVEL_INFO};
+
+class ConsoleLog
+{
+private:
+    LogRing ring;
+    atomic<size_t> written; // сколько строк кольца уже выведено
+    mutex flush_mtx;
+    condition_variable flushed;
+    uint64_t reported_dropped;
+
+    void writer_loop()
+    {
+        int level;
+        string line;
+        while (true)
+        {
+            bool wrote = false;
+            while (ring.pop(level, line))
+            {
+                FILE *out = level >= LOG_LEVEL_WARN ? stderr : stdout;
+                line += '\n';
+                fwrite(line.data(), 1, line.size(), out);
+                wrote = true;
+            }
+
+            uint64_t dropped = ring.getDropped();
+            if (dropped != reported_dropped)
+            {
+                fprintf(stderr, "WARNING: журнал не успевает, отброшено строк: %llu\n",
+                        static_cast<unsigned long long>(dropped - reported_dropped));
+                reported_dropped = dropped;
+                wrote = true;
+            }
+
+            if (wrote)
+            {
+                fflush(stdout);
+                fflush(stderr);
+                {
+                    lock_guard<mutex> lock(flush_mtx);
+                    written.store(ring.poppedCount());
+                }
+                flushed.notify_all();
+            }
+            ring.waitForData(chrono::milliseconds(100));
+        }
+    }
+
+public:
+    ConsoleLog() : ring(16384), written(0), reported_dropped(0)
+    {
+        thread(&ConsoleLog::writer_loop, this).detach();
+    }
+
+    bool write(LogLevel level, string &&message)
+    {
+        return ring.push(level, std::move(message));
+    }
+
+    void flush()
+    {
+        size_t target = ring.pushedCount();
+        ring.wake();
+        unique_lock<mutex> lock(flush_mtx);
+        // строки, занятые, но ещё не опубликованные писателями, читатель дождётся сам
+        flushed.wait_for(lock, chrono::seconds(2), [&]
+                         { return written.load() >= target; });
+    }
+
+    uint64_t dropped() const
+    {
+        return ring.getDropped();
+    }
+};
+
+// живёт до конца процесса: статические деструкторы других модулей тоже могут писать в журнал
+static ConsoleLog &consoleLog()
+{
+    static ConsoleLog *log = []
+    {
+        ConsoleLog *created = new ConsoleLog;
+        atexit(logFlush);
+        return created;
+    }();
+    return *log;
+}
+
+void setLogLevel(LogLevel level)
+{
+    g_logLevel.store(level);
+}
+
+bool parseLogLevel(const string &name, LogLevel &level)
+{
+    if (name == "debug")
+        level = LOG_LEVEL_DEBUG;
+    else if (name == "info")
+        level = LOG_LEVEL_INFO;
+    else if (name == "warn")
+        level = LOG_LEVEL_WARN;
+    else if (name == "error")
+        level = LOG_LEVEL_ERROR;
+    else if (name == "off")
+        level = LOG_LEVEL_OFF;
+    else
+        return false;
+    return true;
+}
+
+void logWrite(LogLevel level, string message)
+{
+    consoleLog().write(level, std::move(message));
+}
+
+void logFlush()
+{
+    consoleLog().flush();
+}
+
+uint64_t logDropped()
+{
+    return consoleLog().dropped();
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <sstream>
+#include <string>
+
+// журнал сервера: строки уходят в LogRing, в stdout/stderr их пишет фоновый поток.
+// Поток запроса не ждёт ни консоль, ни общую блокировку потока вывода
+enum LogLevel
+{
+    LOG_LEVEL_DEBUG, // подробности по каждому документу - по умолчанию выключены
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_WARN,  // WARN и ERROR идут в stderr, остальное в stdout
+    LOG_LEVEL_ERROR,
+    LOG_LEVEL_OFF
+};
+
+extern std::atomic<int> g_logLevel;
+
+inline bool logEnabled(LogLevel level)
+{
+    return level >= g_logLevel.load(std::memory_order_relaxed);
+}
+
+void setLogLevel(LogLevel level);
+bool parseLogLevel(const std::string &name, LogLevel &level); // debug / info / warn / error / off
+
+// строка без '\n' на конце; префиксы вроде "INFO:" - часть сообщения
+void logWrite(LogLevel level, std::string message);
+// дождаться, пока всё записанное до вызова выведено (перед выводом в консоль напрямую и при выходе)
+void logFlush();
+uint64_t logDropped(); // строк отброшено из-за полного кольца
+
+// LOG_INFO("Документов: " << count) - сообщение собирается, только если уровень включён
+#define LOG_AT(level, expr)                      \
+    do                                           \
+    {                                            \
+        if (logEnabled(level))                   \
+        {                                        \
+            std::ostringstream log_stream_;      \
+            log_stream_ << expr;                 \
+            logWrite(level, log_stream_.str());  \
+        }                                        \
+    } while (0)
+
+#define LOG_DEBUG(expr) LOG_AT(LOG_LEVEL_DEBUG, expr)
+#define LOG_INFO(expr) LOG_AT(LOG_LEVEL_INFO, expr)
+#define LOG_WARN(expr) LOG_AT(LOG_LEVEL_WARN, expr)
+#define LOG_ERROR(expr) LOG_AT(LOG_LEVEL_ERROR, expr)
@@ -0,0 +1,218 @@
+#include "metrics.h"
+
+#include <chrono>
+#include <mutex>
+
+using namespace std;
+
+LatencyHistogram::LatencyHistogram() : total(0), sum(0), max(0)
+{
+    for (size_t i = 0; i < BUCKETS; i++)
+    {
+        counts[i].store(0, memory_order_relaxed);
+    }
+}
+
+size_t LatencyHistogram::bucket_of(uint64_t value)
+{
+    if (value < SUB_BUCKETS)
+    {
+        return static_cast<size_t>(value); // маленькие значения - точно
+    }
+    int top = 63 - __builtin_clzll(value); // номер старшего бита
+    int shift = top - SUB_BITS;
+    size_t sub = static_cast<size_t>(value >> shift) & (SUB_BUCKETS - 1);
+    return static_cast<size_t>(shift + 1) * SUB_BUCKETS + sub;
+}
+
+uint64_t LatencyHistogram::bucket_high(size_t bucket)
+{
+    if (bucket < SUB_BUCKETS)
+    {
+        return bucket;
+    }
+    int shift = static_cast<int>(bucket / SUB_BUCKETS) - 1;
+    uint64_t sub = bucket % SUB_BUCKETS;
+    return ((SUB_BUCKETS + sub + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t value)
+{
+    atomic<uint64_t> &bucket = counts[bucket_of(value)];
+    bucket.store(bucket.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    total.store(total.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    sum.store(sum.load(memory_order_relaxed) + value, memory_order_relaxed);
+    if (value > max.load(memory_order_relaxed))
+    {
+        max.store(value, memory_order_relaxed);
+    }
+}
+
+void LatencyHistogram::merge(const LatencyHistogram &other)
+{
+    for (size_t i = 0; i < BUCKETS; i++)
+    {
+        uint64_t count = other.counts[i].load(memory_order_relaxed);
+        if (count)
+        {
+            counts[i].fetch_add(count, memory_order_relaxed);
+        }
+    }
+    total.fetch_add(other.total.load(memory_order_relaxed), memory_order_relaxed);
+    sum.fetch_add(other.sum.load(memory_order_relaxed), memory_order_relaxed);
+    uint64_t other_max = other.max.load(memory_order_relaxed);
+    if (other_max > max.load(memory_order_relaxed))
+    {
+        max.store(other_max, memory_order_relaxed);
+    }
+}
+
+uint64_t LatencyHistogram::getCount() const
+{
+    return total.load(memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::getSum() const
+{
+    return sum.load(memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::getMax() const
+{
+    return max.load(memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::percentile(double fraction) const
+{
+    // корзины читаются по одной, поэтому их сумма может не совпасть с total
+    uint64_t all = 0;
+    for (size_t i = 0; i < BUCKETS; i++)
+    {
+        all += counts[i].load(memory_order_relaxed);
+    }
+    if (all == 0)
+    {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(fraction * static_cast<double>(all));
+    if (rank >= all)
+    {
+        rank = all - 1;
+    }
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; i++)
+    {
+        seen += counts[i].load(memory_order_relaxed);
+        if (seen > rank)
+        {
+            uint64_t high = bucket_high(i);
+            uint64_t top = getMax();
+            return high < top ? high : top;
+        }
+    }
+    return getMax();
+}
+
+// счётчики одного потока; блоки не освобождаются, чтобы итоги завершившихся потоков
+// не пропадали, а сборщику не нужно было синхронизироваться с выходом потока
+struct alignas(64) ThreadMetrics
+{
+    atomic<uint64_t> counters[COUNTER_COUNT];
+    LatencyHistogram histograms[HISTOGRAM_COUNT];
+    ThreadMetrics *next;
+
+    ThreadMetrics() : next(nullptr)
+    {
+        for (size_t i = 0; i < COUNTER_COUNT; i++)
+        {
+            counters[i].store(0, memory_order_relaxed);
+        }
+    }
+};
+
+static mutex g_threadsMutex; // только регистрация потока и сбор
+static ThreadMetrics *g_threads = nullptr;
+
+static ThreadMetrics &local_metrics()
+{
+    static thread_local ThreadMetrics *mine = nullptr;
+    if (mine == nullptr)
+    {
+        ThreadMetrics *block = new ThreadMetrics;
+        lock_guard<mutex> lock(g_threadsMutex);
+        block->next = g_threads;
+        g_threads = block;
+        mine = block;
+    }
+    return *mine;
+}
+
+void addCounter(MetricCounter counter, uint64_t value)
+{
+    atomic<uint64_t> &slot = local_metrics().counters[counter];
+    slot.store(slot.load(memory_order_relaxed) + value, memory_order_relaxed);
+}
+
+void recordLatency(MetricHistogram histogram, long long ns)
+{
+    local_metrics().histograms[histogram].record(ns > 0 ? static_cast<uint64_t>(ns) : 0);
+}
+
+MetricsSnapshot::MetricsSnapshot()
+{
+    for (size_t i = 0; i < COUNTER_COUNT; i++)
+    {
+        counters[i] = 0;
+    }
+}
+
+void collectMetrics(MetricsSnapshot &out)
+{
+    lock_guard<mutex> lock(g_threadsMutex);
+    for (ThreadMetrics *block = g_threads; block; block = block->next)
+    {
+        for (size_t i = 0; i < COUNTER_COUNT; i++)
+        {
+            out.counters[i] += block->counters[i].load(memory_order_relaxed);
+        }
+        for (size_t i = 0; i < HISTOGRAM_COUNT; i++)
+        {
+            out.histograms[i].merge(block->histograms[i]);
+        }
+    }
+}
+
+const char *counterName(MetricCounter counter)
+{
+    static const char *names[COUNTER_COUNT] = {"bytes_in", "bytes_out", "requests_json", "requests_binary", "request_errors"};
+    return names[counter];
+}
+
+const char *histogramName(MetricHistogram histogram)
+{
+    static const char *names[HISTOGRAM_COUNT] = {"insert", "find", "count", "delete", "update", "prepare", "stats",
+                                                 "other", "lock_wait", "disk_save", "disk_load"};
+    return names[histogram];
+}
+
+MetricHistogram histogramForOperation(const string &operation)
+{
+    if (operation == "import")
+    {
+        return OP_INSERT; // пачка без записи файла - та же вставка
+    }
+    for (int i = OP_INSERT; i < OP_OTHER; i++)
+    {
+        if (operation == histogramName(static_cast<MetricHistogram>(i)))
+        {
+            return static_cast<MetricHistogram>(i);
+        }
+    }
+    return OP_OTHER;
+}
+
+long long metricsNowNs()
+{
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
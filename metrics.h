@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// счётчики, которые копятся с запуска процесса
+enum MetricCounter
+{
+    BYTES_IN,         // принято в запросах (строки JSON и кадры)
+    BYTES_OUT,        // отправлено в ответах
+    REQUESTS_JSON,
+    REQUESTS_BINARY,
+    REQUEST_ERRORS,   // ответы со статусом error
+    COUNTER_COUNT
+};
+
+// задержки в наносекундах
+enum MetricHistogram
+{
+    OP_INSERT,
+    OP_FIND,
+    OP_COUNT,
+    OP_DELETE,
+    OP_UPDATE,
+    OP_PREPARE,
+    OP_STATS,
+    OP_OTHER,      // неизвестные и некорректные запросы
+    LOCK_WAIT,     // ожидание блокировки записи (WriteScope)
+    DISK_SAVE,     // saveToDisk, когда файл действительно переписывался
+    DISK_LOAD,     // loadFromDisk с разбором файла
+    HISTOGRAM_COUNT
+};
+
+// гистограмма в духе HDR: диапазон [2^k, 2^(k+1)) делится на SUB_BUCKETS равных частей,
+// поэтому относительная ошибка любой квантили не больше 1/SUB_BUCKETS при любом масштабе.
+// Пишет один поток (свой экземпляр), читать можно из любого - значения атомарные
+class LatencyHistogram
+{
+public:
+    static const int SUB_BITS = 4;
+    static const size_t SUB_BUCKETS = 1 << SUB_BITS;
+    static const size_t BUCKETS = (64 - SUB_BITS + 1) * SUB_BUCKETS;
+
+private:
+    std::atomic<uint64_t> counts[BUCKETS];
+    std::atomic<uint64_t> total;
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> max;
+
+    static size_t bucket_of(uint64_t value);
+    static uint64_t bucket_high(size_t bucket); // верхняя граница значений корзины
+
+public:
+    LatencyHistogram();
+    LatencyHistogram(const LatencyHistogram &) = delete;
+    LatencyHistogram &operator=(const LatencyHistogram &) = delete;
+
+    // только поток-владелец: без атомарного RMW, строка кеша остаётся у него
+    void record(uint64_t value);
+    // прибавить чужую гистограмму (сбор со всех потоков)
+    void merge(const LatencyHistogram &other);
+
+    uint64_t getCount() const;
+    uint64_t getSum() const;
+    uint64_t getMax() const;
+    uint64_t percentile(double fraction) const; // fraction в [0, 1]
+};
+
+// запись с горячего пути: в счётчики своего потока, без общих блокировок и общих строк кеша
+void addCounter(MetricCounter counter, uint64_t value);
+void recordLatency(MetricHistogram histogram, long long ns);
+
+// сумма по всем потокам на момент вызова
+struct MetricsSnapshot
+{
+    uint64_t counters[COUNTER_COUNT];
+    LatencyHistogram histograms[HISTOGRAM_COUNT];
+
+    MetricsSnapshot();
+};
+void collectMetrics(MetricsSnapshot &out);
+
+const char *counterName(MetricCounter counter);
+const char *histogramName(MetricHistogram histogram);
+
+// гистограмма по имени операции JSON-протокола (insert, find, ...)
+MetricHistogram histogramForOperation(const std::string &operation);
+
+// монотонное время для замеров
+long long metricsNowNs();
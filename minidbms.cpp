@@ -1,22 +1,36 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <stdexcept>
+#include <chrono>
+#include <shared_mutex>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
 
 #include "minidbms.h"
 #include "document.h"
+#include "metrics.h"
+#include "logger.h"
+#include "trace.h"
+#include "uring.h"
 
 using namespace std;
 
+static long long now_ns()
+{
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 MiniDBMS::MiniDBMS(const string &db_name, const string &db_folder)
-    : db_name(db_name), db_folder(db_folder), data_store(), next_id(1) {}
+    : db_name(db_name), db_folder(db_folder), data_store(), next_id(1), saved_version(0), uring_writes(false) {}
 MiniDBMS::~MiniDBMS() {} // у хэша есть свой тут не нужен
 
 
 
 string MiniDBMS::generate_id()
 {
-    string id = to_string(next_id);
-    next_id++;
+    string id = to_string(next_id.fetch_add(1));
     return (id);
 }
 
@@ -25,14 +39,114 @@ string MiniDBMS::get_collection_path() const
     return (db_folder + "/" + db_name + ".json");
 }
 
+// открытая область записи текущего потока (для вложенных вставок пачки)
+static thread_local MiniDBMS::WriteScope *current_scope = nullptr;
+
+MiniDBMS::WriteScope::WriteScope(MiniDBMS &db, QueryStats *stats)
+    : db(db), outer(nullptr), version(0), exclusive(true), nested(false), stripe(nullptr)
+{
+    begin(nullptr, stats);
+}
+
+MiniDBMS::WriteScope::WriteScope(MiniDBMS &db, const string &key, QueryStats *stats)
+    : db(db), outer(nullptr), version(0), exclusive(false), nested(false), stripe(nullptr)
+{
+    begin(&key, stats);
+}
+
+void MiniDBMS::WriteScope::begin(const string *key, QueryStats *stats)
+{
+    outer = current_scope;
+    if (outer && &outer->db == &db)
+    {
+        // внутри уже открытой записи этой базы: та же версия и те же блокировки
+        if (!outer->exclusive && (!key || &db.data_store.stripeOf(*key) != outer->stripe))
+            throw logic_error("Вложенная запись шире внешней");
+        nested = true;
+        version = outer->version;
+        exclusive = outer->exclusive;
+        current_scope = this;
+        return;
+    }
+
+    long long start = now_ns();
+    if (key)
+    {
+        db.write_mode.lock_shared();
+        stripe = &db.data_store.stripeOf(*key);
+        stripe->lock();
+    }
+    else
+    {
+        db.write_mode.lock();
+    }
+    long long waited = now_ns() - start;
+    if (stats)
+        stats->lock_wait_ns += waited;
+    recordLatency(LOCK_WAIT, waited);
+    if (tracingEnabled())
+        traceSpan(TRACE_LOCK_WAIT, start, start + waited);
+
+    // версия выдаётся под блокировкой ключа, поэтому версии одного ключа всегда растут
+    version = db.snapshots.allocate();
+    current_scope = this;
+}
+
+MiniDBMS::WriteScope::~WriteScope()
+{
+    current_scope = outer;
+    if (nested)
+        return;
+
+    db.snapshots.publish(version); // с этого момента новые снимки видят запись
+    if (stripe)
+    {
+        stripe->unlock();
+        db.write_mode.unlock_shared();
+    }
+    else
+    {
+        db.write_mode.unlock();
+    }
+    db.collect_garbage();
+}
+
+unsigned long long MiniDBMS::WriteScope::getVersion() const
+{
+    return version;
+}
+
+bool MiniDBMS::WriteScope::isExclusive() const
+{
+    return exclusive;
+}
+
+// старые версии, которые не нужны ни одному снимку, - в мусор
+void MiniDBMS::collect_garbage()
+{
+    if (!data_store.hasGarbage())
+        return;
+    shared_lock<RWLock> mode(write_mode); // не пересекаемся с ростом таблицы
+    data_store.collect(snapshots);
+}
+
 void MiniDBMS::loadFromDisk()
 {
+    long long start = now_ns();
+    WriteScope write(*this);
+    result_cache.clear();
+    {
+        // в памяти будет то же, что в файле: без записей сохранять (и при выгрузке) нечего
+        lock_guard<mutex> saving(save_mtx);
+        saved_version = write.getVersion();
+    }
+
     string path = get_collection_path();
     ifstream file(path);
     if (!file.is_open())
     {
         // файла нет — начинаем с пустой базы
-        cout << " Файл коллекции не найден. Новая база." << endl;
+        LOG_INFO(" Файл коллекции не найден. Новая база.");
         next_id = 1;
         return;
     }
@@ -57,7 +171,7 @@ void MiniDBMS::loadFromDisk()
 
     if (s.front() != '[' || s.back() != ']')
     {
-        cerr << "Некорректный формат файла (ожидался JSON-массив)." << endl;
+        LOG_ERROR("Некорректный формат файла (ожидался JSON-массив).");
         next_id = 1;
         return;
     }
@@ -83,7 +197,7 @@ void MiniDBMS::loadFromDisk()
 
         if (content[pos] != '{')
         {
-            cerr << "Ожидался '{' при разборе массива документов." << endl;
+            LOG_ERROR("Ожидался '{' при разборе массива документов.");
             break;
         }
 
@@ -111,7 +225,7 @@ void MiniDBMS::loadFromDisk()
 
         if (!found_end)
         {
-            cerr << "ERROR: Не смогли найти конец JSON-объекта в массиве." << endl;
+            LOG_ERROR("ERROR: Не смогли найти конец JSON-объекта в массиве.");
             break;
         }
 
@@ -124,7 +238,9 @@ void MiniDBMS::loadFromDisk()
         Document *doc = Document::deserialize(obj_str);
         if (doc)
         {
-            data_store.put(doc->_id, doc);
+            if (data_store.needsGrow())
+                data_store.grow(write.getVersion());
+            data_store.put(doc->_id, doc, write.getVersion());
             try
             {
                 long long current_id = stoll(doc->_id);
@@ -135,793 +251,775 @@ void MiniDBMS::loadFromDisk()
             }
             catch (const exception &e)
             {
-                cerr << "WARNING: Не удалось преобразовать _id '" << doc->_id
-                     << "' в число: " << e.what() << endl;
+                LOG_WARN("WARNING: Не удалось преобразовать _id '" << doc->_id
+                         << "' в число: " << e.what());
             }
         }
     }
 
     next_id = max_id + 1;
-    cout << "INFO: Загрузка завершена. Документов: "
-         << data_store.getSize()
-         << ". next_id = " << next_id << endl;
+    LOG_INFO("INFO: Загрузка завершена. Документов: "
+             << data_store.getSize()
+             << ". next_id = " << next_id);
+    recordLatency(DISK_LOAD, now_ns() - start);
 }
 
-void MiniDBMS::saveToDisk() 
+unsigned long long MiniDBMS::data_version(unsigned long long snapshot_version) const
 {
-    string path = get_collection_path();
-    ofstream file(path); // открываем для перезаписи
-    if (!file.is_open())
+    // изменение новее снимка ему не видно - тогда снимок сам себе версия
+    unsigned long long changed = data_store.getChangedVersion();
+    return changed < snapshot_version ? changed : snapshot_version;
+}
+
+bool MiniDBMS::saveToDisk() 
+{
+    // пишем согласованный снимок, запись в это время не блокируется;
+    // если параллельный писатель уже сохранил этот же снимок - второй раз не пишем
+    lock_guard<mutex> saving(save_mtx);
+    SnapshotGuard snapshot(snapshots);
+    unsigned long long version = data_version(snapshot.getVersion());
+    if (version == saved_version)
     {
-        cerr << "Ошибка открытия файла \n";
-        return;
+        return true;
     }
 
-    file << "[\n";
+    long long start = now_ns();
+    // один и тот же обход для ofstream и UringFileWriter
+    auto write_snapshot = [&](auto &file)
+    {
+        file << "[\n";
 
-    bool first = true;
+        bool first = true;
 
-    // проход по все бакетам
-    for (size_t i = 0; i < data_store.getCapacity(); i++)
-    {
-        ListNode *current = data_store.getBucketHead(i);
-        while (current)
-        {
-            Document *doc = current->value;
-            if (!doc)
-            {
-                current = current->next;
-                continue;
-            }
+        data_store.for_each_visible(snapshot.getVersion(), [&](Document *doc)
+                                    {
+                                        if (!first)
+                                        {
+                                            file << ",\n";
+                                        }
+                                        first = false;
 
-            if (!first)
-            {
-                file << ",\n";
-            }
-            first = false;
+                                        file << doc->serialize(); });
 
-            file << doc->serialize();
+        file << "\n]\n";
+    };
 
-            current = current->next;
+    // снимок пишется во временный файл и заменяет старый через rename: при ошибке
+    // записи (нет места, сбой диска) на диске остаётся прежняя целая версия
+    string path = get_collection_path();
+    string temp_path = path + ".tmp";
+    bool written = false;
+    if (uring_writes)
+    {
+        UringFileWriter file;
+        if (!file.open(temp_path))
+        {
+            LOG_ERROR("Ошибка открытия файла " << temp_path);
+            return false;
         }
+        write_snapshot(file);
+        written = file.close();
+    }
+    else
+    {
+        ofstream file(temp_path); // открываем для перезаписи
+        if (!file.is_open())
+        {
+            LOG_ERROR("Ошибка открытия файла " << temp_path);
+            return false;
+        }
+        write_snapshot(file);
+        file.flush();
+        written = file.good();
+        file.close();
+        written = written && !file.fail();
     }
 
-    file << "\n]\n";
-
-    file.close();
+    if (!written || ::rename(temp_path.c_str(), path.c_str()) != 0)
+    {
+        LOG_ERROR("Ошибка записи файла " << path);
+        ::remove(temp_path.c_str());
+        return false; // версия не сохранена - следующая запись попробует снова
+    }
+    saved_version = version;
+    recordLatency(DISK_SAVE, now_ns() - start);
+    return true;
 }
 
-// проверка есть ли в строке цифры или + -
-bool MiniDBMS::is_integer_string(const string &s)
+
+// разобранный запрос берём из кеша, разбор текста - только при первом появлении
+shared_ptr<const CompiledQuery> MiniDBMS::compile_query(const string &query_json, const QueryParams &params, QueryStats *stats)
 {
-    string t = trim(s);
-    if (t.empty())
-        return false;
-    size_t i = 0;
-    if (t[0] == '+' || t[0] == '-')
+    bool timed = stats && stats->timings;
+    long long start = timed ? now_ns() : 0;
+    bool was_hit = false;
+    shared_ptr<const CompiledQuery> query = plan_cache.get(query_json, &was_hit);
+    if (stats)
     {
-        if (t.size() == 1)
-            return false;
-        i = 1;
+        if (timed)
+            stats->parse_ns += now_ns() - start;
+        stats->plan_cache_hit = was_hit;
+        stats->access_path = query->accessPath();
     }
-    for (; i < t.size(); i++)
+    if (static_cast<size_t>(query->getParamCount()) != params.getCount())
     {
-        if (t[i] < '0' || t[i] > '9')
-            return false;
+        throw invalid_argument("Ожидалось параметров: " + to_string(query->getParamCount()) +
+                               ", передано: " + to_string(params.getCount()));
     }
-    return true;
+    return query;
 }
 
-static bool like_match_impl(const string &value, const string &pattern, size_t i, size_t j)
-{ // patern - шаблон поиска
-    if (j == pattern.size())
+template <typename Visitor>
+void MiniDBMS::for_each_match(const CompiledQuery &query, const QueryParams &params, unsigned long long snapshot, Visitor visit, QueryStats *stats)
+{
+    string key;
+    if (query.pointLookupKey(params, key))
     {
-        return i == value.size();
+        // план ID_LOOKUP: условие требует конкретный _id, остальные документы не подходят
+        if (stats)
+            stats->access_path = "ID_LOOKUP";
+        Document *doc = data_store.get(key, snapshot);
+        if (doc && stats)
+            stats->docs_examined++;
+        if (doc && query.matches(doc, params))
+        {
+            if (stats)
+                stats->docs_matched++;
+            visit(doc);
+        }
+        return;
     }
-    char pc = pattern[j]; // текуший символ
-    if (pc == '%')        // любой
+
+    if (stats)
+        stats->access_path = "FULL_SCAN";
+
+    // план FULL_SCAN: проход по всем бакетам, документы - в версии снимка
+    if (!stats)
     {
-        return like_match_impl(value, pattern, i, j + 1) ||
-               (i < value.size() && like_match_impl(value, pattern, i + 1, j));
+        data_store.for_each_visible(snapshot, [&](Document *doc)
+                                    {
+                                        if (query.matches(doc, params))
+                                        {
+                                            visit(doc);
+                                        } });
+        return;
     }
-    if (pc == '_') //  один символ
+    if (!stats->timings)
     {
-        return (i < value.size() &&
-                like_match_impl(value, pattern, i + 1, j + 1));
+        data_store.for_each_visible(snapshot, [&](Document *doc)
+                                    {
+                                        stats->docs_examined++;
+                                        if (query.matches(doc, params))
+                                        {
+                                            stats->docs_matched++;
+                                            visit(doc);
+                                        } });
+        return;
     }
-    // Обычный символ – должен совпасть по значению
-    return (i < value.size() &&
-            value[i] == pc &&
-            like_match_impl(value, pattern, i + 1, j + 1));
+
+    // тот же проход, но с замером времени на каждом документе (только для explain)
+    long long scan_start = now_ns();
+    long long in_match = 0;
+    long long in_visit = 0;
+    data_store.for_each_visible(snapshot, [&](Document *doc)
+                                {
+                                    stats->docs_examined++;
+                                    long long t0 = now_ns();
+                                    bool matched = query.matches(doc, params);
+                                    long long t1 = now_ns();
+                                    in_match += t1 - t0;
+                                    if (matched)
+                                    {
+                                        stats->docs_matched++;
+                                        visit(doc);
+                                        in_visit += now_ns() - t1;
+                                    } });
+    stats->match_ns += in_match;
+    stats->scan_ns += (now_ns() - scan_start) - in_match - in_visit;
 }
 
-bool MiniDBMS::like_match(const string &value, const string &pattern)
+int MiniDBMS::prepareQuery(const string &query_json)
 {
-    return like_match_impl(value, pattern, 0, 0);
+    return plan_cache.get(query_json)->getParamCount();
 }
 
-// сравниваем одно поле с одним из условий
-bool MiniDBMS::match_query_value(const string &doc_value_raw, const string &query_value_obj)
+const PlanCache &MiniDBMS::getPlanCache() const
 {
-    string doc_value = trim(doc_value_raw);       // строковое значение
-    string trimmed_query = trim(query_value_obj); // строка с условием
+    return plan_cache;
+}
 
-    // постой случай
-    if (trimmed_query.empty())
-        return false;
-    if (trimmed_query.front() != '{')
-    { // неявное равеносто (нету)
-        if (trimmed_query.length() >= 2 && trimmed_query.front() == '"' && trimmed_query.back() == '"')
-        {
-            trimmed_query = trimmed_query.substr(1, trimmed_query.length() - 2); // вырезаем середину
-        }
-        trimmed_query = trim(trimmed_query);
-        // Если оба числа — сравниваем как int, иначе как строки
-        if (is_integer_string(doc_value) && is_integer_string(trimmed_query))
-        {
-            try
-            {
-                int lhs = stoi(doc_value);
-                int rhs = stoi(trimmed_query);
-                return lhs == rhs;
-            }
-            catch (...)
-            {
-                return false;
-            }
-        }
+void MiniDBMS::setResultCacheBudget(size_t bytes)
+{
+    result_cache.setBudget(bytes);
+}
 
-        return doc_value == trimmed_query;
-    }
-    // сложный случай
-    auto extract_operator_value = [&](const string &op_key) -> string // лямда функция
-    {
-        string op_search = "\"" + op_key + "\":";
-        size_t pos = trimmed_query.find(op_search); // поиск оператора
-        if (pos == string::npos)
-            return "";
+void MiniDBMS::setUringWrites(bool enabled)
+{
+    uring_writes = enabled;
+}
 
-        size_t start_search = pos + op_search.length();
-        size_t start_val = trimmed_query.find_first_not_of(" \t\n\r", start_search);
-        if (start_val == string::npos)
-            return "";
+size_t MiniDBMS::documentCount() const
+{
+    return data_store.getLiveCount();
+}
 
-        if (trimmed_query[start_val] == '"')
-        {
-            // строка
-            size_t start_content = start_val + 1;
-            size_t end_content = trimmed_query.find('"', start_content);
-            if (end_content == string::npos)
-                return "";
-            return trim(trimmed_query.substr(start_content, end_content - start_content));
-        }
-        else
-        {
-            // число или сырой литерал
-            size_t end_val = trimmed_query.find_first_of(",}", start_val);
-            if (end_val == string::npos)
-                return "";
-            return trim(trimmed_query.substr(start_val, end_val - start_val));
-        }
-    };
+double MiniDBMS::loadFactor()
+{
+    SnapshotGuard snapshot(snapshots); // таблицу, которую мы читаем, не освободят после роста
+    return data_store.getLoadFactor();
+}
 
-    bool has_any_operator = false;
-    bool result = true;
+size_t MiniDBMS::memoryUsage() const
+{
+    return sizeof(MiniDBMS) + data_store.getMemoryUsage() + result_cache.getUsedBytes();
+}
 
-    // --- $eq (явное равенство) ---
-    string eq_val_str = extract_operator_value("$eq");
-    if (!eq_val_str.empty())
-    {
-        has_any_operator = true;
-        if (is_integer_string(doc_value) && is_integer_string(eq_val_str))
-        {
-            try
-            {
-                int lhs = stoi(doc_value);
-                int rhs = stoi(eq_val_str);
-                result = result && (lhs == rhs);
-            }
-            catch (...)
-            {
-                return false;
-            }
-        }
-        else
-        {
-            result = result && (doc_value == eq_val_str);
-        }
-    }
+const ResultCache &MiniDBMS::getResultCache() const
+{
+    return result_cache;
+}
+
+// вставка нового документа
+void MiniDBMS::insertQuery(const string &query_json)
+{
+    string new_id = generate_id();
 
-    // --- $gt ---
-    string gt_val_str = extract_operator_value("$gt");
-    if (!gt_val_str.empty())
+    string trimmed = trim(query_json);
+    if (trimmed.empty())
     {
-        has_any_operator = true;
-        if (is_integer_string(doc_value) && is_integer_string(gt_val_str))
-        {
-            try
-            {
-                int lhs = stoi(doc_value);
-                int rhs = stoi(gt_val_str);
-                result = result && (lhs > rhs);
-            }
-            catch (...)
-            {
-                return false;
-            }
-        }
-        else
-        {
-            result = result && (doc_value > gt_val_str);
-        }
+        LOG_ERROR("ERROR: пустая вставка");
+        return;
     }
-
-    // --- $lt ---
-    string lt_val_str = extract_operator_value("$lt");
-    if (!lt_val_str.empty())
+    if (trimmed.front() != '{')
     {
-        has_any_operator = true;
-        if (is_integer_string(doc_value) && is_integer_string(lt_val_str))
-        {
-            try
-            {
-                int lhs = stoi(doc_value);
-                int rhs = stoi(lt_val_str);
-                result = result && (lhs < rhs);
-            }
-            catch (...)
-            {
-                return false;
-            }
-        }
-        else
-        {
-            result = result && (doc_value < lt_val_str);
-        }
+        LOG_ERROR("ERROR: не правильнный ввод " << trimmed);
+        return;
     }
 
-    // --- $like ---
-    string like_val_str = extract_operator_value("$like");
-    if (!like_val_str.empty())
+    // убираем первую '{' и подставляем "_id" первым полем
+    string without_first_brace = trimmed.substr(1);
+    string full_json = "{\"_id\":\"" + new_id + "\"," + without_first_brace;
+
+    Document *new_doc = Document::deserialize(full_json);
+    if (!new_doc)
     {
-        has_any_operator = true;
-        result = result && like_match(doc_value, like_val_str);
+        LOG_ERROR("ERROR: проблема с файлом.");
+        return;
     }
+    store_new(new_doc);
+}
 
-    // --- $in ---
-    string in_search = "\"$in\":";
-    size_t in_pos = trimmed_query.find(in_search);
-    if (in_pos != string::npos)
-    {
-        has_any_operator = true;
+// вставка уже собранного документа (бинарный протокол): _id выдаёт база
+void MiniDBMS::insertDocument(Document *doc)
+{
+    doc->_id = generate_id();
+    store_new(doc);
+}
 
-        size_t array_start = trimmed_query.find('[', in_pos + in_search.length());
-        if (array_start == string::npos)
-            return false;
-        size_t array_end = trimmed_query.find(']', array_start);
-        if (array_end == string::npos)
-            return false;
+void MiniDBMS::insertDocuments(Document **docs, size_t count)
+{
+    if (count == 0)
+        return;
 
-        string array_content =
-            trimmed_query.substr(array_start + 1, array_end - array_start - 1);
+    // исключительный режим: рост таблицы и все вставки - одна версия
+    WriteScope batch(*this);
+    data_store.reserve(count, batch.getVersion());
 
-        stringstream ss(array_content);
-        string item;
-        bool in_result = false;
+    long long first_id = next_id.fetch_add(static_cast<long long>(count));
+    for (size_t i = 0; i < count; i++)
+    {
+        docs[i]->_id = to_string(first_id + static_cast<long long>(i));
+        data_store.put(docs[i]->_id, docs[i], batch.getVersion());
+    }
+    LOG_DEBUG("SUCCESS: " << count << " documents inserted. IDs: " << first_id << ".." << first_id + static_cast<long long>(count) - 1);
+}
 
-        while (getline(ss, item, ','))
+size_t MiniDBMS::insertMany(const string &array_json)
+{
+    size_t pos = array_json.find_first_not_of(" \t\n\r");
+    if (pos == string::npos || array_json[pos] != '[')
+        throw invalid_argument("INSERT ожидает массив []");
+    ++pos;
+
+    // сначала разбираем всё: массив растёт удвоением, документы ещё ничьи
+    size_t capacity = 16;
+    size_t count = 0;
+    Document **docs = new Document *[capacity];
+    bool broken = false;
+    while (true)
+    {
+        pos = array_json.find_first_not_of(" \t\n\r,", pos);
+        if (pos == string::npos)
         {
-            string trimmed_item = trim(item);
-
-            if (trimmed_item.length() >= 2 &&
-                trimmed_item.front() == '"' &&
-                trimmed_item.back() == '"')
-            {
-                trimmed_item =
-                    trimmed_item.substr(1, trimmed_item.length() - 2);
-                trimmed_item = trim(trimmed_item);
-            }
-            else
-            {
-                trimmed_item = trim(trimmed_item);
-            }
-
-            if (is_integer_string(doc_value) && is_integer_string(trimmed_item))
-            {
-                try
-                {
-                    int lhs = stoi(doc_value);
-                    int rhs = stoi(trimmed_item);
-                    if (lhs == rhs)
-                    {
-                        in_result = true;
-                        break;
-                    }
-                }
-                catch (...)
-                {
-                    // игнорируем и считаем неравными
-                }
-            }
-            else if (doc_value == trimmed_item)
-            {
-                in_result = true;
-                break;
-            }
+            broken = true; // нет ']'
+            break;
         }
+        if (array_json[pos] == ']')
+            break;
 
-        result = result && in_result;
+        Document *doc = Document::parseObject(array_json, pos);
+        if (!doc)
+        {
+            broken = true;
+            break;
+        }
+        if (count == capacity)
+        {
+            Document **grown = new Document *[capacity * 2];
+            for (size_t i = 0; i < count; i++)
+                grown[i] = docs[i];
+            delete[] docs;
+            docs = grown;
+            capacity *= 2;
+        }
+        docs[count++] = doc;
     }
 
-    if (!has_any_operator)
+    if (broken)
     {
-        // В объекте нет ни одного из известных операторов –
-
-        return false;
+        for (size_t i = 0; i < count; i++)
+            delete docs[i];
+        delete[] docs;
+        throw invalid_argument("Некорректный документ в INSERT, позиция " + to_string(pos == string::npos ? array_json.size() : pos));
     }
 
-    return result;
+    insertDocuments(docs, count);
+    delete[] docs;
+    return count;
 }
 
-bool MiniDBMS::match_and_query(const Document *doc, const string &query_json)
+void MiniDBMS::store_new(Document *new_doc)
 {
-    string query = trim(query_json);
-    if (query.empty() || query == "{}")
-        return true;
-
-    // ожидаем объект вида {...}
-    if (query.front() != '{' || query.back() != '}')
-        return false;
-
-    // убираем внешние скобки
-    string content = query.substr(1, query.length() - 2);
-    size_t current_pos = 0;
-
-    while (current_pos < content.length())
+    // рост таблицы трогает все полосы - отдельной записью в исключительном режиме
+    if (data_store.needsGrow())
     {
-        // пропускаем пробелы, табы и запятые
-        while (current_pos < content.size() &&
-        (content[current_pos] == ' ' ||
-        content[current_pos] == '\t' ||
-        content[current_pos] == '\n' ||
-        content[current_pos] == '\r' ||
-        content[current_pos] == ',')) {
-        ++current_pos;
-        }
-        if (current_pos >= content.length())
-            break;
+        WriteScope grow_scope(*this);
+        if (data_store.needsGrow())
+            data_store.grow(grow_scope.getVersion());
+    }
 
-        // парсим имя поля value(city)
-        size_t start_key = content.find('"', current_pos);
-        if (start_key == string::npos)
-            break;
+    WriteScope write(*this, new_doc->_id);
+    data_store.put(new_doc->_id, new_doc, write.getVersion());
+    // на каждый документ - только с --log-level debug; при выключенном уровне строка даже не собирается
+    LOG_DEBUG("SUCCESS: Document inserted. ID: " << new_doc->_id);
+}
 
-        size_t end_key = content.find('"', start_key + 1);
-        if (end_key == string::npos)
-            return false; // кривой JSON "name":
+void MiniDBMS::findQueryToStream(const string &query_json, ostream &out) // вывод в поток
+{
+    QueryParams no_params;
+    shared_ptr<const CompiledQuery> query = compile_query(query_json, no_params);
 
-        string field_name = content.substr(start_key + 1, end_key - start_key - 1);
+    size_t found_count = 0;
+    out << "Результаты поиска:\n";
 
-        // ищем начало этого значения
+    SnapshotGuard snapshot(snapshots);
+    for_each_match(*query, no_params, snapshot.getVersion(), [&](Document *doc)
+                   {
+                       out << doc->serialize() << "\n";
+                       found_count++; });
 
-        size_t start_val_search = content.find(':', end_key);
-        if (start_val_search == string::npos)
-            return false;
+    out << "Найдено документов: " << found_count << "\n";
+}   
 
-        size_t val_start_char = content.find_first_not_of(" \t", start_val_search + 1);
-        if (val_start_char == string::npos)
-            return false;
+// найденные документы для сборки ответа отдельным проходом (при трассировке);
+// снимок читателя держит их версии, пока список жив
+struct MatchList
+{
+    Document **items = nullptr;
+    size_t size = 0;
+    size_t capacity = 0;
 
-        // определяем конец значения
-        size_t end_val = string::npos;
-        char first_char = content[val_start_char];
+    ~MatchList() { delete[] items; }
 
-        if (first_char == '{' || first_char == '[')
+    void push(Document *doc)
+    {
+        if (size == capacity)
         {
-            // объект или массив
-            char open_char = first_char;
-            char close_char = (open_char == '{') ? '}' : ']';
+            capacity = capacity ? capacity * 2 : 64;
+            Document **grown = new Document *[capacity];
+            for (size_t i = 0; i < size; i++)
+                grown[i] = items[i];
+            delete[] items;
+            items = grown;
+        }
+        items[size++] = doc;
+    }
+};
 
-            int bracket_count = 0;
-            end_val = val_start_char;
-            bool found_end = false;
+void MiniDBMS::findQueryToJsonArray(const string& query_json, string& out_array_json, size_t& out_count, const myarray *params, QueryStats *stats) // вывод в JSON-массив
+{
+    std::string q = trim(query_json);
+    if (q.empty())
+    {
+        q = "{}";
+    }
 
-            while (end_val < content.length())
-            {
-                if (content[end_val] == open_char)
-                    bracket_count++;
-                if (content[end_val] == close_char)
-                {
-                    bracket_count--;
-                    if (bracket_count == 0)
-                    {
-                        found_end = true;
-                        break;
-                    }
-                }
-                end_val++;
-            }
+    // всё чтение идёт по одному снимку, параллельные записи его не меняют
+    SnapshotGuard snapshot(snapshots);
 
-            if (!found_end)
-                return false;
-        }
-        else if (first_char == '"')
+    // ключ кеша результатов: запрос + значения параметров
+    string cache_key;
+    bool use_cache = result_cache.isEnabled();
+    unsigned long long cache_version = data_version(snapshot.getVersion());
+    if (use_cache)
+    {
+        cache_key = normalize_query(q);
+        for (size_t i = 0; params && i < params->getSize(); i++)
         {
-            // строка
-            size_t end_quote = content.find('"', val_start_char + 1);
-            if (end_quote == string::npos)
-                return false;
-            end_val = end_quote;
+            cache_key += '\x1f';
+            cache_key += (*params)[i];
         }
-        else
+        if (result_cache.get(cache_key, cache_version, out_array_json, out_count))
         {
-            // число или литерал
-            size_t separator_pos = content.find_first_of(",}", val_start_char);
-            size_t boundary = (separator_pos == string::npos)
-                                  ? content.length()
-                                  : separator_pos;
-
-            end_val = boundary - 1;
-            while (end_val > val_start_char &&
-                   (content[end_val] == ' ' || content[end_val] == '\t'))
+            if (stats)
             {
-                end_val--;
+                stats->access_path = "RESULT_CACHE";
+                stats->docs_matched = out_count;
             }
+            return;
         }
+    }
 
-        if (end_val == string::npos || end_val < val_start_char)
-            return false;
+    QueryParams bound = params ? QueryParams(*params) : QueryParams();
+    shared_ptr<const CompiledQuery> query = compile_query(q, bound, stats);
+    bool timed = stats && stats->timings;
+
+    out_array_json.clear();
+    out_array_json.push_back('[');
 
-        // само значение условия
-        size_t length = end_val - val_start_char + 1;
-        string condition_value = content.substr(val_start_char, length);
+    bool first = true;
+    out_count = 0U;
 
-        // ---- достаём значение поля из документа
-        string doc_value_raw;
-        if (field_name == "_id")
+    auto append = [&](Document *doc)
+    {
+        long long start = timed ? now_ns() : 0;
+        if (!first)
         {
-            doc_value_raw = doc->_id;
+            out_array_json.push_back(',');
         }
-        else
+        out_array_json += doc->serialize();
+        first = false;
+        ++out_count;
+        if (timed)
+            stats->serialize_ns += now_ns() - start;
+    };
+
+    if (tracingEnabled())
+    {
+        // на трассе поиск и сборка ответа - отдельные отрезки
+        MatchList matches;
         {
-            if (!doc->getField(field_name, doc_value_raw))
-            {
-                // поля нет - документ не удовлетворяет AND
-                return false;
-            }
+            TraceScope scan(TRACE_SCAN);
+            for_each_match(*query, bound, snapshot.getVersion(), [&](Document *doc)
+                           { matches.push(doc); },
+                           stats);
         }
-
-        // ---- проверяем одно условие ----
-        if (!match_query_value(doc_value_raw, condition_value))
+        TraceScope serialize(TRACE_SERIALIZE_DOCS);
+        for (size_t i = 0; i < matches.size; i++)
         {
-            return false;
+            append(matches.items[i]);
         }
-
-        // двигаемся дальше
-        current_pos = end_val + 1;
+        serialize.setValue(out_count);
+    }
+    else
+    {
+        for_each_match(*query, bound, snapshot.getVersion(), append, stats);
     }
 
-    return true;
+    out_array_json.push_back(']');
+
+    // результат старого снимка новым читателям уже не пригодится
+    if (use_cache && snapshot.getVersion() == snapshots.getCommitted())
+    {
+        result_cache.put(cache_key, cache_version, out_array_json, out_count);
+    }
 }
 
-// обработка $or: {"$or": [ { ... }, { ... }, ... ]}
-bool MiniDBMS::handle_or_query(const Document *doc, const string &query_json)
+size_t MiniDBMS::countQuery(const string &query_json, const myarray *params, QueryStats *stats)
 {
-    string search_key = "\"$or\":";
-    size_t pos = query_json.find(search_key);
-    if (pos == string::npos)
-        return false;
-
-    // Находим границы массива условий
-    size_t array_start = query_json.find('[', pos + search_key.length());
-    if (array_start == string::npos)
-        return false;
-
-    size_t array_end = query_json.find_last_of(']');
-    if (array_end == string::npos || array_end < array_start)
-        return false;
-
-    string array_content = query_json.substr(array_start + 1, array_end - array_start - 1); // убираем скобки
+    QueryParams bound = params ? QueryParams(*params) : QueryParams();
+    shared_ptr<const CompiledQuery> query = compile_query(query_json, bound, stats);
+
+    SnapshotGuard snapshot(snapshots);
+    size_t count = 0;
+    for_each_match(
+        *query, bound, snapshot.getVersion(), [&](Document *)
+        { ++count; },
+        stats);
+    return count;
+}
 
-    size_t current_pos = 0;
-    bool has_any_condition = false;
+void MiniDBMS::findQueryToBinary(const string &query_json, string &out, size_t &out_count, QueryStats *stats)
+{
+    QueryParams no_params;
+    shared_ptr<const CompiledQuery> query = compile_query(query_json, no_params, stats);
 
-    while (current_pos < array_content.length())
+    SnapshotGuard snapshot(snapshots);
+    out_count = 0;
+    if (tracingEnabled())
     {
-        // ищем начало объекта-условия
-        size_t start_cond = array_content.find('{', current_pos);
-        if (start_cond == string::npos)
-            break;
-
-        size_t end_cond = start_cond;
-        int bracket_count = 0;
-        bool found_end = false;
-
-        // ищем конец объекта с учётом вложенных { }
-        while (end_cond < array_content.length())
+        MatchList matches;
         {
-            if (array_content[end_cond] == '{')
-                bracket_count++;
-            if (array_content[end_cond] == '}')
-            {
-                bracket_count--;
-                if (bracket_count == 0)
-                {
-                    found_end = true;
-                    break;
-                }
-            }
-            end_cond++;
+            TraceScope scan(TRACE_SCAN);
+            for_each_match(*query, no_params, snapshot.getVersion(), [&](Document *doc)
+                           { matches.push(doc); },
+                           stats);
         }
-
-        if (!found_end)
-            return false;
-
-        string sub_query =
-            array_content.substr(start_cond, end_cond - start_cond + 1);
-        has_any_condition = true;
-
-        // каждое подусловие — это полноценный подзапрос (там может быть и $and, и $or)
-        if (match_document(doc, trim(sub_query)))
+        TraceScope serialize(TRACE_SERIALIZE_DOCS);
+        for (size_t i = 0; i < matches.size; i++)
         {
-            // для $or достаточно одного совпадения
-            return true;
+            matches.items[i]->serializeBinary(out);
         }
-
-        current_pos = end_cond + 1;
+        out_count = matches.size;
+        serialize.setValue(out_count);
+        return;
     }
 
-    if (!has_any_condition)
-        return false;
-
-    // ни одно условие не совпало
-    return false;
+    for_each_match(
+        *query, no_params, snapshot.getVersion(), [&](Document *doc)
+        {
+            doc->serializeBinary(out);
+            ++out_count; },
+        stats);
 }
 
-// обработка $and: {"$and": [ { ... }, { ... }, ... ]}
-bool MiniDBMS::handle_and_query(const Document *doc, const string &query_json)
+// поиск документов по условию
+void MiniDBMS::handle_find(const string &query_json)
 {
-    string search_key = "\"$and\":";
-    size_t pos = query_json.find(search_key);
-    if (pos == string::npos)
-        return false;
-
-    // Находим границы массива условий
-    size_t array_start = query_json.find('[', pos + search_key.length());
-    if (array_start == string::npos)
-        return false;
+    findQueryToStream(query_json, cout);
+}
 
-    size_t array_end = query_json.find_last_of(']');
-    if (array_end == string::npos || array_end < array_start)
+size_t MiniDBMS::deleteQuery(const std::string &query_json, const myarray *params, QueryStats *stats)
+{
+    QueryParams bound = params ? QueryParams(*params) : QueryParams();
+    shared_ptr<const CompiledQuery> query = compile_query(query_json, bound, stats);
+
+    // документы не освобождаются сразу: версия помечается удалённой,
+    // а память забирает сборщик, когда её не видит ни один снимок
+    string key;
+    bool point = query->pointLookupKey(bound, key);
+    WriteScope write = point ? WriteScope(*this, key, stats) : WriteScope(*this, stats);
+    size_t removed = 0;
+    for_each_match(
+        *query, bound, write.getVersion(), [&](Document *doc)
+        {
+            if (data_store.remove(doc->_id, write.getVersion()))
+                removed++; },
+        stats);
+    return removed;
+}
+// разбор плоского объекта {"k":"v","n":5} в пары ключ/значение (без вложенных объектов)
+static bool parse_flat_object(const string &json, myarray &keys, myarray &values)
+{
+    string s = trim(json);
+    if (s.size() < 2 || s.front() != '{' || s.back() != '}')
         return false;
 
-    string array_content = query_json.substr(array_start + 1, array_end - array_start - 1); // чистим скобки
-
-    size_t current_pos = 0;
-    bool has_any_condition = false;
-
-    while (current_pos < array_content.length())
+    size_t i = 1;
+    const size_t end = s.size() - 1;
+    while (i < end)
     {
-        size_t start_cond = array_content.find('{', current_pos);
-        if (start_cond == string::npos)
+        while (i < end && (s[i] == ' ' || s[i] == '\t' || s[i] == ',' || s[i] == '\n' || s[i] == '\r'))
+            ++i;
+        if (i >= end)
             break;
+        if (s[i] != '"')
+            return false;
 
-        size_t end_cond = start_cond;
-        int bracket_count = 0;
-        bool found_end = false;
-
-        while (end_cond < array_content.length())
-        {
-            if (array_content[end_cond] == '{')
-                bracket_count++;
-            if (array_content[end_cond] == '}')
-            {
-                bracket_count--;
-                if (bracket_count == 0)
-                {
-                    found_end = true;
-                    break;
-                }
-            }
-            end_cond++;
-        }
-
-        if (!found_end)
+        size_t key_end = s.find('"', i + 1);
+        if (key_end == string::npos || key_end >= end)
             return false;
+        string key = s.substr(i + 1, key_end - i - 1);
 
-        string sub_query = array_content.substr(start_cond, end_cond - start_cond + 1);
-        has_any_condition = true;
+        i = s.find_first_not_of(" \t\n\r", key_end + 1);
+        if (i == string::npos || i >= end || s[i] != ':')
+            return false;
+        i = s.find_first_not_of(" \t\n\r", i + 1);
+        if (i == string::npos || i >= end)
+            return false;
 
-        // КАЖДОЕ подусловие было true
-        if (!match_document(doc, trim(sub_query)))
+        string value;
+        if (s[i] == '"')
         {
-            return false;
+            size_t val_end = s.find('"', i + 1);
+            if (val_end == string::npos || val_end >= end)
+                return false;
+            value = s.substr(i + 1, val_end - i - 1);
+            i = val_end + 1;
+        }
+        else if (s[i] == '{' || s[i] == '[')
+        {
+            return false; // вложенные значения документ хранить не умеет
+        }
+        else
+        {
+            size_t val_end = s.find_first_of(",}", i);
+            if (val_end == string::npos)
+                val_end = end;
+            value = trim(s.substr(i, val_end - i));
+            i = val_end;
         }
 
-        current_pos = end_cond + 1;
+        keys.push(key);
+        values.push(value);
     }
-
-    // Если не было считаем что документ не подходит
-    if (!has_any_condition)
-        return false;
-
     return true;
 }
 
-// решает как вывести
-bool MiniDBMS::match_document(const Document *doc, const string &query_json)
+// целое из поля документа / аргумента $inc; false - не число или вне long long
+static bool parse_int64(const string &text, long long &out)
 {
-    string query = trim(query_json);
-    if (query.empty() || query == "{}")
-        return true;
-
-    // если это объект смотрим на первый ключ
-    if (!query.empty() && query.front() == '{')
-    {
-        size_t first_quote = query.find('"');
-        if (first_quote != string::npos)
-        {
-            size_t second_quote = query.find('"', first_quote + 1);
-            if (second_quote != string::npos)
-            {
-                string first_key = query.substr(first_quote + 1, second_quote - first_quote - 1);
-
-                if (first_key == "$or")
-                {
-                    return handle_or_query(doc, query);
-                }
-                if (first_key == "$and")
-                {
-                    return handle_and_query(doc, query);
-                }
-            }
-        }
-    }
-
-    // по умолчанию — неявный AND
-    return match_and_query(doc, query);
+    if (!is_integer_string(text))
+        return false;
+    string t = trim(text);
+    errno = 0;
+    out = strtoll(t.c_str(), nullptr, 10);
+    return errno != ERANGE;
 }
 
-// вставка нового документа
-void MiniDBMS::insertQuery(const string &query_json)
+// новые версии документов UPDATE до публикации: при исключении удаляются вместе со списком
+struct PendingVersions
 {
-    string new_id = generate_id();
+    MatchList docs;
 
-    string trimmed = trim(query_json);
-    if (trimmed.empty())
-    {
-        cerr << "ERROR: пустая вставка" << endl;
-        return;
-    }
-    if (trimmed.front() != '{')
-    {
-        cerr << "ERROR: не правильнный ввод " << trimmed << endl;
-        return;
-    }
-
-    // убираем первую '{' и подставляем "_id" первым полем
-    string without_first_brace = trimmed.substr(1);
-    string full_json = "{\"_id\":\"" + new_id + "\"," + without_first_brace;
-
-    Document *new_doc = Document::deserialize(full_json);
-    if (!new_doc)
+    ~PendingVersions()
     {
-        cerr << "ERROR: проблема с файлом." << endl;
-        return;
+        for (size_t i = 0; i < docs.size; i++)
+            delete docs.items[i];
     }
+};
 
-    data_store.put(new_doc->_id, new_doc);
-    cout << "SUCCESS: Document inserted. ID: " << new_id << endl;
-}
-
-void MiniDBMS::findQueryToStream(const string &query_json, ostream &out) // вывод в поток
+// изменение документов по условию: {"$set":{...},"$unset":{...},"$inc":{...}}
+// каждый найденный документ получает новую версию, _id менять нельзя
+size_t MiniDBMS::updateQuery(const string &query_json, const string &update_json, const myarray *params, QueryStats *stats)
 {
-    size_t found_count = 0;
-    out << "Результаты поиска:\n";
+    string update = trim(update_json);
+    if (update.size() < 2 || update.front() != '{' || update.back() != '}')
+        throw invalid_argument("UPDATE ожидает объект с $set/$unset/$inc");
 
-    // проход по все бакетам
-    for (size_t i = 0; i < data_store.getCapacity(); ++i)
-    {
-        ListNode *current = data_store.getBucketHead(i);
-        while (current)
-        {
-            Document *doc = current->value;
-            if (match_document(doc, query_json))
-            {
-                out << doc->serialize() << "\n";
-                found_count++;
-            }
-            current = current->next;
-        }
-    }
+    myarray set_keys, set_values;
+    myarray unset_keys, unset_values;
+    myarray inc_keys, inc_values;
 
-    out << "Найдено документов: " << found_count << "\n";
-}   
-
-void MiniDBMS::findQueryToJsonArray(const string& query_json, string& out_array_json, size_t& out_count) // вывод в JSON-массив
-{
-    std::string q = trim(query_json);
-    if (q.empty())
+    size_t pos = 1;
+    while (pos < update.size() - 1)
     {
-        q = "{}";
-    }
-
-    out_array_json.clear();
-    out_array_json.push_back('[');
-
-    bool first = true;
-    out_count = 0U;
+        size_t key_start = update.find('"', pos);
+        if (key_start == string::npos)
+            break;
+        size_t key_end = update.find('"', key_start + 1);
+        if (key_end == string::npos)
+            throw invalid_argument("Некорректный UPDATE");
+        string op = update.substr(key_start + 1, key_end - key_start - 1);
+
+        size_t obj_start = update.find_first_not_of(" \t\n\r:", key_end + 1);
+        size_t obj_end = findMatchingBracket(update, obj_start == string::npos ? update.size() : obj_start);
+        if (obj_end == string::npos)
+            throw invalid_argument("Оператор " + op + " ожидает объект");
+        string body = update.substr(obj_start, obj_end - obj_start + 1);
+
+        bool ok = false;
+        if (op == "$set")
+            ok = parse_flat_object(body, set_keys, set_values);
+        else if (op == "$unset")
+            ok = parse_flat_object(body, unset_keys, unset_values);
+        else if (op == "$inc")
+            ok = parse_flat_object(body, inc_keys, inc_values);
+        else
+            throw invalid_argument("Неизвестный оператор обновления: " + op);
 
-    const std::size_t cap = data_store.getCapacity();
-    for (std::size_t i = 0; i < cap; ++i)
-    {
-        ListNode* node = data_store.getBucketHead(i); // проход по цепочке
-        while (node != nullptr)
-        {
-            Document* doc = node->value;
-            if (doc != nullptr && match_document(doc, q))
-            {
-                if (!first)
-                {
-                    out_array_json.push_back(',');
-                }
-                out_array_json += doc->serialize();
-                first = false;
-                ++out_count;
-            }
-            node = node->next;
-        }
+        if (!ok)
+            throw invalid_argument("Некорректное значение для " + op);
+        pos = obj_end + 1;
     }
 
-    out_array_json.push_back(']');
-}
+    if (set_keys.getSize() + unset_keys.getSize() + inc_keys.getSize() == 0)
+        throw invalid_argument("UPDATE без $set/$unset/$inc");
 
-// поиск документов по условию
-void MiniDBMS::handle_find(const string &query_json)
-{
-    findQueryToStream(query_json, cout);
-}
-
-size_t MiniDBMS::deleteQuery(const std::string &query_json){
-    size_t deleted_count = 0;
-
-    myarray ids_to_delete;
-
-    // сначала собираем id всех подходящих документов
-    for (size_t i = 0; i < data_store.getCapacity(); ++i)
+    for (size_t i = 0; i < set_keys.getSize(); i++)
+        if (set_keys[i] == "_id")
+            throw invalid_argument("Поле _id изменять нельзя");
+    for (size_t i = 0; i < unset_keys.getSize(); i++)
+        if (unset_keys[i] == "_id")
+            throw invalid_argument("Поле _id изменять нельзя");
+    for (size_t i = 0; i < inc_keys.getSize(); i++)
     {
-        ListNode *current = data_store.getBucketHead(i);
-        while (current)
-        {
-            Document *doc = current->value;
-            if (match_document(doc, query_json))
-            {
-                ids_to_delete.push(current->key); // ключ = _id
-            }
-            current = current->next;
-        }
+        if (inc_keys[i] == "_id")
+            throw invalid_argument("Поле _id изменять нельзя");
+        long long inc = 0;
+        if (!parse_int64(inc_values[i], inc))
+            throw invalid_argument("$inc ожидает целое число в диапазоне int64 для поля " + inc_keys[i]);
     }
 
-    // потом удаляем их по одному
-    for (size_t i = 0; i < ids_to_delete.getSize(); ++i)
+    QueryParams bound = params ? QueryParams(*params) : QueryParams();
+    shared_ptr<const CompiledQuery> query = compile_query(query_json, bound, stats);
+
+    // опубликованный документ не меняется: правим копию и кладём её новой версией.
+    // Сначала собираем все новые версии и только потом публикуем: ошибка $inc
+    // на любом документе не должна оставить часть документов изменёнными
+    string key;
+    bool point = query->pointLookupKey(bound, key);
+    WriteScope write = point ? WriteScope(*this, key, stats) : WriteScope(*this, stats);
+    PendingVersions pending;
+    for_each_match(*query, bound, write.getVersion(), [&](Document *old_doc)
+                   {
+                       pending.docs.push(old_doc->clone());
+                       Document *doc = pending.docs.items[pending.docs.size - 1];
+                       // изменённым считается документ, у которого что-то действительно поменялось:
+                       // $set того же значения и $unset отсутствующего поля версию не создают
+                       bool changed = false;
+                       for (size_t k = 0; k < set_keys.getSize(); k++)
+                       {
+                           string current;
+                           if (doc->getField(set_keys[k], current) && current == set_values[k])
+                               continue;
+                           doc->addField(set_keys[k], set_values[k]);
+                           changed = true;
+                       }
+                       for (size_t k = 0; k < unset_keys.getSize(); k++)
+                           if (doc->removeField(unset_keys[k]))
+                               changed = true;
+                       for (size_t k = 0; k < inc_keys.getSize(); k++)
+                       {
+                           string old_value = "0"; // отсутствующее поле считаем нулём
+                           bool present = doc->getField(inc_keys[k], old_value);
+                           if (!is_integer_string(old_value))
+                               continue; // нечисловое поле не трогаем
+                           long long old_number = 0, inc = 0, sum = 0;
+                           parse_int64(inc_values[k], inc); // проверено до прохода
+                           if (!parse_int64(old_value, old_number))
+                               throw invalid_argument("$inc: значение поля " + inc_keys[k] + " документа " + doc->_id +
+                                                      " вне диапазона int64");
+                           if (__builtin_add_overflow(old_number, inc, &sum))
+                               throw invalid_argument("$inc: переполнение поля " + inc_keys[k] + " документа " + doc->_id);
+                           if (present && sum == old_number && to_string(sum) == trim(old_value))
+                               continue; // $inc 0 - значение то же
+                           doc->addField(inc_keys[k], to_string(sum));
+                           changed = true;
+                       }
+                       if (!changed)
+                       {
+                           // ничего не поменялось: новой версии нет, документ не считается
+                           delete doc;
+                           pending.docs.size--;
+                       } },
+                   stats);
+
+    for (size_t i = 0; i < pending.docs.size; i++)
     {
-        string id = ids_to_delete[i];
-        Document *removed_doc = data_store.remove(id);
-        if (removed_doc)
-        {
-            delete removed_doc;
-            deleted_count++;
-        }
+        Document *doc = pending.docs.items[i];
+        pending.docs.items[i] = nullptr; // дальше документ принадлежит хранилищу
+        data_store.put(doc->_id, doc, write.getVersion());
     }
-
-    return deleted_count;
+    return pending.docs.size;
 }
+
 // удаление документов по условию
 void MiniDBMS::handle_delete(const string &query_json)
 {
-    cout <<"INFO:Начало удаления документов...\n" <<query_json <<endl;
-    size_t deleted_count = deleteQuery(query_json);  
-    cout << "Документ удален:" << deleted_count << endl; 
+    LOG_INFO("INFO:Начало удаления документов...\n" << query_json);
+    size_t deleted_count = deleteQuery(query_json);
+    LOG_INFO("Документ удален:" << deleted_count);
 }
 
 
@@ -1,30 +1,52 @@
 #pragma once
 
 #include <string>
+#include <atomic>
 #include <iosfwd>
+#include <memory>
+#include <mutex>
 #include "custom_hashmap.h"
 #include "document.h"
+#include "protocol.h"
+#include "plan_cache.h"
+#include "query.h"
+#include "result_cache.h"
+#include "rwlock.h"
+#include "snapshot.h"
 #include "utills.h"
 
+// чтения идут без блокировок по снимку (MVCC); точечные записи (один _id) разных
+// ключей идут параллельно, записи по всей базе - по одной (см. WriteScope)
 class MiniDBMS
 {
 private:
+
     std::string db_name;      // название файла
     std::string db_folder;    // название папки
     CustomHashMap data_store; // memory память
-    long long next_id;        // счетчик для айди
+    std::atomic<long long> next_id; // счетчик для айди
+    PlanCache plan_cache;     // разобранные запросы (LRU)
+    ResultCache result_cache; // готовые ответы FIND (по умолчанию выключен)
+    SnapshotRegistry snapshots; // опубликованная версия данных + активные снимки читателей
+    RWLock write_mode;        // точечные записи - общий доступ, записи по всей базе - исключительный
+    std::mutex save_mtx;      // файл пишет один поток
+    unsigned long long saved_version; // версия, которая уже лежит на диске
+    bool uring_writes;        // снимок на диск через io_uring (UringFileWriter)
 
     std::string generate_id();
+    // версия, на которой данные снимка стали такими, какие они есть: записи
+    // без изменений публикуют версии, но ни кеш, ни файл из-за них не устаревают
+    unsigned long long data_version(unsigned long long snapshot_version) const;
+    void store_new(Document *doc); // публикация нового _id (владение переходит базе)
+    void collect_garbage();
     std::string get_collection_path() const;
 
-    bool is_integer_string(const std::string &s);
-    bool like_match(const std::string &value, const std::string &pattern);
-    bool match_query_value(const std::string &doc_value_raw, const std::string &query_value_obj);
-
-    bool handle_or_query(const Document *doc, const std::string &query_json);
-    bool match_and_query(const Document *doc, const std::string &query_json);
-    bool handle_and_query(const Document *doc, const std::string &query_json);
-    bool match_document(const Document *doc, const std::string &query_json);
+    // разобранный запрос из кеша + проверка числа параметров
+    std::shared_ptr<const CompiledQuery> compile_query(const std::string &query_json, const QueryParams &params, QueryStats *stats = nullptr);
+    // обход подходящих документов по выбранному плану (точечно по _id или полный проход)
+    // snapshot - версия, по которой читаем (у писателя - его ещё не опубликованная версия)
+    template <typename Visitor>
+    void for_each_match(const CompiledQuery &query, const QueryParams &params, unsigned long long snapshot, Visitor visit, QueryStats *stats = nullptr);
 
     void handle_find(const std::string &query_json);
     void handle_delete(const std::string &query_json);
@@ -34,12 +56,69 @@ public:
     ~MiniDBMS();
 
     void loadFromDisk();
-    void saveToDisk();
+    // false - файл не записан (ошибка уже в журнале), изменения остаются только в памяти
+    bool saveToDisk();
+
+    // одна запись = одна новая версия, читатели видят её целиком после выхода из области.
+    // Запись одного ключа держит только полосу этого ключа, запись по всей базе -
+    // исключительный режим; вложенные области (вставки внутри пачки) идут в версию внешней
+    class WriteScope
+    {
+    private:
+        MiniDBMS &db;
+        WriteScope *outer; // внешняя область этого потока
+        unsigned long long version;
+        bool exclusive;
+        bool nested;
+        std::mutex *stripe; // полоса ключа для точечной записи
+
+        void begin(const std::string *key, QueryStats *stats);
+
+    public:
+        explicit WriteScope(MiniDBMS &db, QueryStats *stats = nullptr);                // вся база
+        WriteScope(MiniDBMS &db, const std::string &key, QueryStats *stats = nullptr); // один _id
+        ~WriteScope();
+        WriteScope(const WriteScope &) = delete;
+        WriteScope &operator=(const WriteScope &) = delete;
+
+        unsigned long long getVersion() const;
+        bool isExclusive() const;
+    };
 
     void insertQuery(const std::string &query_json);
+    void insertDocument(Document *doc); // _id присваивается заново, документ переходит базе
+    // пачка документов одной версией: таблица растёт один раз под всю пачку, _id - подряд.
+    // Документы переходят базе
+    void insertDocuments(Document **docs, std::size_t count);
+    // JSON-массив объектов за один проход без промежуточных строк; битый документ не
+    // вставит ничего (invalid_argument). Возвращает число вставленных
+    std::size_t insertMany(const std::string &array_json);
     void findQueryToStream(const std::string &query_json, std::ostream &out);
-    std::size_t deleteQuery(const std::string &query_json);
-    void findQueryToJsonArray(const std::string& query_json, std::string& out_array_json, std::size_t& out_count);
+    // params - значения для '?' в подготовленном запросе, stats - сбор отчёта EXPLAIN
+    std::size_t deleteQuery(const std::string &query_json, const myarray *params = nullptr, QueryStats *stats = nullptr);
+    std::size_t updateQuery(const std::string &query_json, const std::string &update_json, const myarray *params = nullptr, QueryStats *stats = nullptr);
+    void findQueryToJsonArray(const std::string& query_json, std::string& out_array_json, std::size_t& out_count, const myarray *params = nullptr, QueryStats *stats = nullptr);
+    // найденные документы в бинарном виде (binary_protocol.h) подряд в out
+    void findQueryToBinary(const std::string &query_json, std::string &out, std::size_t &out_count, QueryStats *stats = nullptr);
+    // число подходящих документов без сериализации
+    std::size_t countQuery(const std::string &query_json, const myarray *params = nullptr, QueryStats *stats = nullptr);
+
+    // разбирает запрос заранее (кладёт в кеш), возвращает число параметров '?'
+    int prepareQuery(const std::string &query_json);
+    const PlanCache &getPlanCache() const;
+
+    // бюджет кеша результатов FIND в байтах, 0 - выключить
+    void setResultCacheBudget(std::size_t bytes);
+    const ResultCache &getResultCache() const;
+
+    // писать файл базы через io_uring (зарегистрированные буферы) вместо ofstream
+    void setUringWrites(bool enabled);
+
+    // сколько база занимает в памяти: все версии документов, таблица и кеш результатов
+    std::size_t memoryUsage() const;
+    // для статистики сервера: живые документы (без удалённых) и заполненность хэш-таблицы
+    std::size_t documentCount() const;
+    double loadFactor();
 
     void run(const std::string &command, const std::string &query_json);
 };
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "myarray.h"
+#include "utills.h"
 
 using namespace std;
 
@@ -41,10 +42,31 @@ void myarray::push(const std::string &value)
     data[size] = value;
     size++;
 }
+void myarray::erase(size_t index)
+{
+    if (index >= size)
+        return;
+    for (size_t i = index + 1; i < size; i++)
+    {
+        data[i - 1].swap(data[i]);
+    }
+    size--;
+    data[size].clear();
+}
 size_t myarray::getSize() const
 {
     return size;
 }
+
+size_t myarray::memoryUsage() const
+{
+    size_t bytes = capacity * sizeof(string);
+    for (size_t i = 0; i < size; i++)
+    {
+        bytes += stringHeapBytes(data[i]);
+    }
+    return bytes;
+}
 string &myarray::operator[](size_t index)
 {
     return data[index];
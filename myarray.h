@@ -15,7 +15,9 @@ public:
     myarray(size_t initial_capacity = 10);
     ~myarray();
     void push(const std::string &value);
+    void erase(size_t index); // удаление элемента со сдвигом хвоста
     size_t getSize() const;
+    size_t memoryUsage() const; // массив строк + их содержимое в куче
     std::string &operator[](size_t index);
     const std::string &operator[](size_t index) const;
 };
\ No newline at end of file
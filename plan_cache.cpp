@@ -0,0 +1,139 @@
+#include "plan_cache.h"
+
+using namespace std;
+
+PlanCache::PlanCache(size_t capacity)
+    : lru_head(nullptr), lru_tail(nullptr), size(0), capacity(capacity == 0 ? 1 : capacity), hits(0), misses(0)
+{
+    for (size_t i = 0; i < BUCKETS; i++)
+    {
+        buckets[i] = nullptr;
+    }
+}
+
+PlanCache::~PlanCache()
+{
+    Entry *current = lru_head;
+    while (current)
+    {
+        Entry *next = current->next;
+        delete current;
+        current = next;
+    }
+}
+
+size_t PlanCache::bucket_of(const string &key) const
+{
+    size_t hash_value = 0;
+    for (unsigned char c : key)
+    {
+        hash_value = hash_value * 31 + c;
+    }
+    return hash_value % BUCKETS;
+}
+
+void PlanCache::unlink_lru(Entry *e)
+{
+    if (e->prev)
+        e->prev->next = e->next;
+    else
+        lru_head = e->next;
+    if (e->next)
+        e->next->prev = e->prev;
+    else
+        lru_tail = e->prev;
+    e->prev = nullptr;
+    e->next = nullptr;
+}
+
+void PlanCache::push_front(Entry *e)
+{
+    e->prev = nullptr;
+    e->next = lru_head;
+    if (lru_head)
+        lru_head->prev = e;
+    lru_head = e;
+    if (!lru_tail)
+        lru_tail = e;
+}
+
+void PlanCache::evict_last()
+{
+    Entry *victim = lru_tail;
+    if (!victim)
+        return;
+    unlink_lru(victim);
+
+    // вырезаем из цепочки бакета
+    Entry **link = &buckets[bucket_of(victim->key)];
+    while (*link && *link != victim)
+    {
+        link = &(*link)->hash_next;
+    }
+    if (*link)
+        *link = victim->hash_next;
+
+    delete victim; // план живёт, пока им пользуется хоть один запрос (shared_ptr)
+    size--;
+}
+
+shared_ptr<const CompiledQuery> PlanCache::get(const string &query_json, bool *was_hit)
+{
+    string key = normalize_query(query_json);
+    size_t index = bucket_of(key);
+
+    {
+        lock_guard<mutex> lock(mtx);
+        for (Entry *e = buckets[index]; e; e = e->hash_next)
+        {
+            if (e->key == key)
+            {
+                hits++;
+                unlink_lru(e);
+                push_front(e);
+                if (was_hit)
+                    *was_hit = true;
+                return e->plan;
+            }
+        }
+        misses++;
+    }
+
+    // разбор делаем без блокировки - другие запросы не ждут
+    shared_ptr<const CompiledQuery> plan = make_shared<CompiledQuery>(key);
+    if (was_hit)
+        *was_hit = false;
+
+    lock_guard<mutex> lock(mtx);
+    for (Entry *e = buckets[index]; e; e = e->hash_next)
+    {
+        if (e->key == key)
+            return e->plan; // кто-то успел раньше
+    }
+    if (size >= capacity)
+        evict_last();
+
+    Entry *entry = new Entry{key, plan, nullptr, nullptr, buckets[index]};
+    buckets[index] = entry;
+    push_front(entry);
+    size++;
+    return plan;
+}
+
+size_t PlanCache::getSize() const
+{
+    lock_guard<mutex> lock(mtx);
+    return size;
+}
+
+size_t PlanCache::getHits() const
+{
+    lock_guard<mutex> lock(mtx);
+    return hits;
+}
+
+size_t PlanCache::getMisses() const
+{
+    lock_guard<mutex> lock(mtx);
+    return misses;
+}
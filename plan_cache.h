@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include "query.h"
+
+// LRU-кеш разобранных запросов: ключ - нормализованный текст запроса
+class PlanCache
+{
+private:
+    struct Entry
+    {
+        std::string key;
+        std::shared_ptr<const CompiledQuery> plan;
+        Entry *prev;       // LRU-список (голова - самый свежий)
+        Entry *next;
+        Entry *hash_next;  // цепочка в бакете
+    };
+
+    static const size_t BUCKETS = 256;
+
+    Entry *buckets[BUCKETS];
+    Entry *lru_head;
+    Entry *lru_tail;
+    size_t size;
+    size_t capacity;
+    size_t hits;
+    size_t misses;
+    mutable std::mutex mtx;
+
+    size_t bucket_of(const std::string &key) const;
+    void unlink_lru(Entry *e);
+    void push_front(Entry *e);
+    void evict_last();
+
+public:
+    explicit PlanCache(size_t capacity = 128);
+    ~PlanCache();
+    PlanCache(const PlanCache &) = delete;
+    PlanCache &operator=(const PlanCache &) = delete;
+
+    // найти или разобрать запрос; was_hit - был ли он уже в кеше
+    std::shared_ptr<const CompiledQuery> get(const std::string &query_json, bool *was_hit = nullptr);
+
+    size_t getSize() const;
+    size_t getHits() const;
+    size_t getMisses() const;
+};
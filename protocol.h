@@ -6,9 +6,38 @@
 struct Request
 { 
     std::string database; // имя базы данных
-    std::string operation; // "insert", "find", "delete"
-    std::string data_json; // данные для вставки (только для insert)
+    std::string operation; // "insert", "import", "save", "find", "delete", "update", "prepare", "execute"
+    std::string data_json; // данные для вставки (insert) или модификаторы $set/$unset/$inc (update)
     std::string query_json; // уловия
+
+    std::string command;     // prepare: какую операцию готовим (find/delete/update)
+    std::string statement;   // execute: номер подготовленного запроса
+    std::string params_json; // значения для '?' в запросе: [30,"Alice"]
+
+    bool explain = false;    // вернуть план и статистику выполнения
+    bool persist = true;     // false - запись без saveToDisk: файл пишет вызывающий (пакетный режим local_cli)
+};
+
+// отчёт EXPLAIN: как выполнялся запрос и куда ушло время
+struct QueryStats
+{
+    // false - только счётчики и путь доступа (медленный журнал на каждом запросе),
+    // без замеров времени по стадиям, которые EXPLAIN делает на каждом документе
+    bool timings = true;
+
+    std::string access_path;       // FULL_SCAN / ID_LOOKUP / RESULT_CACHE
+    bool plan_cache_hit = false;   // разобранный запрос взят из кеша
+    std::size_t docs_examined = 0; // сколько документов проверено
+    std::size_t docs_matched = 0;
+
+    long long parse_ns = 0;        // разбор запроса (или поиск в кеше планов)
+    long long scan_ns = 0;         // обход хэш-таблицы
+    long long match_ns = 0;        // проверка условий
+    long long serialize_ns = 0;    // сборка JSON результата
+    long long lock_wait_ns = 0;    // ожидание блокировки базы (заполняет сервер)
+    long long total_ns = 0;
+
+    std::size_t bytes_out = 0;     // размер data в ответе
 };
 
 struct Response
@@ -18,4 +47,7 @@ struct Response
     std::size_t count = 0; // количество найденных/удаленных документов
 
     std::string data; // найденные данные в формате JSON (для find)
+
+    bool has_stats = false; // запрос был с explain
+    QueryStats stats;
 };
@@ -0,0 +1,947 @@
+#include "query.h"
+#include "utills.h"
+
+#include <string>
+
+using namespace std;
+
+QueryValue::QueryValue() : param(-1), is_int(false), int_ok(false), num(0), next(nullptr) {}
+
+// проверка есть ли в строке цифры или + -
+bool is_integer_string(const string &s)
+{
+    string t = trim(s);
+    if (t.empty())
+        return false;
+    size_t i = 0;
+    if (t[0] == '+' || t[0] == '-')
+    {
+        if (t.size() == 1)
+            return false;
+        i = 1;
+    }
+    for (; i < t.size(); i++)
+    {
+        if (t[i] < '0' || t[i] > '9')
+            return false;
+    }
+    return true;
+}
+
+void QueryValue::set(const string &raw)
+{
+    text = trim(raw);
+    is_int = is_integer_string(text);
+    int_ok = false;
+    num = 0;
+    if (is_int)
+    {
+        try
+        {
+            num = stoll(text);
+            int_ok = true;
+        }
+        catch (...)
+        {
+            int_ok = false; // переполнение - сравнение даст false
+        }
+    }
+}
+
+FieldCondition::FieldCondition()
+    : valid(true), implicit_eq(false), has_eq(false), has_gt(false), has_lt(false),
+      has_like(false), has_in(false), in_values(nullptr), next(nullptr) {}
+
+FieldCondition::~FieldCondition()
+{
+    QueryValue *current = in_values;
+    while (current)
+    {
+        QueryValue *next_value = current->next;
+        delete current;
+        current = next_value;
+    }
+}
+
+QueryNode::QueryNode(QueryNodeKind k) : kind(k), conditions(nullptr), children(nullptr), next(nullptr) {}
+
+QueryNode::~QueryNode()
+{
+    FieldCondition *cond = conditions;
+    while (cond)
+    {
+        FieldCondition *next_cond = cond->next;
+        delete cond;
+        cond = next_cond;
+    }
+    QueryNode *child = children;
+    while (child)
+    {
+        QueryNode *next_child = child->next;
+        delete child;
+        child = next_child;
+    }
+}
+
+QueryParams::QueryParams() : values(nullptr), count(0) {}
+
+QueryParams::QueryParams(const myarray &raw) : values(nullptr), count(raw.getSize())
+{
+    if (count > 0)
+    {
+        values = new QueryValue[count];
+        for (size_t i = 0; i < count; i++)
+        {
+            values[i].set(raw[i]);
+        }
+    }
+}
+
+QueryParams::~QueryParams()
+{
+    delete[] values;
+}
+
+size_t QueryParams::getCount() const
+{
+    return count;
+}
+
+const QueryValue *QueryParams::get(int index) const
+{
+    if (index < 0 || static_cast<size_t>(index) >= count)
+        return nullptr;
+    return &values[index];
+}
+
+static bool like_match_impl(const string &value, const string &pattern, size_t i, size_t j)
+{ // patern - шаблон поиска
+    if (j == pattern.size())
+    {
+        return i == value.size();
+    }
+    char pc = pattern[j]; // текуший символ
+    if (pc == '%')        // любой
+    {
+        return like_match_impl(value, pattern, i, j + 1) ||
+               (i < value.size() && like_match_impl(value, pattern, i + 1, j));
+    }
+    if (pc == '_') //  один символ
+    {
+        return (i < value.size() &&
+                like_match_impl(value, pattern, i + 1, j + 1));
+    }
+    // Обычный символ – должен совпасть по значению
+    return (i < value.size() &&
+            value[i] == pc &&
+            like_match_impl(value, pattern, i + 1, j + 1));
+}
+
+bool like_match(const string &value, const string &pattern)
+{
+    return like_match_impl(value, pattern, 0, 0);
+}
+
+static bool is_structural(char c)
+{
+    return c == '{' || c == '}' || c == '[' || c == ']' || c == ':' || c == ',';
+}
+
+static bool is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+string normalize_query(const string &query_json)
+{
+    string s = trim(query_json);
+    string out;
+    out.reserve(s.size());
+
+    bool in_string = false;
+    size_t i = 0;
+    while (i < s.size())
+    {
+        char c = s[i];
+        if (c == '"')
+        {
+            in_string = !in_string;
+        }
+        if (!in_string && is_space(c))
+        {
+            size_t j = i;
+            while (j < s.size() && is_space(s[j]))
+                ++j;
+            bool drop = out.empty() || j == s.size() || is_structural(out.back()) || is_structural(s[j]);
+            if (!drop)
+            {
+                out.append(s, i, j - i); // пробел внутри литерала оставляем как есть
+            }
+            i = j;
+            continue;
+        }
+        out.push_back(c);
+        ++i;
+    }
+    return out.empty() ? string("{}") : out;
+}
+
+// конец литерала, начинающегося в s[i]: строка в кавычках или всё до , } ]
+static size_t skip_literal(const string &s, size_t i)
+{
+    if (s[i] == '"')
+    {
+        ++i;
+        while (i < s.size() && s[i] != '"')
+        {
+            i += (s[i] == '\\') ? 2 : 1;
+        }
+        return i < s.size() ? i + 1 : s.size();
+    }
+    while (i < s.size() && s[i] != ',' && s[i] != '}' && s[i] != ']')
+    {
+        ++i;
+    }
+    return i;
+}
+
+string query_shape(const string &query_json)
+{
+    string s = normalize_query(query_json);
+    string out;
+    out.reserve(s.size());
+    string open; // стек открытых скобок: значение - после ':' в объекте или любой элемент массива
+
+    size_t i = 0;
+    while (i < s.size())
+    {
+        char c = s[i];
+        if (c == '{' || c == '[')
+        {
+            open.push_back(c);
+            out.push_back(c);
+            ++i;
+            continue;
+        }
+        if (c == '}' || c == ']')
+        {
+            if (!open.empty())
+                open.pop_back();
+            out.push_back(c);
+            ++i;
+            continue;
+        }
+        if (c == ':' || c == ',')
+        {
+            out.push_back(c);
+            ++i;
+            continue;
+        }
+
+        bool in_array = !open.empty() && open.back() == '[';
+        bool value = !out.empty() && (out.back() == ':' || (in_array && (out.back() == '[' || out.back() == ',')));
+        size_t end = skip_literal(s, i);
+        if (!value)
+        {
+            out.append(s, i, end - i); // ключ или разделитель - как есть
+        }
+        else if (in_array && out.size() >= 2 && out.back() == ',' && out[out.size() - 2] == '?')
+        {
+            out.pop_back(); // [?,?,?] -> [?]: длина списка на форму не влияет
+        }
+        else
+        {
+            out.push_back('?');
+        }
+        i = end;
+    }
+    return out;
+}
+
+// заменяет параметры '?' вне строк на ?0, ?1 ... в порядке появления в тексте
+static string number_placeholders(const string &query, int &param_count)
+{
+    string out;
+    out.reserve(query.size() + 8);
+    bool in_string = false;
+    for (size_t i = 0; i < query.size(); ++i)
+    {
+        char c = query[i];
+        if (c == '"')
+            in_string = !in_string;
+        if (!in_string && c == '?')
+        {
+            char before = (i == 0) ? '{' : query[i - 1];
+            char after = (i + 1 < query.size()) ? query[i + 1] : '}';
+            if ((before == ':' || before == '[' || before == ',') &&
+                (after == ',' || after == '}' || after == ']'))
+            {
+                out += "?" + to_string(param_count);
+                param_count++;
+                continue;
+            }
+        }
+        out.push_back(c);
+    }
+    return out;
+}
+
+// значение условия: "?N" без кавычек - параметр, иначе литерал
+static void set_query_value(QueryValue &v, const string &raw, bool quoted)
+{
+    string t = trim(raw);
+    if (!quoted && t.size() >= 2 && t[0] == '?' && is_integer_string(t.substr(1)))
+    {
+        v.param = stoi(t.substr(1));
+        v.text.clear();
+        return;
+    }
+    v.set(t);
+}
+
+static void compile_condition(FieldCondition *cond, const string &query_value_obj)
+{
+    string trimmed_query = trim(query_value_obj);
+
+    if (trimmed_query.empty())
+    {
+        cond->valid = false;
+        return;
+    }
+
+    if (trimmed_query.front() != '{')
+    { // неявное равенство
+        bool quoted = false;
+        if (trimmed_query.length() >= 2 && trimmed_query.front() == '"' && trimmed_query.back() == '"')
+        {
+            trimmed_query = trimmed_query.substr(1, trimmed_query.length() - 2);
+            quoted = true;
+        }
+        cond->implicit_eq = true;
+        set_query_value(cond->eq, trimmed_query, quoted);
+        return;
+    }
+
+    // значение оператора: "$gt":20 или "$like":"A%"
+    auto extract_operator_value = [&](const string &op_key, QueryValue &out) -> bool
+    {
+        string op_search = "\"" + op_key + "\":";
+        size_t pos = trimmed_query.find(op_search);
+        if (pos == string::npos)
+            return false;
+
+        size_t start_search = pos + op_search.length();
+        size_t start_val = trimmed_query.find_first_not_of(" \t\n\r", start_search);
+        if (start_val == string::npos)
+            return false;
+
+        string raw;
+        bool quoted = false;
+        if (trimmed_query[start_val] == '"')
+        {
+            size_t start_content = start_val + 1;
+            size_t end_content = trimmed_query.find('"', start_content);
+            if (end_content == string::npos)
+                return false;
+            raw = trim(trimmed_query.substr(start_content, end_content - start_content));
+            quoted = true;
+        }
+        else
+        {
+            size_t end_val = trimmed_query.find_first_of(",}", start_val);
+            if (end_val == string::npos)
+                return false;
+            raw = trim(trimmed_query.substr(start_val, end_val - start_val));
+        }
+        if (raw.empty())
+            return false; // пустое значение - оператор игнорируется
+        set_query_value(out, raw, quoted);
+        return true;
+    };
+
+    cond->has_eq = extract_operator_value("$eq", cond->eq);
+    cond->has_gt = extract_operator_value("$gt", cond->gt);
+    cond->has_lt = extract_operator_value("$lt", cond->lt);
+    cond->has_like = extract_operator_value("$like", cond->like);
+
+    string in_search = "\"$in\":";
+    size_t in_pos = trimmed_query.find(in_search);
+    if (in_pos != string::npos)
+    {
+        cond->has_in = true;
+
+        size_t array_start = trimmed_query.find('[', in_pos + in_search.length());
+        size_t array_end = (array_start == string::npos) ? string::npos : trimmed_query.find(']', array_start);
+        if (array_end == string::npos)
+        {
+            cond->valid = false;
+            return;
+        }
+
+        string array_content = trimmed_query.substr(array_start + 1, array_end - array_start - 1);
+
+        QueryValue *tail = nullptr;
+        size_t item_start = 0;
+        while (item_start < array_content.size())
+        {
+            size_t comma = array_content.find(',', item_start);
+            size_t item_end = (comma == string::npos) ? array_content.size() : comma;
+            string item = trim(array_content.substr(item_start, item_end - item_start));
+
+            bool quoted = false;
+            if (item.length() >= 2 && item.front() == '"' && item.back() == '"')
+            {
+                item = item.substr(1, item.length() - 2);
+                quoted = true;
+            }
+
+            QueryValue *value = new QueryValue();
+            set_query_value(*value, item, quoted);
+            if (tail)
+                tail->next = value;
+            else
+                cond->in_values = value;
+            tail = value;
+
+            item_start = item_end + 1;
+        }
+    }
+
+    if (!cond->has_eq && !cond->has_gt && !cond->has_lt && !cond->has_like && !cond->has_in)
+    {
+        // В объекте нет ни одного из известных операторов
+        cond->valid = false;
+    }
+}
+
+static QueryNode *compile_node(const string &query_json);
+
+// неявный AND: {"name":"Alice","age":{"$gt":20}}
+static QueryNode *compile_fields(const string &query)
+{
+    if (query.front() != '{' || query.back() != '}')
+        return new QueryNode(QUERY_NONE);
+
+    QueryNode *node = new QueryNode(QUERY_FIELDS);
+    FieldCondition *tail = nullptr;
+
+    string content = query.substr(1, query.length() - 2);
+    size_t current_pos = 0;
+
+    while (current_pos < content.length())
+    {
+        while (current_pos < content.size() && (is_space(content[current_pos]) || content[current_pos] == ','))
+            ++current_pos;
+        if (current_pos >= content.length())
+            break;
+
+        // имя поля
+        size_t start_key = content.find('"', current_pos);
+        if (start_key == string::npos)
+            break;
+        size_t end_key = content.find('"', start_key + 1);
+        if (end_key == string::npos)
+        {
+            delete node;
+            return new QueryNode(QUERY_NONE);
+        }
+        string field_name = content.substr(start_key + 1, end_key - start_key - 1);
+
+        size_t colon = content.find(':', end_key);
+        size_t val_start = (colon == string::npos) ? string::npos : content.find_first_not_of(" \t\n\r", colon + 1);
+        if (val_start == string::npos)
+        {
+            delete node;
+            return new QueryNode(QUERY_NONE);
+        }
+
+        // конец значения
+        size_t end_val = string::npos;
+        char first_char = content[val_start];
+        if (first_char == '{' || first_char == '[')
+        {
+            char close_char = (first_char == '{') ? '}' : ']';
+            int bracket_count = 0;
+            for (size_t i = val_start; i < content.length(); ++i)
+            {
+                if (content[i] == first_char)
+                    bracket_count++;
+                if (content[i] == close_char)
+                {
+                    bracket_count--;
+                    if (bracket_count == 0)
+                    {
+                        end_val = i;
+                        break;
+                    }
+                }
+            }
+        }
+        else if (first_char == '"')
+        {
+            end_val = content.find('"', val_start + 1);
+        }
+        else
+        {
+            size_t separator_pos = content.find_first_of(",}", val_start);
+            size_t boundary = (separator_pos == string::npos) ? content.length() : separator_pos;
+            end_val = boundary - 1;
+            while (end_val > val_start && (content[end_val] == ' ' || content[end_val] == '\t'))
+                end_val--;
+        }
+
+        if (end_val == string::npos || end_val < val_start)
+        {
+            delete node;
+            return new QueryNode(QUERY_NONE);
+        }
+
+        FieldCondition *cond = new FieldCondition();
+        cond->field = field_name;
+        compile_condition(cond, content.substr(val_start, end_val - val_start + 1));
+        if (tail)
+            tail->next = cond;
+        else
+            node->conditions = cond;
+        tail = cond;
+
+        current_pos = end_val + 1;
+    }
+
+    return node;
+}
+
+// {"$or": [ {...}, {...} ]} и {"$and": [ ... ]}
+static QueryNode *compile_logical(const string &query, const string &op, QueryNodeKind kind)
+{
+    string search_key = "\"" + op + "\":";
+    size_t pos = query.find(search_key);
+    if (pos == string::npos)
+        return new QueryNode(QUERY_NONE);
+
+    size_t array_start = query.find('[', pos + search_key.length());
+    size_t array_end = query.find_last_of(']');
+    if (array_start == string::npos || array_end == string::npos || array_end < array_start)
+        return new QueryNode(QUERY_NONE);
+
+    string array_content = query.substr(array_start + 1, array_end - array_start - 1);
+
+    QueryNode *node = new QueryNode(kind);
+    QueryNode *tail = nullptr;
+    size_t current_pos = 0;
+
+    while (current_pos < array_content.length())
+    {
+        size_t start_cond = array_content.find('{', current_pos);
+        if (start_cond == string::npos)
+            break;
+
+        size_t end_cond = start_cond;
+        int bracket_count = 0;
+        bool found_end = false;
+        while (end_cond < array_content.length())
+        {
+            if (array_content[end_cond] == '{')
+                bracket_count++;
+            if (array_content[end_cond] == '}')
+            {
+                bracket_count--;
+                if (bracket_count == 0)
+                {
+                    found_end = true;
+                    break;
+                }
+            }
+            end_cond++;
+        }
+
+        if (!found_end)
+        {
+            delete node;
+            return new QueryNode(QUERY_NONE);
+        }
+
+        // каждое подусловие - полноценный подзапрос (там может быть и $and, и $or)
+        QueryNode *child = compile_node(array_content.substr(start_cond, end_cond - start_cond + 1));
+        if (tail)
+            tail->next = child;
+        else
+            node->children = child;
+        tail = child;
+
+        current_pos = end_cond + 1;
+    }
+
+    if (!node->children)
+    {
+        // пустой список условий - документ не подходит
+        delete node;
+        return new QueryNode(QUERY_NONE);
+    }
+    return node;
+}
+
+static QueryNode *compile_node(const string &query_json)
+{
+    string query = trim(query_json);
+    if (query.empty() || query == "{}")
+        return new QueryNode(QUERY_ALL);
+
+    // если это объект смотрим на первый ключ
+    if (query.front() == '{')
+    {
+        size_t first_quote = query.find('"');
+        size_t second_quote = (first_quote == string::npos) ? string::npos : query.find('"', first_quote + 1);
+        if (second_quote != string::npos)
+        {
+            string first_key = query.substr(first_quote + 1, second_quote - first_quote - 1);
+            if (first_key == "$or")
+                return compile_logical(query, "$or", QUERY_OR);
+            if (first_key == "$and")
+                return compile_logical(query, "$and", QUERY_AND);
+        }
+    }
+
+    // по умолчанию - неявный AND
+    return compile_fields(query);
+}
+
+CompiledQuery::CompiledQuery(const string &query_json) : root(nullptr), param_count(0), id_key(nullptr)
+{
+    string numbered = number_placeholders(normalize_query(query_json), param_count);
+    root = compile_node(numbered);
+
+    // план: равенство по _id на верхнем уровне - достаточно одного get() вместо прохода
+    if (root->kind == QUERY_FIELDS)
+    {
+        for (FieldCondition *cond = root->conditions; cond; cond = cond->next)
+        {
+            if (cond->field == "_id" && cond->valid && (cond->implicit_eq || cond->has_eq))
+            {
+                id_key = &cond->eq;
+                break;
+            }
+        }
+    }
+}
+
+CompiledQuery::~CompiledQuery()
+{
+    delete root;
+}
+
+int CompiledQuery::getParamCount() const
+{
+    return param_count;
+}
+
+static const QueryValue *resolve(const QueryValue &v, const QueryParams &params)
+{
+    if (v.param < 0)
+        return &v;
+    return params.get(v.param);
+}
+
+bool CompiledQuery::pointLookupKey(const QueryParams &params, string &out_key) const
+{
+    if (!id_key)
+        return false;
+    const QueryValue *key = resolve(*id_key, params);
+    if (!key)
+        return false;
+    // числа сравниваются как int ("01" == "1"), поэтому по ключу ищем только каноничную запись
+    if (key->is_int && (!key->int_ok || to_string(key->num) != key->text))
+        return false;
+    out_key = key->text;
+    return true;
+}
+
+const char *CompiledQuery::accessPath() const
+{
+    return id_key ? "ID_LOOKUP" : "FULL_SCAN";
+}
+
+// значение поля документа, подготовленное для сравнений
+struct DocValue
+{
+    string text;
+    bool is_int;
+    bool int_ok;
+    long long num;
+};
+
+static void make_doc_value(const string &raw, DocValue &out)
+{
+    out.text = trim(raw);
+    out.is_int = is_integer_string(out.text);
+    out.int_ok = false;
+    if (out.is_int)
+    {
+        try
+        {
+            out.num = stoll(out.text);
+            out.int_ok = true;
+        }
+        catch (...)
+        {
+        }
+    }
+}
+
+enum CompareOp
+{
+    CMP_EQ,
+    CMP_GT,
+    CMP_LT
+};
+
+// если оба числа - сравниваем как int, иначе как строки
+static bool compare_value(const DocValue &d, const QueryValue &q, CompareOp op)
+{
+    if (d.is_int && q.is_int)
+    {
+        if (!d.int_ok || !q.int_ok)
+            return false;
+        switch (op)
+        {
+        case CMP_EQ:
+            return d.num == q.num;
+        case CMP_GT:
+            return d.num > q.num;
+        case CMP_LT:
+            return d.num < q.num;
+        }
+        return false;
+    }
+    switch (op)
+    {
+    case CMP_EQ:
+        return d.text == q.text;
+    case CMP_GT:
+        return d.text > q.text;
+    case CMP_LT:
+        return d.text < q.text;
+    }
+    return false;
+}
+
+static bool match_condition(const FieldCondition *cond, const DocValue &d, const QueryParams &params)
+{
+    if (!cond->valid)
+        return false;
+
+    if (cond->implicit_eq || cond->has_eq)
+    {
+        const QueryValue *v = resolve(cond->eq, params);
+        if (!v || !compare_value(d, *v, CMP_EQ))
+            return false;
+    }
+    if (cond->has_gt)
+    {
+        const QueryValue *v = resolve(cond->gt, params);
+        if (!v || !compare_value(d, *v, CMP_GT))
+            return false;
+    }
+    if (cond->has_lt)
+    {
+        const QueryValue *v = resolve(cond->lt, params);
+        if (!v || !compare_value(d, *v, CMP_LT))
+            return false;
+    }
+    if (cond->has_like)
+    {
+        const QueryValue *v = resolve(cond->like, params);
+        if (!v || !like_match(d.text, v->text))
+            return false;
+    }
+    if (cond->has_in)
+    {
+        bool in_result = false;
+        for (const QueryValue *item = cond->in_values; item && !in_result; item = item->next)
+        {
+            const QueryValue *v = resolve(*item, params);
+            if (v && compare_value(d, *v, CMP_EQ))
+                in_result = true;
+        }
+        if (!in_result)
+            return false;
+    }
+    return true;
+}
+
+static bool match_node(const QueryNode *node, const Document *doc, const QueryParams &params)
+{
+    switch (node->kind)
+    {
+    case QUERY_ALL:
+        return true;
+    case QUERY_NONE:
+        return false;
+    case QUERY_OR:
+        for (const QueryNode *child = node->children; child; child = child->next)
+        {
+            if (match_node(child, doc, params))
+                return true; // для $or достаточно одного совпадения
+        }
+        return false;
+    case QUERY_AND:
+        for (const QueryNode *child = node->children; child; child = child->next)
+        {
+            if (!match_node(child, doc, params))
+                return false;
+        }
+        return true;
+    case QUERY_FIELDS:
+        break;
+    }
+
+    DocValue d;
+    string raw;
+    for (const FieldCondition *cond = node->conditions; cond; cond = cond->next)
+    {
+        if (cond->field == "_id")
+        {
+            raw = doc->_id;
+        }
+        else if (!doc->getField(cond->field, raw))
+        {
+            return false; // поля нет - документ не удовлетворяет AND
+        }
+        make_doc_value(raw, d);
+        if (!match_condition(cond, d, params))
+            return false;
+    }
+    return true;
+}
+
+bool CompiledQuery::matches(const Document *doc, const QueryParams &params) const
+{
+    if (!doc)
+        return false;
+    return match_node(root, doc, params);
+}
+
+// содержимое строкового литерала s[from, to) без кавычек: \" \\ \/ \n \t \r \b \f и \uXXXX
+// (в UTF-8) заменяются символами - параметр сравнивается с данными, а не с записью JSON
+static bool unescape_json_string(const string &s, size_t from, size_t to, string &out)
+{
+    out.clear();
+    out.reserve(to - from);
+    for (size_t i = from; i < to; ++i)
+    {
+        if (s[i] != '\\')
+        {
+            out.push_back(s[i]);
+            continue;
+        }
+        if (++i >= to)
+            return false;
+        switch (s[i])
+        {
+        case '"':
+        case '\\':
+        case '/':
+            out.push_back(s[i]);
+            break;
+        case 'n':
+            out.push_back('\n');
+            break;
+        case 't':
+            out.push_back('\t');
+            break;
+        case 'r':
+            out.push_back('\r');
+            break;
+        case 'b':
+            out.push_back('\b');
+            break;
+        case 'f':
+            out.push_back('\f');
+            break;
+        case 'u':
+        {
+            if (i + 4 >= to)
+                return false;
+            unsigned code = 0;
+            for (size_t k = 1; k <= 4; ++k)
+            {
+                char h = s[i + k];
+                code <<= 4;
+                if (h >= '0' && h <= '9')
+                    code |= static_cast<unsigned>(h - '0');
+                else if (h >= 'a' && h <= 'f')
+                    code |= static_cast<unsigned>(h - 'a' + 10);
+                else if (h >= 'A' && h <= 'F')
+                    code |= static_cast<unsigned>(h - 'A' + 10);
+                else
+                    return false;
+            }
+            i += 4;
+            if (code < 0x80)
+            {
+                out.push_back(static_cast<char>(code));
+            }
+            else if (code < 0x800)
+            {
+                out.push_back(static_cast<char>(0xC0 | (code >> 6)));
+                out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+            }
+            else
+            {
+                out.push_back(static_cast<char>(0xE0 | (code >> 12)));
+                out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+                out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+            }
+            break;
+        }
+        default:
+            return false;
+        }
+    }
+    return true;
+}
+
+bool parse_params_array(const string &json, myarray &out)
+{
+    string s = trim(json);
+    if (s.empty())
+        return true;
+    if (s.size() < 2 || s.front() != '[' || s.back() != ']')
+        return false;
+
+    size_t i = 1;
+    const size_t end = s.size() - 1;
+    while (i < end)
+    {
+        while (i < end && (is_space(s[i]) || s[i] == ','))
+            ++i;
+        if (i >= end)
+            break;
+
+        if (s[i] == '"')
+        {
+            // конец строки - как в skip_literal: \x пропускается целиком
+            size_t val_end = skip_literal(s, i);
+            if (val_end > end || s[val_end - 1] != '"' || val_end - i < 2)
+                return false;
+            string value;
+            if (!unescape_json_string(s, i + 1, val_end - 1, value))
+                return false;
+            out.push(value);
+            i = val_end;
+        }
+        else if (s[i] == '{' || s[i] == '[')
+        {
+            return false;
+        }
+        else
+        {
+            size_t val_end = s.find(',', i);
+            if (val_end == string::npos || val_end > end)
+                val_end = end;
+            out.push(trim(s.substr(i, val_end - i)));
+            i = val_end;
+        }
+    }
+    return true;
+}
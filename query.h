@@ -0,0 +1,116 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+#include "document.h"
+#include "myarray.h"
+
+// одно значение из условия: литерал или параметр '?' подготовленного запроса
+struct QueryValue
+{
+    std::string text;
+    int param;         // номер параметра, -1 если это литерал
+    bool is_int;       // строка синтаксически целое число
+    bool int_ok;       // число влезло в long long
+    long long num;
+    QueryValue *next;  // следующий элемент для $in
+
+    QueryValue();
+    void set(const std::string &raw); // заполнение text/is_int/num
+};
+
+// условие на одно поле: "name":"Alice" или "age":{"$gt":20,"$lt":30}
+struct FieldCondition
+{
+    std::string field;
+    bool valid; // false - условие никогда не выполняется (нет известных операторов)
+
+    bool implicit_eq; // "name":"Alice"
+    bool has_eq;
+    bool has_gt;
+    bool has_lt;
+    bool has_like;
+    bool has_in;
+
+    QueryValue eq;
+    QueryValue gt;
+    QueryValue lt;
+    QueryValue like;
+    QueryValue *in_values; // список для $in
+
+    FieldCondition *next;
+
+    FieldCondition();
+    ~FieldCondition();
+};
+
+enum QueryNodeKind
+{
+    QUERY_ALL,    // {} - подходит всё
+    QUERY_NONE,   // кривой запрос - не подходит ничего
+    QUERY_FIELDS, // неявный AND по полям
+    QUERY_OR,
+    QUERY_AND
+};
+
+struct QueryNode
+{
+    QueryNodeKind kind;
+    FieldCondition *conditions; // для QUERY_FIELDS
+    QueryNode *children;        // для QUERY_OR / QUERY_AND
+    QueryNode *next;
+
+    QueryNode(QueryNodeKind k);
+    ~QueryNode();
+};
+
+// значения параметров для одного выполнения подготовленного запроса
+class QueryParams
+{
+private:
+    QueryValue *values;
+    size_t count;
+
+public:
+    QueryParams();
+    explicit QueryParams(const myarray &raw);
+    ~QueryParams();
+    QueryParams(const QueryParams &) = delete;
+    QueryParams &operator=(const QueryParams &) = delete;
+
+    size_t getCount() const;
+    const QueryValue *get(int index) const;
+};
+
+// запрос, разобранный один раз: дерево условий + выбранный план доступа
+class CompiledQuery
+{
+private:
+    QueryNode *root;
+    int param_count;
+    const QueryValue *id_key; // если задан - план "точечный поиск по _id"
+
+public:
+    explicit CompiledQuery(const std::string &query_json);
+    ~CompiledQuery();
+    CompiledQuery(const CompiledQuery &) = delete;
+    CompiledQuery &operator=(const CompiledQuery &) = delete;
+
+    bool matches(const Document *doc, const QueryParams &params) const;
+
+    int getParamCount() const;
+    // ключ для точечного поиска (пусто, если нужен полный проход)
+    bool pointLookupKey(const QueryParams &params, std::string &out_key) const;
+    const char *accessPath() const;
+};
+
+bool is_integer_string(const std::string &s);
+bool like_match(const std::string &value, const std::string &pattern);
+
+// убирает пробелы вокруг {}[]:, вне строк - одинаковые запросы дают одинаковый текст
+std::string normalize_query(const std::string &query_json);
+// форма запроса для журналов: значения заменены на ?, подряд идущие значения массива - одним ?
+// {"age":{"$gt":30},"city":{"$in":["A","B"]}} -> {"age":{"$gt":?},"city":{"$in":[?]}}
+std::string query_shape(const std::string &query_json);
+// разбор массива параметров [30,"Alice"] в строки
+bool parse_params_array(const std::string &json, myarray &out);
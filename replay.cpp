@@ -0,0 +1,450 @@
+// проигрывание захваченной нагрузки (db_server --capture) на живом сервере
+// сборка: g++ -std=c++17 -O2 -pthread replay.cpp capture.cpp async_log.cpp logger.cpp metrics.cpp line_reader.cpp -o replay
+// запуск:  replay <файл захвата> --port N [--host H] [--speed K|max] [--show N]
+// каждое захваченное соединение - своё соединение и поток; внутри соединения порядок
+// запросов исходный. --speed 1 - в исходном темпе, K - в K раз быстрее, max - без пауз.
+// Ответы сверяются с захваченными (статус, count, отпечаток), поэтому сервер
+// должен стартовать с тех же данных, что и при записи. Порядок между соединениями
+// держит только расписание: при --speed max запросы разных соединений могут
+// обогнать друг друга, и расхождения тогда ожидаемы
+#include "capture.h"
+#include "line_reader.h"
+#include "metrics.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+using namespace std;
+
+struct ReplayEntry
+{
+    CapturedRequest captured;
+    long long offset_ns; // от первого запроса захвата
+    size_t line_number;
+    ReplayEntry *next;
+};
+
+enum MismatchKind
+{
+    MISMATCH_STATUS,
+    MISMATCH_COUNT,
+    MISMATCH_BODY,
+    MISMATCH_KIND_COUNT
+};
+
+// одно захваченное соединение; статистику пишет только его поток
+struct ReplayConnection
+{
+    uint64_t id;
+    ReplayEntry *head;
+    ReplayEntry *tail;
+    size_t requests;
+
+    LatencyHistogram scheduled; // от момента по расписанию
+    LatencyHistogram raw;       // от фактической отправки
+    uint64_t completed;
+    uint64_t mismatches[MISMATCH_KIND_COUNT];
+    bool disconnected;
+
+    ReplayConnection *next;      // все соединения
+    ReplayConnection *hash_next; // цепочка в таблице по id
+
+    explicit ReplayConnection(uint64_t id)
+        : id(id), head(nullptr), tail(nullptr), requests(0), completed(0), disconnected(false),
+          next(nullptr), hash_next(nullptr)
+    {
+        for (int i = 0; i < MISMATCH_KIND_COUNT; i++)
+            mismatches[i] = 0;
+    }
+};
+
+static const size_t CONNECTION_BUCKETS = 4096;
+
+struct ReplayConfig
+{
+    string host = "127.0.0.1";
+    int port = 0;
+    double speed = 1.0; // 0 - без пауз
+    size_t show = 5;    // сколько расхождений напечатать
+};
+
+// первые расхождения для отчёта; общий список, но пишут в него редко
+static mutex g_examplesMutex;
+static size_t g_examplesShown = 0;
+
+static long long nowNs()
+{
+    return chrono::duration_cast<chrono::nanoseconds>(
+               chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+static void waitUntil(long long target_ns)
+{
+    const long long spin_ns = 200000;
+    long long now = nowNs();
+    if (target_ns - now > spin_ns)
+    {
+        this_thread::sleep_for(chrono::nanoseconds(target_ns - now - spin_ns));
+    }
+    while (nowNs() < target_ns)
+    {
+        this_thread::yield();
+    }
+}
+
+static int connectTo(const string &host, int port)
+{
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    if (inet_pton(AF_INET, host == "localhost" ? "127.0.0.1" : host.c_str(), &addr.sin_addr) <= 0)
+    {
+        cerr << "Invalid host/IP address: " << host << "\n";
+        return -1;
+    }
+    int sock = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0 || ::connect(sock, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0)
+    {
+        perror("connect");
+        if (sock >= 0)
+            close(sock);
+        return -1;
+    }
+    int one = 1;
+    ::setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return sock;
+}
+
+static bool sendAll(int sock, const string &data)
+{
+    size_t sent = 0;
+    while (sent < data.size())
+    {
+        ssize_t n = ::send(sock, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+static bool receiveLine(int sock, LineReader &reader, string_view &line)
+{
+    while (!reader.nextLine(line))
+    {
+        ssize_t n = reader.fill(sock);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+    }
+    return true;
+}
+
+// поля ответа сервера: {"status":"..","message":"..","count":N,...}
+static string responseStatus(string_view response)
+{
+    const string_view key = "{\"status\":\"";
+    if (response.compare(0, key.size(), key) != 0)
+        return string();
+    size_t end = response.find('"', key.size());
+    return string(response.substr(key.size(), end == string_view::npos ? 0 : end - key.size()));
+}
+
+static size_t responseCount(string_view response)
+{
+    size_t at = response.find("\"count\":");
+    return at == string_view::npos ? 0 : static_cast<size_t>(strtoull(response.data() + at + 8, nullptr, 10));
+}
+
+// ответы stats и trace зависят от момента, а не от данных
+static bool comparable(const string &operation)
+{
+    return operation != "stats" && operation != "trace";
+}
+
+static void reportMismatch(const ReplayEntry &entry, MismatchKind kind, const string &status,
+                           size_t count, const ReplayConfig &config)
+{
+    static const char *names[MISMATCH_KIND_COUNT] = {"status", "count", "body"};
+    lock_guard<mutex> lock(g_examplesMutex);
+    if (g_examplesShown >= config.show)
+        return;
+    g_examplesShown++;
+    cout << "[Replay] mismatch (" << names[kind] << ") at line " << entry.line_number << ": expected "
+         << entry.captured.status << "/" << entry.captured.count << ", got " << status << "/" << count
+         << ": " << entry.captured.request.substr(0, 200) << "\n";
+}
+
+static void replayConnection(ReplayConnection &connection, const ReplayConfig &config, long long start_ns)
+{
+    int sock = connectTo(config.host, config.port);
+    if (sock < 0)
+    {
+        connection.disconnected = true;
+        return;
+    }
+
+    LineReader reader;
+    string request;
+    for (ReplayEntry *entry = connection.head; entry; entry = entry->next)
+    {
+        long long intended_ns = nowNs();
+        if (config.speed > 0)
+        {
+            intended_ns = start_ns + static_cast<long long>(entry->offset_ns / config.speed);
+            waitUntil(intended_ns);
+        }
+
+        request = entry->captured.request;
+        request += '\n';
+        long long send_ns = nowNs();
+        string_view response;
+        if (!sendAll(sock, request) || !receiveLine(sock, reader, response))
+        {
+            connection.disconnected = true;
+            break;
+        }
+        long long done_ns = nowNs();
+
+        connection.scheduled.record(static_cast<uint64_t>(done_ns - intended_ns));
+        connection.raw.record(static_cast<uint64_t>(done_ns - send_ns));
+        connection.completed++;
+
+        if (!comparable(entry->captured.operation))
+            continue;
+        string status = responseStatus(response);
+        size_t count = responseCount(response);
+        int kind = -1;
+        if (status != entry->captured.status)
+            kind = MISMATCH_STATUS;
+        else if (count != entry->captured.count)
+            kind = MISMATCH_COUNT;
+        else if (captureResponseHash(response) != entry->captured.hash &&
+                 entry->captured.request.find("\"explain\":true") == string::npos) // в отчёте EXPLAIN - время
+            kind = MISMATCH_BODY;
+        if (kind >= 0)
+        {
+            connection.mismatches[kind]++;
+            reportMismatch(*entry, static_cast<MismatchKind>(kind), status, count, config);
+        }
+    }
+    close(sock);
+}
+
+// внутри соединения - по времени прихода: в файле строки лежат в порядке
+// завершения, поэтому вставка идёт с хвоста и почти всегда сразу в конец
+static void appendInOrder(ReplayConnection &connection, ReplayEntry *entry)
+{
+    connection.requests++;
+    if (connection.tail == nullptr || connection.tail->captured.ts_us <= entry->captured.ts_us)
+    {
+        if (connection.tail)
+            connection.tail->next = entry;
+        else
+            connection.head = entry;
+        connection.tail = entry;
+        return;
+    }
+    ReplayEntry **link = &connection.head;
+    while ((*link)->captured.ts_us <= entry->captured.ts_us)
+        link = &(*link)->next;
+    entry->next = *link;
+    *link = entry;
+}
+
+static void printLatencyLine(const char *label, const LatencyHistogram &histogram)
+{
+    char line[256];
+    snprintf(line, sizeof(line),
+             "%-22s p50 %9.1f  p90 %9.1f  p99 %9.1f  p99.9 %9.1f  max %9.1f  (us)\n", label,
+             histogram.percentile(0.50) / 1000.0, histogram.percentile(0.90) / 1000.0,
+             histogram.percentile(0.99) / 1000.0, histogram.percentile(0.999) / 1000.0,
+             histogram.getMax() / 1000.0);
+    cout << line;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        cerr << "Usage: " << argv[0] << " <capture file> --port N [--host H] [--speed K|max] [--show N]\n";
+        return 1;
+    }
+    string path = argv[1];
+    ReplayConfig config;
+    for (int i = 2; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--port" && i + 1 < argc)
+            config.port = atoi(argv[++i]);
+        else if (arg == "--host" && i + 1 < argc)
+            config.host = argv[++i];
+        else if (arg == "--speed" && i + 1 < argc)
+        {
+            string speed = argv[++i];
+            config.speed = speed == "max" ? 0.0 : atof(speed.c_str());
+            if (speed != "max" && config.speed <= 0)
+            {
+                cerr << "--speed ожидает положительный множитель или max\n";
+                return 1;
+            }
+        }
+        else if (arg == "--show" && i + 1 < argc)
+            config.show = static_cast<size_t>(atol(argv[++i]));
+        else
+        {
+            cerr << "Unknown argument: " << arg << "\n";
+            return 1;
+        }
+    }
+    if (config.port <= 0)
+    {
+        cerr << "--port is required\n";
+        return 1;
+    }
+
+    ifstream in(path);
+    if (!in)
+    {
+        cerr << path << ": " << strerror(errno) << "\n";
+        return 1;
+    }
+
+    ReplayConnection **buckets = new ReplayConnection *[CONNECTION_BUCKETS]();
+    ReplayConnection *connections = nullptr;
+    size_t connection_count = 0;
+    size_t total = 0;
+    size_t skipped = 0;
+    long long first_us = -1;
+    long long last_us = 0;
+
+    string line;
+    size_t line_number = 0;
+    while (getline(in, line))
+    {
+        line_number++;
+        ReplayEntry *entry = new ReplayEntry;
+        if (!parseCaptureLine(line, entry->captured))
+        {
+            delete entry;
+            skipped++;
+            continue;
+        }
+        entry->line_number = line_number;
+        entry->next = nullptr;
+        if (first_us < 0 || entry->captured.ts_us < first_us)
+            first_us = entry->captured.ts_us;
+        if (entry->captured.ts_us > last_us)
+            last_us = entry->captured.ts_us;
+
+        ReplayConnection *&bucket = buckets[entry->captured.connection % CONNECTION_BUCKETS];
+        ReplayConnection *connection = bucket;
+        while (connection && connection->id != entry->captured.connection)
+            connection = connection->hash_next;
+        if (connection == nullptr)
+        {
+            connection = new ReplayConnection(entry->captured.connection);
+            connection->hash_next = bucket;
+            bucket = connection;
+            connection->next = connections;
+            connections = connection;
+            connection_count++;
+        }
+        appendInOrder(*connection, entry);
+        total++;
+    }
+    if (total == 0)
+    {
+        cerr << path << ": no captured requests\n";
+        return 1;
+    }
+    for (ReplayConnection *c = connections; c; c = c->next)
+    {
+        for (ReplayEntry *entry = c->head; entry; entry = entry->next)
+            entry->offset_ns = (entry->captured.ts_us - first_us) * 1000;
+    }
+
+    double captured_s = (last_us - first_us) / 1e6;
+    cout << "[Replay] " << total << " requests on " << connection_count << " connections, captured over "
+         << captured_s << " s";
+    if (skipped > 0)
+        cout << " (" << skipped << " unreadable lines skipped)";
+    cout << ", speed " << (config.speed > 0 ? to_string(config.speed) + "x" : string("max")) << "\n";
+
+    // все потоки стартуют по одним часам; соединяются до старта
+    long long start_ns = nowNs() + 50000000;
+    thread *threads = new thread[connection_count];
+    size_t index = 0;
+    for (ReplayConnection *c = connections; c; c = c->next)
+        threads[index++] = thread(replayConnection, ref(*c), cref(config), start_ns);
+
+    LatencyHistogram *scheduled = new LatencyHistogram;
+    LatencyHistogram *raw = new LatencyHistogram;
+    uint64_t completed = 0;
+    uint64_t mismatches[MISMATCH_KIND_COUNT] = {0, 0, 0};
+    size_t disconnected = 0;
+    index = 0;
+    for (ReplayConnection *c = connections; c; c = c->next)
+    {
+        threads[index++].join();
+        scheduled->merge(c->scheduled);
+        raw->merge(c->raw);
+        completed += c->completed;
+        for (int i = 0; i < MISMATCH_KIND_COUNT; i++)
+            mismatches[i] += c->mismatches[i];
+        if (c->disconnected)
+            disconnected++;
+    }
+    double seconds = (nowNs() - start_ns) / 1e9;
+
+    uint64_t mismatch_total = mismatches[MISMATCH_STATUS] + mismatches[MISMATCH_COUNT] + mismatches[MISMATCH_BODY];
+    cout << "[Replay] " << completed << " of " << total << " requests in " << seconds << " s, throughput "
+         << (seconds > 0 ? static_cast<long long>(completed / seconds) : 0) << " req/s";
+    if (disconnected > 0)
+        cout << ", " << disconnected << " connections lost";
+    cout << "\n";
+    cout << "[Replay] mismatches " << mismatch_total << " (status " << mismatches[MISMATCH_STATUS]
+         << ", count " << mismatches[MISMATCH_COUNT] << ", body " << mismatches[MISMATCH_BODY] << ")\n";
+    if (completed > 0)
+    {
+        if (config.speed > 0)
+            printLatencyLine("latency (scheduled)", *scheduled);
+        printLatencyLine("latency (send-reply)", *raw);
+    }
+
+    delete raw;
+    delete scheduled;
+    delete[] threads;
+    for (ReplayConnection *c = connections; c;)
+    {
+        ReplayConnection *next_connection = c->next;
+        for (ReplayEntry *entry = c->head; entry;)
+        {
+            ReplayEntry *next_entry = entry->next;
+            delete entry;
+            entry = next_entry;
+        }
+        delete c;
+        c = next_connection;
+    }
+    delete[] buckets;
+    return completed == total && mismatch_total == 0 ? 0 : 2;
+}
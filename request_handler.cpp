@@ -1,21 +1,35 @@
 #include "request_handler.h"
-
-
-
-using namespace std;
-
-#include "request_handler.h"
+#include "query.h"
 #include "utills.h" 
 
+#include <chrono>
+
 using namespace std;
 
-Response processRequest(const Request& req, MiniDBMS& db)
+static Response executeRequest(const Request& req, MiniDBMS& db, QueryStats* stats)
 {
     Response resp;
 
     try
     {
-        if (req.operation == "insert")
+        // значения параметров для '?' (подготовленные запросы)
+        myarray params;
+        const myarray* params_ptr = nullptr;
+        if (!trim(req.params_json).empty())
+        {
+            if (!parse_params_array(req.params_json, params))
+            {
+                resp.status  = "error";
+                resp.message = "Некорректный массив params";
+                resp.data    = "[]";
+                return resp;
+            }
+            params_ptr = &params;
+        }
+
+        // import - та же вставка, но без записи файла: загрузчик шлёт пачки подряд
+        // и в конце один раз вызывает save
+        if (req.operation == "insert" || req.operation == "import")
 {
     Response resp;
     resp.status  = "success";
@@ -23,44 +37,26 @@ Response processRequest(const Request& req, MiniDBMS& db)
     resp.data    = "[]";
     resp.count   = 0;
 
-    std::string docs = !req.data_json.empty() ? req.data_json : req.query_json;
-    std::string trimmed = trim(docs);
+    // без копий: пачка может весить мегабайты
+    const std::string& docs = !req.data_json.empty() ? req.data_json : req.query_json;
+    size_t first = docs.find_first_not_of(" \t\n\r");
 
-    if (trimmed.empty())
+    if (first == std::string::npos)
     {
         resp.status  = "error";
         resp.message = "Пустой JSON-документ";
         return resp;
     }
 
-    if (trimmed.front() == '{')
+    if (docs[first] == '{')
     {
-        db.insertQuery(trimmed);
+        db.insertQuery(docs); // точечная запись, параллельно с другими ключами
         resp.count = 1;
     }
-    else if (trimmed.front() == '[')
+    else if (docs[first] == '[')
     {
-        size_t pos = 0;
-        while (pos < trimmed.size())
-        {
-            size_t s = trimmed.find('{', pos);
-            if (s == std::string::npos) break;
-
-            size_t cnt = 0;
-            size_t i = s;
-            do
-            {
-                if (trimmed[i] == '{') ++cnt;
-                if (trimmed[i] == '}') --cnt;
-                ++i;
-            } while (i < trimmed.size() && cnt > 0);
-
-            std::string obj = trimmed.substr(s, i - s);
-            db.insertQuery(obj);
-            ++resp.count;
-
-            pos = i;
-        }
+        // один проход по массиву, вся пачка - одна версия и один рост таблицы
+        resp.count = db.insertMany(docs);
     }
     else
     {
@@ -69,9 +65,26 @@ Response processRequest(const Request& req, MiniDBMS& db)
         return resp;
     }
 
-    db.saveToDisk();
+    if (req.operation == "insert" && req.persist)
+    {
+        db.saveToDisk();
+    }
     return resp;
 }
+        else if (req.operation == "save")
+        {
+            if (!db.saveToDisk()) // снимок уже на диске - файл не переписывается
+            {
+                resp.status  = "error";
+                resp.message = "Не удалось сохранить базу на диск";
+                resp.data    = "[]";
+                return resp;
+            }
+
+            resp.status  = "success";
+            resp.message = "Сохранено";
+            resp.data    = "[]";
+        }
         else if (req.operation == "find")
         {
             string query = req.query_json;
@@ -83,7 +96,7 @@ Response processRequest(const Request& req, MiniDBMS& db)
             string json_array;
             size_t count = 0U;
 
-            db.findQueryToJsonArray(query, json_array, count);
+            db.findQueryToJsonArray(query, json_array, count, params_ptr, stats);
 
             resp.data = json_array;
             resp.count = count;
@@ -91,6 +104,22 @@ Response processRequest(const Request& req, MiniDBMS& db)
             resp.message = "Fetched " + to_string(count) + " documents";
         }
 
+        else if (req.operation == "count")
+        {
+            string query = req.query_json;
+            if (query.empty())
+            {
+                query = "{}";
+            }
+
+            size_t count = db.countQuery(query, params_ptr, stats);
+
+            resp.data    = "[]";
+            resp.count   = count;
+            resp.status  = "success";
+            resp.message = "Counted " + to_string(count) + " documents";
+        }
+
         // -------------------------
         // DELETE
         // -------------------------
@@ -102,8 +131,11 @@ Response processRequest(const Request& req, MiniDBMS& db)
                 query = "{}";
             }
 
-            size_t removed = db.deleteQuery(query);
-            db.saveToDisk();
+            size_t removed = db.deleteQuery(query, params_ptr, stats);
+            if (req.persist)
+            {
+                db.saveToDisk();
+            }
 
             resp.count   = removed;
             resp.status  = "success";
@@ -111,6 +143,37 @@ Response processRequest(const Request& req, MiniDBMS& db)
             resp.data = "[]";
         }
 
+        // -------------------------
+        // UPDATE
+        // -------------------------
+        else if (req.operation == "update")
+        {
+            string query = req.query_json;
+            if (query.empty())
+            {
+                query = "{}";
+            }
+
+            if (trim(req.data_json).empty())
+            {
+                resp.status  = "error";
+                resp.message = "UPDATE ожидает $set/$unset/$inc в data";
+                resp.data    = "[]";
+                return resp;
+            }
+
+            size_t updated = db.updateQuery(query, req.data_json, params_ptr, stats);
+            if (updated > 0 && req.persist)
+            {
+                db.saveToDisk();
+            }
+
+            resp.count   = updated;
+            resp.status  = "success";
+            resp.message = "Обновлено " + to_string(updated);
+            resp.data    = "[]";
+        }
+
         else
         {
             resp.status  = "error";
@@ -132,3 +195,175 @@ Response processRequest(const Request& req, MiniDBMS& db)
 
     return resp;
 }
+
+Response processRequest(const Request& req, MiniDBMS& db, QueryStats* counters)
+{
+    if (!req.explain)
+    {
+        if (counters)
+        {
+            counters->timings = false;
+        }
+        return executeRequest(req, db, counters);
+    }
+
+    // EXPLAIN: тот же запрос, но с замерами по стадиям
+    QueryStats stats;
+    auto start = chrono::steady_clock::now();
+    Response resp = executeRequest(req, db, &stats);
+    stats.total_ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+    stats.bytes_out = resp.data.size();
+
+    resp.has_stats = true;
+    resp.stats = stats;
+    if (counters)
+    {
+        *counters = stats;
+    }
+    return resp;
+}
+
+// тело запроса: одна строка-условие (FIND/COUNT/DELETE) или условие + модификаторы (UPDATE)
+static bool readQuery(BinaryReader& reader, string& query)
+{
+    string_view text;
+    if (!reader.str(text))
+    {
+        return false;
+    }
+    query = text.empty() ? string("{}") : string(text);
+    return true;
+}
+
+string processBinaryRequest(const BinaryRequest& req, MiniDBMS& db, QueryStats* counters)
+{
+    BinaryReader reader(req.body);
+    if (counters)
+    {
+        counters->timings = false;
+    }
+
+    try
+    {
+        if (req.opcode == BIN_INSERT)
+        {
+            // документ занимает минимум 6 байт (длина _id + число полей)
+            uint32_t n = 0;
+            if (!reader.u32(n) || n > req.body.size() / 6)
+            {
+                return makeBinaryResponse(BIN_ERROR, 0, "Некорректный INSERT");
+            }
+
+            // сначала разбираем все документы: битый кадр не вставит ничего
+            Document** docs = new Document*[n > 0 ? n : 1];
+            uint32_t parsed = 0;
+            while (parsed < n)
+            {
+                docs[parsed] = Document::deserializeBinary(reader);
+                if (!docs[parsed])
+                {
+                    break;
+                }
+                ++parsed;
+            }
+            if (parsed < n || !reader.atEnd())
+            {
+                for (uint32_t i = 0; i < parsed; i++)
+                {
+                    delete docs[i];
+                }
+                delete[] docs;
+                return makeBinaryResponse(BIN_ERROR, 0, "Некорректный документ в INSERT");
+            }
+
+            if (n == 1)
+            {
+                db.insertDocument(docs[0]); // точечная запись
+            }
+            else
+            {
+                db.insertDocuments(docs, n); // вся пачка видна читателям разом
+            }
+            delete[] docs;
+            db.saveToDisk();
+            return makeBinaryResponse(BIN_OK, n, "Документы добавлены");
+        }
+
+        if (req.opcode != BIN_FIND && req.opcode != BIN_COUNT && req.opcode != BIN_DELETE && req.opcode != BIN_UPDATE)
+        {
+            return makeBinaryResponse(BIN_ERROR, 0, "Неизвестный opcode: " + to_string(req.opcode));
+        }
+
+        string query;
+        if (!readQuery(reader, query))
+        {
+            return makeBinaryResponse(BIN_ERROR, 0, "Некорректное условие");
+        }
+
+        if (req.opcode != BIN_UPDATE && !reader.atEnd())
+        {
+            return makeBinaryResponse(BIN_ERROR, 0, "Лишние байты в запросе");
+        }
+
+        if (req.opcode == BIN_FIND)
+        {
+            string docs;
+            size_t count = 0;
+            db.findQueryToBinary(query, docs, count, counters);
+            return makeBinaryResponse(BIN_OK, count, "Fetched " + to_string(count) + " documents", docs);
+        }
+
+        if (req.opcode == BIN_COUNT)
+        {
+            size_t count = db.countQuery(query, nullptr, counters);
+            return makeBinaryResponse(BIN_OK, count, "Counted " + to_string(count) + " documents");
+        }
+
+        if (req.opcode == BIN_DELETE)
+        {
+            size_t removed = db.deleteQuery(query, nullptr, counters);
+            db.saveToDisk();
+            return makeBinaryResponse(BIN_OK, removed, "Удалено " + to_string(removed));
+        }
+
+        // BIN_UPDATE
+        string_view update;
+        if (!reader.str(update) || !reader.atEnd())
+        {
+            return makeBinaryResponse(BIN_ERROR, 0, "UPDATE ожидает условие и модификаторы");
+        }
+
+        size_t updated = db.updateQuery(query, string(update), nullptr, counters);
+        if (updated > 0)
+        {
+            db.saveToDisk();
+        }
+        return makeBinaryResponse(BIN_OK, updated, "Обновлено " + to_string(updated));
+    }
+    catch (const exception& ex)
+    {
+        return makeBinaryResponse(BIN_ERROR, 0, ex.what());
+    }
+    catch (...)
+    {
+        return makeBinaryResponse(BIN_ERROR, 0, "Неизвестная ошибка");
+    }
+}
+
+string statsToJson(const QueryStats& stats)
+{
+    string json = "{";
+    json += "\"access_path\":\"" + (stats.access_path.empty() ? string("NONE") : stats.access_path) + "\",";
+    json += "\"plan_cache_hit\":" + string(stats.plan_cache_hit ? "true" : "false") + ",";
+    json += "\"docs_examined\":" + to_string(stats.docs_examined) + ",";
+    json += "\"docs_matched\":" + to_string(stats.docs_matched) + ",";
+    json += "\"parse_ns\":" + to_string(stats.parse_ns) + ",";
+    json += "\"scan_ns\":" + to_string(stats.scan_ns) + ",";
+    json += "\"match_ns\":" + to_string(stats.match_ns) + ",";
+    json += "\"serialize_ns\":" + to_string(stats.serialize_ns) + ",";
+    json += "\"lock_wait_ns\":" + to_string(stats.lock_wait_ns) + ",";
+    json += "\"total_ns\":" + to_string(stats.total_ns) + ",";
+    json += "\"bytes_out\":" + to_string(stats.bytes_out);
+    json += "}";
+    return json;
+}
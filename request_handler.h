@@ -1,6 +1,16 @@
 #pragma once
 
+#include <string>
+#include "binary_protocol.h"
 #include "protocol.h"
 #include "minidbms.h"
 
-Response processRequest(const Request& req, MiniDBMS& db);
\ No newline at end of file
+// counters - сюда складываются счётчики выполнения (документы, путь доступа, ожидание
+// блокировки) без замеров по стадиям; с explain туда же копируется полный отчёт
+Response processRequest(const Request& req, MiniDBMS& db, QueryStats* counters = nullptr);
+
+// запрос бинарного протокола (кроме BIN_OPEN - его решает сервер), ответ - готовый кадр
+std::string processBinaryRequest(const BinaryRequest& req, MiniDBMS& db, QueryStats* counters = nullptr);
+
+// отчёт EXPLAIN в виде JSON-объекта
+std::string statsToJson(const QueryStats& stats);
\ No newline at end of file
@@ -0,0 +1,173 @@
+#include "result_cache.h"
+
+using namespace std;
+
+ResultCache::ResultCache(size_t budget_bytes)
+    : lru_head(nullptr), lru_tail(nullptr), used_bytes(0), budget_bytes(budget_bytes), hits(0), misses(0)
+{
+    for (size_t i = 0; i < BUCKETS; i++)
+    {
+        buckets[i] = nullptr;
+    }
+}
+
+ResultCache::~ResultCache()
+{
+    Entry *current = lru_head;
+    while (current)
+    {
+        Entry *next = current->next;
+        delete current;
+        current = next;
+    }
+}
+
+size_t ResultCache::bucket_of(const string &key) const
+{
+    size_t hash_value = 0;
+    for (unsigned char c : key)
+    {
+        hash_value = hash_value * 31 + c;
+    }
+    return hash_value % BUCKETS;
+}
+
+void ResultCache::unlink_lru(Entry *e)
+{
+    if (e->prev)
+        e->prev->next = e->next;
+    else
+        lru_head = e->next;
+    if (e->next)
+        e->next->prev = e->prev;
+    else
+        lru_tail = e->prev;
+    e->prev = nullptr;
+    e->next = nullptr;
+}
+
+void ResultCache::push_front(Entry *e)
+{
+    e->prev = nullptr;
+    e->next = lru_head;
+    if (lru_head)
+        lru_head->prev = e;
+    lru_head = e;
+    if (!lru_tail)
+        lru_tail = e;
+}
+
+void ResultCache::erase(Entry *e)
+{
+    unlink_lru(e);
+    Entry **link = &buckets[bucket_of(e->key)];
+    while (*link && *link != e)
+    {
+        link = &(*link)->hash_next;
+    }
+    if (*link)
+        *link = e->hash_next;
+    used_bytes -= e->bytes;
+    delete e;
+}
+
+void ResultCache::setBudget(size_t bytes)
+{
+    lock_guard<mutex> lock(mtx);
+    budget_bytes = bytes;
+    while (lru_tail && used_bytes > budget_bytes)
+    {
+        erase(lru_tail);
+    }
+}
+
+bool ResultCache::isEnabled() const
+{
+    lock_guard<mutex> lock(mtx);
+    return budget_bytes > 0;
+}
+
+bool ResultCache::get(const string &key, unsigned long long version, string &out_data, size_t &out_count)
+{
+    lock_guard<mutex> lock(mtx);
+    if (budget_bytes == 0)
+        return false;
+
+    for (Entry *e = buckets[bucket_of(key)]; e; e = e->hash_next)
+    {
+        if (e->key != key)
+            continue;
+        if (e->version < version)
+        {
+            erase(e); // данные изменились после расчёта - запись устарела
+            break;
+        }
+        if (e->version > version)
+            break; // запись новее снимка читателя - ему не годится, но остаётся другим
+        unlink_lru(e);
+        push_front(e);
+        out_data = e->data;
+        out_count = e->count;
+        hits++;
+        return true;
+    }
+    misses++;
+    return false;
+}
+
+void ResultCache::put(const string &key, unsigned long long version, const string &data, size_t count)
+{
+    lock_guard<mutex> lock(mtx);
+    size_t bytes = key.size() + data.size() + sizeof(Entry);
+    if (budget_bytes == 0 || bytes > budget_bytes)
+        return; // слишком большой результат не кешируем
+
+    size_t index = bucket_of(key);
+    for (Entry *e = buckets[index]; e; e = e->hash_next)
+    {
+        if (e->key == key)
+        {
+            if (e->version > version)
+                return; // читатель со старого снимка не вытесняет более свежий результат
+            erase(e);
+            break;
+        }
+    }
+
+    while (lru_tail && used_bytes + bytes > budget_bytes)
+    {
+        erase(lru_tail);
+    }
+
+    Entry *entry = new Entry{key, data, count, version, bytes, nullptr, nullptr, buckets[index]};
+    buckets[index] = entry;
+    push_front(entry);
+    used_bytes += bytes;
+}
+
+void ResultCache::clear()
+{
+    lock_guard<mutex> lock(mtx);
+    while (lru_tail)
+    {
+        erase(lru_tail);
+    }
+}
+
+size_t ResultCache::getHits() const
+{
+    lock_guard<mutex> lock(mtx);
+    return hits;
+}
+
+size_t ResultCache::getMisses() const
+{
+    lock_guard<mutex> lock(mtx);
+    return misses;
+}
+
+size_t ResultCache::getUsedBytes() const
+{
+    lock_guard<mutex> lock(mtx);
+    return used_bytes;
+}
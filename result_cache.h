@@ -0,0 +1,56 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+#include <mutex>
+
+// кеш результатов FIND: ключ - нормализованный запрос, значение - готовый JSON-массив
+// запись годна, пока версия данных базы не изменилась (любая вставка/удаление/обновление)
+class ResultCache
+{
+private:
+    struct Entry
+    {
+        std::string key;
+        std::string data;            // сериализованный массив документов
+        std::size_t count;
+        unsigned long long version;  // версия данных, на которой посчитан результат
+        std::size_t bytes;
+        Entry *prev;
+        Entry *next;
+        Entry *hash_next;
+    };
+
+    static const std::size_t BUCKETS = 1024;
+
+    Entry *buckets[BUCKETS];
+    Entry *lru_head;
+    Entry *lru_tail;
+    std::size_t used_bytes;
+    std::size_t budget_bytes; // 0 - кеш выключен
+    std::size_t hits;
+    std::size_t misses;
+    mutable std::mutex mtx;
+
+    std::size_t bucket_of(const std::string &key) const;
+    void unlink_lru(Entry *e);
+    void push_front(Entry *e);
+    void erase(Entry *e);
+
+public:
+    explicit ResultCache(std::size_t budget_bytes = 0);
+    ~ResultCache();
+    ResultCache(const ResultCache &) = delete;
+    ResultCache &operator=(const ResultCache &) = delete;
+
+    void setBudget(std::size_t bytes);
+    bool isEnabled() const;
+
+    bool get(const std::string &key, unsigned long long version, std::string &out_data, std::size_t &out_count);
+    void put(const std::string &key, unsigned long long version, const std::string &data, std::size_t count);
+    void clear();
+
+    std::size_t getHits() const;
+    std::size_t getMisses() const;
+    std::size_t getUsedBytes() const;
+};
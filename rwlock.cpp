@@ -0,0 +1,49 @@
+#include "rwlock.h"
+
+using namespace std;
+
+RWLock::RWLock() : active_readers(0), waiting_writers(0), writer_active(false) {}
+
+void RWLock::lock()
+{
+    unique_lock<mutex> guard(mtx);
+    ++waiting_writers;
+    writers_cv.wait(guard, [this]
+                    { return !writer_active && active_readers == 0; });
+    --waiting_writers;
+    writer_active = true;
+}
+
+void RWLock::unlock()
+{
+    bool writers_waiting = false;
+    {
+        lock_guard<mutex> guard(mtx);
+        writer_active = false;
+        writers_waiting = waiting_writers > 0;
+    }
+    // следующий писатель, если есть; иначе впускаем всех ждущих читателей
+    if (writers_waiting)
+        writers_cv.notify_one();
+    else
+        readers_cv.notify_all();
+}
+
+void RWLock::lock_shared()
+{
+    unique_lock<mutex> guard(mtx);
+    readers_cv.wait(guard, [this]
+                    { return !writer_active && waiting_writers == 0; });
+    ++active_readers;
+}
+
+void RWLock::unlock_shared()
+{
+    bool last = false;
+    {
+        lock_guard<mutex> guard(mtx);
+        last = (--active_readers == 0);
+    }
+    if (last)
+        writers_cv.notify_one();
+}
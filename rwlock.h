@@ -0,0 +1,30 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+
+// блокировка общий/исключительный доступ с приоритетом исключительного: пока он ждёт,
+// новые общие владельцы не входят, поэтому поток мелких операций не может его заморить
+class RWLock
+{
+private:
+    std::mutex mtx;
+    std::condition_variable readers_cv;
+    std::condition_variable writers_cv;
+    int active_readers;
+    int waiting_writers;
+    bool writer_active;
+
+public:
+    RWLock();
+    RWLock(const RWLock &) = delete;
+    RWLock &operator=(const RWLock &) = delete;
+
+    // исключительный доступ, подходит для std::lock_guard
+    void lock();
+    void unlock();
+
+    // общий доступ, подходит для std::shared_lock
+    void lock_shared();
+    void unlock_shared();
+};
@@ -0,0 +1,279 @@
+#include "server_stats.h"
+#include "metrics.h"
+#include "logger.h"
+#include "trace.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+using namespace std;
+
+// квантили, которые отдаём для каждой гистограммы
+static const double QUANTILES[] = {0.5, 0.9, 0.99, 0.999};
+static const char *QUANTILE_NAMES[] = {"p50", "p90", "p99", "p999"};
+static const size_t QUANTILE_COUNT = sizeof(QUANTILES) / sizeof(QUANTILES[0]);
+
+static string formatDouble(double value, const char *format)
+{
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), format, value);
+    return buffer;
+}
+
+// имя базы приходит от клиента - экранируем как строку JSON / значение метки
+static string escapeName(const string &name)
+{
+    string out;
+    for (char c : name)
+    {
+        if (c == '"' || c == '\\')
+        {
+            out += '\\';
+            out += c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            out += ' ';
+        }
+        else
+        {
+            out += c;
+        }
+    }
+    return out;
+}
+
+string statsToJson(const ServerState &state)
+{
+    MetricsSnapshot *snapshot = new MetricsSnapshot; // гистограммы большие - не на стеке
+    collectMetrics(*snapshot);
+
+    string json = "{";
+    json += "\"connections\":{\"active\":" + to_string(state.active_connections.load()) +
+            ",\"refused\":" + to_string(state.refused_connections.load()) + "},";
+
+    json += "\"counters\":{";
+    for (int i = 0; i < COUNTER_COUNT; i++)
+    {
+        if (i > 0)
+            json += ",";
+        json += "\"" + string(counterName(static_cast<MetricCounter>(i))) + "\":" + to_string(snapshot->counters[i]);
+    }
+    json += "},";
+
+    json += "\"latency_ns\":{";
+    for (int i = 0; i < HISTOGRAM_COUNT; i++)
+    {
+        const LatencyHistogram &histogram = snapshot->histograms[i];
+        uint64_t count = histogram.getCount();
+        if (i > 0)
+            json += ",";
+        json += "\"" + string(histogramName(static_cast<MetricHistogram>(i))) + "\":{";
+        json += "\"count\":" + to_string(count);
+        json += ",\"mean\":" + to_string(count ? histogram.getSum() / count : 0);
+        for (size_t q = 0; q < QUANTILE_COUNT; q++)
+        {
+            json += ",\"" + string(QUANTILE_NAMES[q]) + "\":" + to_string(histogram.percentile(QUANTILES[q]));
+        }
+        json += ",\"max\":" + to_string(histogram.getMax()) + "}";
+    }
+    json += "},";
+    delete snapshot;
+
+    size_t memory_total = 0;
+    json += "\"databases\":[";
+    bool first = true;
+    state.databases.forEachLoaded([&](const string &name, MiniDBMS &db)
+                                  {
+                                      size_t memory = db.memoryUsage();
+                                      memory_total += memory;
+                                      if (!first)
+                                          json += ",";
+                                      first = false;
+                                      json += "{\"name\":\"" + escapeName(name) + "\"";
+                                      json += ",\"documents\":" + to_string(db.documentCount());
+                                      json += ",\"load_factor\":" + formatDouble(db.loadFactor(), "%.3f");
+                                      json += ",\"memory_bytes\":" + to_string(memory);
+                                      const PlanCache &plans = db.getPlanCache();
+                                      const ResultCache &results = db.getResultCache();
+                                      json += ",\"plan_cache\":{\"hits\":" + to_string(plans.getHits()) +
+                                              ",\"misses\":" + to_string(plans.getMisses()) +
+                                              ",\"size\":" + to_string(plans.getSize()) + "}";
+                                      json += ",\"result_cache\":{\"hits\":" + to_string(results.getHits()) +
+                                              ",\"misses\":" + to_string(results.getMisses()) +
+                                              ",\"bytes\":" + to_string(results.getUsedBytes()) + "}}"; });
+    json += "],";
+    json += "\"memory\":{\"used\":" + to_string(memory_total) +
+            ",\"budget\":" + to_string(state.databases.getMemoryBudget()) + "}";
+    json += "}";
+    return json;
+}
+
+string statsToText(const ServerState &state)
+{
+    MetricsSnapshot *snapshot = new MetricsSnapshot;
+    collectMetrics(*snapshot);
+
+    string text;
+    text += "# TYPE minidb_connections_active gauge\n";
+    text += "minidb_connections_active " + to_string(state.active_connections.load()) + "\n";
+    text += "# TYPE minidb_connections_refused_total counter\n";
+    text += "minidb_connections_refused_total " + to_string(state.refused_connections.load()) + "\n";
+
+    for (int i = 0; i < COUNTER_COUNT; i++)
+    {
+        string name = "minidb_" + string(counterName(static_cast<MetricCounter>(i))) + "_total";
+        text += "# TYPE " + name + " counter\n";
+        text += name + " " + to_string(snapshot->counters[i]) + "\n";
+    }
+
+    text += "# TYPE minidb_latency_seconds summary\n";
+    for (int i = 0; i < HISTOGRAM_COUNT; i++)
+    {
+        const LatencyHistogram &histogram = snapshot->histograms[i];
+        string label = "op=\"" + string(histogramName(static_cast<MetricHistogram>(i))) + "\"";
+        for (size_t q = 0; q < QUANTILE_COUNT; q++)
+        {
+            text += "minidb_latency_seconds{" + label + ",quantile=\"" + formatDouble(QUANTILES[q], "%g") + "\"} " +
+                    formatDouble(histogram.percentile(QUANTILES[q]) / 1e9, "%.9f") + "\n";
+        }
+        text += "minidb_latency_seconds_sum{" + label + "} " + formatDouble(histogram.getSum() / 1e9, "%.9f") + "\n";
+        text += "minidb_latency_seconds_count{" + label + "} " + to_string(histogram.getCount()) + "\n";
+    }
+    delete snapshot;
+
+    string documents = "# TYPE minidb_db_documents gauge\n";
+    string load_factor = "# TYPE minidb_db_load_factor gauge\n";
+    string memory = "# TYPE minidb_db_memory_bytes gauge\n";
+    string plan_hits = "# TYPE minidb_db_plan_cache_hits_total counter\n";
+    string plan_misses = "# TYPE minidb_db_plan_cache_misses_total counter\n";
+    string result_hits = "# TYPE minidb_db_result_cache_hits_total counter\n";
+    string result_misses = "# TYPE minidb_db_result_cache_misses_total counter\n";
+    string result_bytes = "# TYPE minidb_db_result_cache_bytes gauge\n";
+    state.databases.forEachLoaded([&](const string &name, MiniDBMS &db)
+                                  {
+                                      string label = "{db=\"" + escapeName(name) + "\"} ";
+                                      documents += "minidb_db_documents" + label + to_string(db.documentCount()) + "\n";
+                                      load_factor += "minidb_db_load_factor" + label + formatDouble(db.loadFactor(), "%.3f") + "\n";
+                                      memory += "minidb_db_memory_bytes" + label + to_string(db.memoryUsage()) + "\n";
+                                      const PlanCache &plans = db.getPlanCache();
+                                      const ResultCache &results = db.getResultCache();
+                                      plan_hits += "minidb_db_plan_cache_hits_total" + label + to_string(plans.getHits()) + "\n";
+                                      plan_misses += "minidb_db_plan_cache_misses_total" + label + to_string(plans.getMisses()) + "\n";
+                                      result_hits += "minidb_db_result_cache_hits_total" + label + to_string(results.getHits()) + "\n";
+                                      result_misses += "minidb_db_result_cache_misses_total" + label + to_string(results.getMisses()) + "\n";
+                                      result_bytes += "minidb_db_result_cache_bytes" + label + to_string(results.getUsedBytes()) + "\n"; });
+    text += documents + load_factor + memory;
+    text += plan_hits + plan_misses + result_hits + result_misses + result_bytes;
+    text += "# TYPE minidb_memory_budget_bytes gauge\n";
+    text += "minidb_memory_budget_bytes " + to_string(state.databases.getMemoryBudget()) + "\n";
+    return text;
+}
+
+// SO_SNDTIMEO ограничивает один send(); клиент, читающий по байту, держал бы
+// слушатель сколько угодно - поэтому ещё и общий срок на весь ответ
+static const long long SEND_DEADLINE_NS = 10LL * 1000 * 1000 * 1000;
+
+static void sendAll(int fd, const string &data)
+{
+    long long deadline = metricsNowNs() + SEND_DEADLINE_NS;
+    size_t sent = 0;
+    while (sent < data.size())
+    {
+        if (metricsNowNs() > deadline)
+            return;
+        ssize_t n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0)
+            return;
+        sent += static_cast<size_t>(n);
+    }
+}
+
+static void serveMetrics(int client, const ServerState &state)
+{
+    // заголовки целиком; медленный клиент не держит слушатель дольше таймаута -
+    // ни на приёме запроса, ни на отправке большого ответа (/trace), который он не читает
+    timeval timeout{};
+    timeout.tv_sec = 2;
+    ::setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    ::setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    string request;
+    char buffer[1024];
+    while (request.find("\r\n\r\n") == string::npos && request.size() < 8192)
+    {
+        ssize_t n = ::recv(client, buffer, sizeof(buffer), 0);
+        if (n <= 0)
+            return;
+        request.append(buffer, static_cast<size_t>(n));
+    }
+
+    string status = "200 OK";
+    string content_type = "text/plain; version=0.0.4";
+    string body;
+    if (request.compare(0, 13, "GET /metrics ") == 0 || request.compare(0, 6, "GET / ") == 0)
+    {
+        body = statsToText(state);
+    }
+    else if (request.compare(0, 11, "GET /trace ") == 0)
+    {
+        // файл целиком открывается в Perfetto / chrome://tracing
+        body = "{\"traceEvents\":" + traceToChromeJson() + ",\"displayTimeUnit\":\"ns\"}";
+        content_type = "application/json";
+    }
+    else
+    {
+        status = "404 Not Found";
+        body = "try GET /metrics or GET /trace\n";
+    }
+    sendAll(client, "HTTP/1.0 " + status + "\r\n"
+                    "Content-Type: " + content_type + "\r\n"
+                    "Content-Length: " + to_string(body.size()) + "\r\n"
+                    "Connection: close\r\n\r\n" + body);
+}
+
+bool startMetricsListener(int port, const ServerState &state)
+{
+    int listen_fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0)
+    {
+        LOG_ERROR("socket: " << strerror(errno));
+        return false;
+    }
+
+    int reuse = 1;
+    ::setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK); // метрики - только локально
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+
+    if (::bind(listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 || ::listen(listen_fd, 16) < 0)
+    {
+        LOG_ERROR("metrics listener: " << strerror(errno));
+        ::close(listen_fd);
+        return false;
+    }
+
+    thread([listen_fd, state]()
+           {
+               while (true)
+               {
+                   int client = ::accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+                   if (client < 0)
+                       continue;
+                   serveMetrics(client, state);
+                   ::close(client);
+               } })
+        .detach();
+    return true;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+
+#include "db_registry.h"
+
+// то, что сервер знает о себе помимо счётчиков metrics.h
+struct ServerState
+{
+    const std::atomic<int> &active_connections;
+    const std::atomic<long long> &refused_connections;
+    DbRegistry &databases;
+};
+
+// операция stats: один JSON-объект со счётчиками, квантилями задержек (нс) и базами
+std::string statsToJson(const ServerState &state);
+// то же в текстовом формате Prometheus (для HTTP-слушателя)
+std::string statsToText(const ServerState &state);
+
+// HTTP-слушатель метрик на 127.0.0.1:port в отдельном потоке: GET /metrics (или /),
+// GET /trace - трасса запросов (trace.h) файлом для Perfetto.
+// Запросы обслуживаются по одному - это для сборщика метрик, а не для клиентов базы
+bool startMetricsListener(int port, const ServerState &state);
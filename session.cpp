@@ -0,0 +1,112 @@
+#include "session.h"
+
+#include <cstdlib>
+
+using namespace std;
+
+ClientSession::~ClientSession()
+{
+    while (statements_head != nullptr)
+    {
+        PreparedStatement *next = statements_head->next;
+        delete statements_head;
+        statements_head = next;
+    }
+    while (binary_databases != nullptr)
+    {
+        BinaryDatabase *next = binary_databases->next;
+        delete binary_databases;
+        binary_databases = next;
+    }
+}
+
+static void unlinkStatement(PreparedStatement *stmt, PreparedStatement *&head, PreparedStatement *&tail)
+{
+    if (stmt->prev)
+        stmt->prev->next = stmt->next;
+    else
+        head = stmt->next;
+    if (stmt->next)
+        stmt->next->prev = stmt->prev;
+    else
+        tail = stmt->prev;
+    stmt->prev = nullptr;
+    stmt->next = nullptr;
+}
+
+static void pushStatement(PreparedStatement *stmt, PreparedStatement *&head, PreparedStatement *&tail)
+{
+    stmt->prev = nullptr;
+    stmt->next = head;
+    if (head)
+        head->prev = stmt;
+    head = stmt;
+    if (!tail)
+        tail = stmt;
+}
+
+void ClientSession::addStatement(PreparedStatement *stmt)
+{
+    if (statement_count >= MAX_STATEMENTS)
+    {
+        PreparedStatement *oldest = statements_tail;
+        unlinkStatement(oldest, statements_head, statements_tail);
+        PreparedStatement **link = &statement_buckets[static_cast<size_t>(oldest->id) % STATEMENT_BUCKETS];
+        while (*link != oldest)
+        {
+            link = &(*link)->hash_next;
+        }
+        *link = oldest->hash_next;
+        delete oldest;
+        statement_count--;
+    }
+
+    stmt->id = next_statement_id++;
+    size_t bucket = static_cast<size_t>(stmt->id) % STATEMENT_BUCKETS;
+    stmt->hash_next = statement_buckets[bucket];
+    statement_buckets[bucket] = stmt;
+    pushStatement(stmt, statements_head, statements_tail);
+    statement_count++;
+}
+
+PreparedStatement *ClientSession::findStatement(const string &id)
+{
+    char *end = nullptr;
+    long long number = strtoll(id.c_str(), &end, 10);
+    if (id.empty() || *end != '\0' || number <= 0)
+    {
+        return nullptr;
+    }
+
+    PreparedStatement *stmt = statement_buckets[static_cast<size_t>(number) % STATEMENT_BUCKETS];
+    while (stmt != nullptr && stmt->id != number)
+    {
+        stmt = stmt->hash_next;
+    }
+    if (stmt != nullptr && stmt != statements_head)
+    {
+        unlinkStatement(stmt, statements_head, statements_tail);
+        pushStatement(stmt, statements_head, statements_tail);
+    }
+    return stmt;
+}
+
+BinaryDatabase *ClientSession::findDatabase(uint32_t id) const
+{
+    BinaryDatabase *entry = binary_databases;
+    while (entry != nullptr && entry->id != id)
+    {
+        entry = entry->next;
+    }
+    return entry;
+}
+
+BinaryDatabase *ClientSession::findDatabase(const string &name) const
+{
+    BinaryDatabase *entry = binary_databases;
+    while (entry != nullptr && entry->name != name)
+    {
+        entry = entry->next;
+    }
+    return entry;
+}
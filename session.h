@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "db_registry.h"
+
+// подготовленный запрос, живёт пока открыто соединение
+// (или пока его не вытеснят более новые - см. ClientSession::MAX_STATEMENTS)
+struct PreparedStatement
+{
+    long long id;
+    std::string database;
+    std::string operation;  // find / delete / update
+    std::string query_json; // шаблон с '?'
+    std::string data_json;  // модификаторы для update
+    PreparedStatement *prev; // LRU: в голове - последний использованный
+    PreparedStatement *next;
+    PreparedStatement *hash_next; // цепочка в таблице по id
+};
+
+// база, открытая в бинарном протоколе (BIN_OPEN): кадры ссылаются на неё по id
+struct BinaryDatabase
+{
+    uint32_t id;
+    std::string name;
+    DbRegistry::Entry *db; // запись реестра: база может быть выгружена и загружена заново
+    BinaryDatabase *next;
+};
+
+// состояние одного клиентского соединения
+struct ClientSession
+{
+    // подготовленных запросов на соединение не больше MAX_STATEMENTS: клиент,
+    // который только готовит запросы, не раздувает память сервера - давно не
+    // выполнявшиеся вытесняются (EXECUTE по ним вернёт "Неизвестный statement")
+    static const size_t MAX_STATEMENTS = 256;
+    static const size_t STATEMENT_BUCKETS = 32;
+
+    PreparedStatement *statement_buckets[STATEMENT_BUCKETS] = {};
+    PreparedStatement *statements_head = nullptr; // LRU
+    PreparedStatement *statements_tail = nullptr;
+    size_t statement_count = 0;
+    long long next_statement_id = 1;
+    BinaryDatabase *binary_databases = nullptr;
+    uint32_t next_database_id = 1;
+    uint64_t capture_id = 0; // номер соединения в файле захвата, 0 - ещё не назначен
+
+    ClientSession() = default;
+    ClientSession(const ClientSession &) = delete;
+    ClientSession &operator=(const ClientSession &) = delete;
+    ~ClientSession();
+
+    // назначает id и запоминает (при переполнении вытесняет самый давний)
+    void addStatement(PreparedStatement *stmt);
+    // поиск по id из запроса; найденный становится самым свежим
+    PreparedStatement *findStatement(const std::string &id);
+    BinaryDatabase *findDatabase(uint32_t id) const;
+    BinaryDatabase *findDatabase(const std::string &name) const;
+};
@@ -0,0 +1,90 @@
+#include "slow_log.h"
+#include "query.h"
+
+#include <chrono>
+#include <random>
+
+using namespace std;
+
+SlowQueryLog::SlowQueryLog(const string &path, size_t max_file_bytes, long long threshold_ns, double sample_rate)
+    : log(path, max_file_bytes), threshold_ns(threshold_ns), sample_rate(sample_rate)
+{
+}
+
+bool SlowQueryLog::open()
+{
+    return log.open();
+}
+
+const char *SlowQueryLog::classify(long long duration_ns) const
+{
+    if (threshold_ns >= 0 && duration_ns >= threshold_ns)
+    {
+        return "slow";
+    }
+    if (sample_rate > 0)
+    {
+        // у каждого потока свой генератор - без общего состояния на горячем пути
+        thread_local mt19937_64 rng(random_device{}());
+        if (uniform_real_distribution<double>(0.0, 1.0)(rng) < sample_rate)
+        {
+            return "sample";
+        }
+    }
+    return nullptr;
+}
+
+// строки от клиента - в строку JSON
+static void appendEscaped(string &out, const string &text)
+{
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            out += '\\';
+            out += c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            out += ' ';
+        }
+        else
+        {
+            out += c;
+        }
+    }
+}
+
+void SlowQueryLog::record(const char *kind, const SlowQueryEntry &entry)
+{
+    long long now_ms = chrono::duration_cast<chrono::milliseconds>(
+                           chrono::system_clock::now().time_since_epoch())
+                           .count();
+
+    string line = "{\"ts_ms\":" + to_string(now_ms);
+    line += ",\"kind\":\"" + string(kind) + "\"";
+    line += ",\"duration_us\":" + to_string(entry.duration_ns / 1000);
+    line += ",\"database\":\"";
+    appendEscaped(line, entry.database);
+    line += "\",\"operation\":\"";
+    appendEscaped(line, entry.operation);
+    line += "\",\"shape\":\"";
+    appendEscaped(line, entry.query_json.empty() ? string() : query_shape(entry.query_json));
+    line += "\"";
+    if (entry.counters)
+    {
+        line += ",\"access_path\":\"" + entry.counters->access_path + "\"";
+        line += ",\"docs_examined\":" + to_string(entry.counters->docs_examined);
+        line += ",\"lock_wait_us\":" + to_string(entry.counters->lock_wait_ns / 1000);
+    }
+    line += ",\"docs_returned\":" + to_string(entry.docs_returned);
+    line += ",\"response_bytes\":" + to_string(entry.response_bytes);
+    line += "}";
+
+    log.write(std::move(line));
+}
+
+uint64_t SlowQueryLog::getDropped() const
+{
+    return log.getDropped();
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "async_log.h"
+#include "protocol.h"
+
+// одна выполненная операция глазами журнала медленных запросов
+struct SlowQueryEntry
+{
+    long long duration_ns = 0;
+    std::string database;
+    std::string operation;
+    std::string query_json;   // как пришёл; в журнал попадает только форма (query_shape)
+    const QueryStats *counters = nullptr; // nullptr - операция без счётчиков (insert)
+    std::size_t docs_returned = 0;
+    std::size_t response_bytes = 0;
+};
+
+// журнал медленных запросов: JSON-строка на каждый запрос дольше порога и на
+// случайную выборку остальных. Запись - через AsyncFileLog, так что поток
+// запроса только ставит строку в очередь
+class SlowQueryLog
+{
+private:
+    AsyncFileLog log;
+    long long threshold_ns; // < 0 - по порогу не пишем
+    double sample_rate;     // доля остальных запросов, 0 - без выборки
+
+public:
+    SlowQueryLog(const std::string &path, size_t max_file_bytes, long long threshold_ns, double sample_rate);
+
+    bool open();
+
+    // что делать с запросом такой длительности: nullptr - не писать, иначе "slow" / "sample".
+    // Дёшево, вызывается на каждом запросе до сбора подробностей
+    const char *classify(long long duration_ns) const;
+    void record(const char *kind, const SlowQueryEntry &entry);
+
+    uint64_t getDropped() const;
+};
@@ -0,0 +1,111 @@
+#include "snapshot.h"
+
+#include <functional>
+#include <thread>
+
+using namespace std;
+
+SnapshotRegistry::SnapshotRegistry() : committed(1), allocated(1), sleeping_writers(0)
+{
+    for (size_t i = 0; i < SLOTS; i++)
+    {
+        slots[i].store(0);
+    }
+}
+
+size_t SnapshotRegistry::pin(unsigned long long &version)
+{
+    // у каждого потока свой стартовый слот, чтобы не толкаться на одном
+    static thread_local size_t hint = hash<thread::id>()(this_thread::get_id()) % SLOTS;
+
+    version = committed.load();
+    size_t slot = hint;
+    while (true)
+    {
+        unsigned long long expected = 0;
+        if (slots[slot].compare_exchange_strong(expected, version))
+            break;
+        slot = (slot + 1) % SLOTS;
+        if (slot == hint)
+            this_thread::yield(); // все слоты заняты - ждём
+    }
+
+    // писатель мог опубликовать новую версию и уже посчитать minActive без нас:
+    // перепроверяем и переходим на свежую версию, пока она не совпадёт с записанной
+    while (true)
+    {
+        unsigned long long now = committed.load();
+        if (now == version)
+            break;
+        version = now;
+        slots[slot].store(version);
+    }
+    return slot;
+}
+
+void SnapshotRegistry::unpin(size_t slot)
+{
+    slots[slot].store(0);
+}
+
+unsigned long long SnapshotRegistry::getCommitted() const
+{
+    return committed.load();
+}
+
+unsigned long long SnapshotRegistry::allocate()
+{
+    return allocated.fetch_add(1) + 1;
+}
+
+void SnapshotRegistry::publish(unsigned long long version)
+{
+    // запись с меньшей версией ещё идёт - ждём, иначе снимок увидит "дыру".
+    // Обычно она заканчивается через доли микросекунды - немного крутимся на месте;
+    // если её поток вытеснили, засыпаем до её публикации (yield тут хуже сна:
+    // отдаёт процессор не ей, а следующему писателю, который тоже встанет ждать)
+    for (int spin = 0; committed.load() != version - 1; ++spin)
+    {
+        if (spin < PUBLISH_SPINS)
+            continue;
+        unique_lock<mutex> lock(publish_mtx);
+        sleeping_writers++;
+        publish_cv[(version - 1) % WAIT_QUEUES].wait(lock, [&]
+                                                    { return committed.load() == version - 1; });
+        sleeping_writers--;
+    }
+    committed.store(version);
+
+    if (sleeping_writers.load() > 0)
+    {
+        { lock_guard<mutex> lock(publish_mtx); }
+        publish_cv[version % WAIT_QUEUES].notify_all();
+    }
+}
+
+unsigned long long SnapshotRegistry::minActive() const
+{
+    unsigned long long result = committed.load();
+    for (size_t i = 0; i < SLOTS; i++)
+    {
+        unsigned long long v = slots[i].load();
+        if (v != 0 && v < result)
+            result = v;
+    }
+    return result;
+}
+
+SnapshotGuard::SnapshotGuard(SnapshotRegistry &registry) : registry(registry), slot(0), version(0)
+{
+    slot = registry.pin(version);
+}
+
+SnapshotGuard::~SnapshotGuard()
+{
+    registry.unpin(slot);
+}
+
+unsigned long long SnapshotGuard::getVersion() const
+{
+    return version;
+}
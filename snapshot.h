@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+
+// версии данных для MVCC: каждая запись получает номер, читатель видит состояние
+// на момент своего снимка; реестр активных снимков говорит сборщику мусора,
+// какие старые версии ещё кому-то нужны
+class SnapshotRegistry
+{
+private:
+    static const size_t SLOTS = 1024;
+
+    std::atomic<unsigned long long> committed; // последняя видимая читателям версия
+    std::atomic<unsigned long long> allocated; // последняя выданная писателю версия
+    std::atomic<unsigned long long> slots[SLOTS]; // 0 - слот свободен, иначе версия снимка
+
+    // писатели, уснувшие в publish в ожидании своей очереди: ждущий публикации
+    // версии v спит на publish_cv[v % WAIT_QUEUES], и её публикация будит только его
+    static const size_t WAIT_QUEUES = 64;
+    static const int PUBLISH_SPINS = 128;
+    std::mutex publish_mtx;
+    std::condition_variable publish_cv[WAIT_QUEUES];
+    std::atomic<int> sleeping_writers;
+
+public:
+    SnapshotRegistry();
+    SnapshotRegistry(const SnapshotRegistry &) = delete;
+    SnapshotRegistry &operator=(const SnapshotRegistry &) = delete;
+
+    // занять слот и зафиксировать текущую версию; version - версия снимка
+    size_t pin(unsigned long long &version);
+    void unpin(size_t slot);
+
+    unsigned long long getCommitted() const;
+    // писатели получают версии по порядку и публикуют их в том же порядке:
+    // publish ждёт, пока не будут опубликованы все предыдущие
+    unsigned long long allocate();
+    void publish(unsigned long long version);
+    // самая старая версия, которую ещё может читать какой-нибудь снимок
+    unsigned long long minActive() const;
+};
+
+// снимок на время одного чтения
+class SnapshotGuard
+{
+private:
+    SnapshotRegistry &registry;
+    size_t slot;
+    unsigned long long version;
+
+public:
+    explicit SnapshotGuard(SnapshotRegistry &registry);
+    ~SnapshotGuard();
+    SnapshotGuard(const SnapshotGuard &) = delete;
+    SnapshotGuard &operator=(const SnapshotGuard &) = delete;
+
+    unsigned long long getVersion() const;
+};
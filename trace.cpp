@@ -0,0 +1,193 @@
+#include "trace.h"
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <mutex>
+
+using namespace std;
+
+atomic<bool> g_tracing{false};
+
+// отрезков в кольце одного потока: старые перезаписываются новыми
+static const size_t TRACE_EVENTS_PER_THREAD = 1 << 15;
+
+// поля атомарные: выгрузка читает кольцо, пока поток-владелец пишет дальше.
+// sequence - номер записи + 1, на время перезаписи 0 (seqlock на одну ячейку)
+struct TraceEvent
+{
+    atomic<uint64_t> sequence;
+    atomic<uint64_t> start_ns;
+    atomic<uint64_t> duration_ns;
+    atomic<uint64_t> meta; // stage | value << 8
+};
+
+// блоки потоков не освобождаются - как ThreadMetrics
+struct alignas(64) ThreadTrace
+{
+    long tid;
+    string name;
+    atomic<TraceEvent *> events; // выделяется при первом отрезке
+    atomic<uint64_t> written;    // пишет только владелец
+    ThreadTrace *next;
+
+    ThreadTrace() : tid(0), events(nullptr), written(0), next(nullptr) {}
+};
+
+static mutex g_traceMutex; // регистрация потоков и выгрузка
+static ThreadTrace *g_traceThreads = nullptr;
+static atomic<long long> g_traceSince{0};
+
+static ThreadTrace &local_trace()
+{
+    static thread_local ThreadTrace *mine = nullptr;
+    if (mine == nullptr)
+    {
+        ThreadTrace *block = new ThreadTrace;
+        block->tid = static_cast<long>(::syscall(SYS_gettid));
+        lock_guard<mutex> lock(g_traceMutex);
+        block->next = g_traceThreads;
+        g_traceThreads = block;
+        mine = block;
+    }
+    return *mine;
+}
+
+void setTracing(bool enabled)
+{
+    if (enabled && !g_tracing.load())
+    {
+        g_traceSince.store(metricsNowNs());
+    }
+    g_tracing.store(enabled);
+}
+
+void traceThreadName(const string &name)
+{
+    ThreadTrace &trace = local_trace();
+    lock_guard<mutex> lock(g_traceMutex);
+    trace.name = name;
+}
+
+void traceSpan(TraceStage stage, long long start_ns, long long end_ns, uint64_t value)
+{
+    ThreadTrace &trace = local_trace();
+    TraceEvent *events = trace.events.load(memory_order_relaxed);
+    if (events == nullptr)
+    {
+        events = new TraceEvent[TRACE_EVENTS_PER_THREAD];
+        for (size_t i = 0; i < TRACE_EVENTS_PER_THREAD; i++)
+        {
+            events[i].sequence.store(0, memory_order_relaxed);
+        }
+        trace.events.store(events, memory_order_release);
+    }
+
+    uint64_t index = trace.written.load(memory_order_relaxed);
+    TraceEvent &event = events[index % TRACE_EVENTS_PER_THREAD];
+    event.sequence.store(0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release); // читатель не примет ячейку с наполовину новыми полями
+    event.start_ns.store(static_cast<uint64_t>(start_ns), memory_order_relaxed);
+    event.duration_ns.store(end_ns > start_ns ? static_cast<uint64_t>(end_ns - start_ns) : 0, memory_order_relaxed);
+    event.meta.store(static_cast<uint64_t>(stage) | (value << 8), memory_order_relaxed);
+    event.sequence.store(index + 1, memory_order_release);
+    trace.written.store(index + 1, memory_order_release);
+}
+
+static const char *stageName(TraceStage stage)
+{
+    static const char *names[TRACE_STAGE_COUNT] = {
+        "request", "socket read", "parse", "db lookup", "lock wait", "execute",
+        "scan", "serialize documents", "serialize response", "socket write"};
+    return stage < TRACE_STAGE_COUNT ? names[stage] : "unknown";
+}
+
+// ключ аргумента value для стадии (nullptr - без аргументов)
+static const char *valueName(TraceStage stage)
+{
+    switch (stage)
+    {
+    case TRACE_SOCKET_READ:
+    case TRACE_SOCKET_WRITE:
+        return "bytes";
+    case TRACE_SERIALIZE_DOCS:
+        return "documents";
+    default:
+        return nullptr;
+    }
+}
+
+static void appendMicros(string &out, uint64_t ns)
+{
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%llu.%03llu",
+             static_cast<unsigned long long>(ns / 1000), static_cast<unsigned long long>(ns % 1000));
+    out += buffer;
+}
+
+string traceToChromeJson(size_t *event_count)
+{
+    uint64_t since = static_cast<uint64_t>(g_traceSince.load());
+    long pid = static_cast<long>(::getpid());
+    size_t count = 0;
+    string json = "[";
+
+    lock_guard<mutex> lock(g_traceMutex);
+    for (ThreadTrace *trace = g_traceThreads; trace; trace = trace->next)
+    {
+        string thread_prefix = "{\"pid\":" + to_string(pid) + ",\"tid\":" + to_string(trace->tid);
+        if (!trace->name.empty())
+        {
+            if (json.size() > 1)
+                json += ",";
+            json += thread_prefix + ",\"ph\":\"M\",\"name\":\"thread_name\",\"args\":{\"name\":\"" + trace->name + "\"}}";
+        }
+
+        TraceEvent *events = trace->events.load(memory_order_acquire);
+        if (events == nullptr)
+            continue;
+
+        uint64_t written = trace->written.load(memory_order_acquire);
+        uint64_t first = written > TRACE_EVENTS_PER_THREAD ? written - TRACE_EVENTS_PER_THREAD : 0;
+        for (uint64_t index = first; index < written; index++)
+        {
+            TraceEvent &event = events[index % TRACE_EVENTS_PER_THREAD];
+            if (event.sequence.load(memory_order_acquire) != index + 1)
+                continue; // уже перезаписана
+            uint64_t start = event.start_ns.load(memory_order_relaxed);
+            uint64_t duration = event.duration_ns.load(memory_order_relaxed);
+            uint64_t meta = event.meta.load(memory_order_relaxed);
+            atomic_thread_fence(memory_order_acquire);
+            if (event.sequence.load(memory_order_relaxed) != index + 1)
+                continue; // владелец переписал ячейку, пока мы читали
+            if (start < since)
+                continue; // до последнего включения трассировки
+
+            TraceStage stage = static_cast<TraceStage>(meta & 0xff);
+            uint64_t value = meta >> 8;
+
+            if (json.size() > 1)
+                json += ",";
+            json += thread_prefix + ",\"ph\":\"X\",\"cat\":\"minidb\",\"name\":\"";
+            json += stage == TRACE_REQUEST && value < HISTOGRAM_COUNT
+                        ? histogramName(static_cast<MetricHistogram>(value))
+                        : stageName(stage);
+            json += "\",\"ts\":";
+            appendMicros(json, start);
+            json += ",\"dur\":";
+            appendMicros(json, duration);
+            if (const char *key = valueName(stage))
+            {
+                json += ",\"args\":{\"" + string(key) + "\":" + to_string(value) + "}";
+            }
+            json += "}";
+            count++;
+        }
+    }
+    json += "]";
+
+    if (event_count)
+        *event_count = count;
+    return json;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include "metrics.h"
+
+// трассировка запросов: отрезки по стадиям пишутся в кольцо своего потока и
+// по запросу выгружаются в формате Chrome trace_event (открывается в Perfetto /
+// chrome://tracing). Выключенная трассировка стоит одну relaxed-загрузку флага
+enum TraceStage
+{
+    TRACE_REQUEST,          // запрос целиком (value - операция, MetricHistogram)
+    TRACE_SOCKET_READ,      // value - принято байт
+    TRACE_PARSE,            // разбор строки JSON или кадра
+    TRACE_DB_LOOKUP,        // база в реестре (с ожиданием загрузки)
+    TRACE_LOCK_WAIT,        // ожидание блокировки записи
+    TRACE_EXECUTE,          // выполнение запроса в базе
+    TRACE_SCAN,             // поиск совпадений (при трассировке отделён от сборки ответа)
+    TRACE_SERIALIZE_DOCS,   // value - документов
+    TRACE_SERIALIZE_RESPONSE,
+    TRACE_SOCKET_WRITE,     // value - отправлено байт
+    TRACE_STAGE_COUNT
+};
+
+extern std::atomic<bool> g_tracing;
+
+inline bool tracingEnabled()
+{
+    return g_tracing.load(std::memory_order_relaxed);
+}
+
+// включение сбрасывает прошлую трассу: выгружаются только отрезки после старта
+void setTracing(bool enabled);
+
+void traceSpan(TraceStage stage, long long start_ns, long long end_ns, uint64_t value = 0);
+// имя потока на трассе (иначе - только номер)
+void traceThreadName(const std::string &name);
+
+// все сохранённые отрезки: JSON-массив событий trace_event ("ph":"X", ts/dur в мкс)
+std::string traceToChromeJson(size_t *event_count = nullptr);
+
+// отрезок от конструктора до деструктора; время берётся, только если трассировка включена
+class TraceScope
+{
+private:
+    TraceStage stage;
+    long long start;
+    uint64_t value;
+
+public:
+    explicit TraceScope(TraceStage stage)
+        : stage(stage), start(tracingEnabled() ? metricsNowNs() : 0), value(0) {}
+    ~TraceScope()
+    {
+        if (start)
+            traceSpan(stage, start, metricsNowNs(), value);
+    }
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+
+    void setValue(uint64_t v) { value = v; }
+};
@@ -0,0 +1,373 @@
+#include "uring.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+
+// размер одного буфера записи файла: в 32 раза меньше системных вызовов, чем у ofstream (8 КБ);
+// буферы закреплены в памяти (RLIMIT_MEMLOCK), поэтому не больше
+static const size_t FILE_CHUNK = 256 * 1024;
+
+IoUring::IoUring()
+    : ring_fd(-1), entries(0), sq_head(nullptr), sq_tail(nullptr), sq_mask(nullptr), sq_array(nullptr),
+      sqes(nullptr), sqe_tail(0), to_submit(0), cq_head(nullptr), cq_tail(nullptr), cq_mask(nullptr),
+      cqes(nullptr), sq_ptr(MAP_FAILED), sq_size(0), cq_ptr(MAP_FAILED), cq_size(0), sqes_size(0) {}
+
+IoUring::~IoUring()
+{
+    if (sqes)
+        munmap(sqes, sqes_size);
+    if (cq_ptr != MAP_FAILED && cq_ptr != sq_ptr)
+        munmap(cq_ptr, cq_size);
+    if (sq_ptr != MAP_FAILED)
+        munmap(sq_ptr, sq_size);
+    if (ring_fd >= 0)
+        ::close(ring_fd);
+}
+
+bool IoUring::init(unsigned requested, unsigned cq_entries)
+{
+    io_uring_params params{};
+    // кольцо обслуживает один поток: ядро не синхронизирует отправку и
+    // выполняет отложенную работу только внутри нашего io_uring_enter()
+    params.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+    if (cq_entries)
+    {
+        params.flags |= IORING_SETUP_CQSIZE;
+        params.cq_entries = cq_entries;
+    }
+    ring_fd = static_cast<int>(syscall(__NR_io_uring_setup, requested, &params));
+    if (ring_fd < 0 && errno == EINVAL)
+    {
+        // ядра до 6.1 этих флагов не знают
+        unsigned cq_flag = params.flags & IORING_SETUP_CQSIZE;
+        params = io_uring_params{};
+        params.flags = cq_flag;
+        params.cq_entries = cq_entries;
+        ring_fd = static_cast<int>(syscall(__NR_io_uring_setup, requested, &params));
+    }
+    if (ring_fd < 0)
+        return false;
+
+    entries = params.sq_entries;
+    sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap)
+        sq_size = cq_size = sq_size > cq_size ? sq_size : cq_size;
+
+    sq_ptr = mmap(nullptr, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    if (sq_ptr == MAP_FAILED)
+        return false;
+    cq_ptr = single_mmap ? sq_ptr
+                         : mmap(nullptr, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+    if (cq_ptr == MAP_FAILED)
+        return false;
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    void *sqes_ptr = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+    if (sqes_ptr == MAP_FAILED)
+        return false;
+    sqes = static_cast<io_uring_sqe *>(sqes_ptr);
+
+    char *sq = static_cast<char *>(sq_ptr);
+    sq_head = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sq_mask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    sqe_tail = *sq_tail;
+
+    char *cq = static_cast<char *>(cq_ptr);
+    cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cq_mask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+    return true;
+}
+
+io_uring_sqe *IoUring::getSqe()
+{
+    unsigned head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+    if (sqe_tail - head >= entries)
+    {
+        submit();
+        head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+        if (sqe_tail - head >= entries)
+            return nullptr;
+    }
+
+    unsigned index = sqe_tail & *sq_mask;
+    io_uring_sqe *sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array[index] = index;
+    sqe_tail++;
+    to_submit++;
+    return sqe;
+}
+
+int IoUring::submit(unsigned wait_nr)
+{
+    if (to_submit == 0 && wait_nr == 0)
+        return 0;
+
+    __atomic_store_n(sq_tail, sqe_tail, __ATOMIC_RELEASE);
+    unsigned flags = wait_nr ? IORING_ENTER_GETEVENTS : 0;
+    long ret = syscall(__NR_io_uring_enter, ring_fd, to_submit, wait_nr, flags, nullptr, 0);
+    if (ret < 0)
+        return -errno;
+    to_submit -= static_cast<unsigned>(ret) < to_submit ? static_cast<unsigned>(ret) : to_submit;
+    return static_cast<int>(ret);
+}
+
+io_uring_cqe *IoUring::peekCqe()
+{
+    unsigned head = *cq_head;
+    if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE))
+        return nullptr;
+    return &cqes[head & *cq_mask];
+}
+
+void IoUring::seenCqe()
+{
+    __atomic_store_n(cq_head, *cq_head + 1, __ATOMIC_RELEASE);
+}
+
+int IoUring::registerBuffers(const iovec *iov, unsigned count)
+{
+    if (syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_BUFFERS, iov, count) < 0)
+        return -errno;
+    return 0;
+}
+
+int IoUring::registerBufferRing(void *ring, unsigned ring_entries, uint16_t group)
+{
+    io_uring_buf_reg reg{};
+    reg.ring_addr = reinterpret_cast<uint64_t>(ring);
+    reg.ring_entries = ring_entries;
+    reg.bgid = group;
+    if (syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+        return -errno;
+    return 0;
+}
+
+ProvidedBuffers::ProvidedBuffers()
+    : ring(nullptr), ring_bytes(0), pool(nullptr), count(0), buffer_size(0), tail(0) {}
+
+ProvidedBuffers::~ProvidedBuffers()
+{
+    // ядро держит свою ссылку на страницы кольца, пока жив io_uring
+    if (ring)
+        munmap(ring, ring_bytes);
+    delete[] pool;
+}
+
+bool ProvidedBuffers::init(IoUring &uring, uint16_t group, unsigned buffers, unsigned size)
+{
+    count = buffers;
+    buffer_size = size;
+
+    // кольцо должно начинаться с границы страницы
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    ring_bytes = (count * sizeof(io_uring_buf) + page - 1) / page * page;
+    void *mem = mmap(nullptr, ring_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
+        return false;
+    ring = static_cast<io_uring_buf_ring *>(mem);
+
+    int rc = uring.registerBufferRing(ring, count, group);
+    if (rc < 0)
+    {
+        errno = -rc;
+        return false;
+    }
+
+    pool = new char[static_cast<size_t>(count) * buffer_size];
+    for (unsigned id = 0; id < count; ++id)
+        recycle(id);
+    return true;
+}
+
+const char *ProvidedBuffers::data(unsigned id) const
+{
+    return pool + static_cast<size_t>(id) * buffer_size;
+}
+
+void ProvidedBuffers::recycle(unsigned id)
+{
+    // не ring->bufs: в C++ __DECLARE_FLEX_ARRAY сдвигает массив на 8 байт,
+    // а ядро ждёт записи с начала кольца (tail лежит в резерве нулевой)
+    io_uring_buf *buf = reinterpret_cast<io_uring_buf *>(ring) + (tail & (count - 1));
+    buf->addr = reinterpret_cast<uint64_t>(data(id));
+    buf->len = buffer_size;
+    buf->bid = static_cast<uint16_t>(id);
+    tail++;
+    __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+}
+
+// кольцо живёт, пока жив поток: saveToDisk() не платит за io_uring_setup и регистрацию
+struct UringFileWriter::ThreadRing
+{
+    IoUring uring;
+    char *buffers[2];
+    bool available; // иначе пишем pwrite() из тех же буферов
+
+    ThreadRing() : available(false)
+    {
+        buffers[0] = static_cast<char *>(aligned_alloc(4096, FILE_CHUNK));
+        buffers[1] = static_cast<char *>(aligned_alloc(4096, FILE_CHUNK));
+        if (!uring.init(4))
+            return;
+        iovec iov[2] = {{buffers[0], FILE_CHUNK}, {buffers[1], FILE_CHUNK}};
+        available = uring.registerBuffers(iov, 2) == 0;
+    }
+
+    ~ThreadRing()
+    {
+        free(buffers[0]);
+        free(buffers[1]);
+    }
+};
+
+UringFileWriter::UringFileWriter()
+    : ring(nullptr), file_fd(-1), offset(0), current(0), used(0), in_flight{false, false},
+      flight_size{0, 0}, flight_offset{0, 0}, failed(false) {}
+
+UringFileWriter::~UringFileWriter()
+{
+    if (file_fd >= 0)
+        close();
+}
+
+bool UringFileWriter::open(const string &path)
+{
+    thread_local ThreadRing thread_ring;
+    ring = &thread_ring;
+    file_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    offset = 0;
+    current = 0;
+    used = 0;
+    failed = false;
+    return file_fd >= 0;
+}
+
+void UringFileWriter::write(string_view data)
+{
+    while (!data.empty())
+    {
+        size_t n = FILE_CHUNK - used < data.size() ? FILE_CHUNK - used : data.size();
+        memcpy(ring->buffers[current] + used, data.data(), n);
+        used += n;
+        data.remove_prefix(n);
+        if (used == FILE_CHUNK)
+            submit_current();
+    }
+}
+
+UringFileWriter &UringFileWriter::operator<<(string_view data)
+{
+    write(data);
+    return *this;
+}
+
+// заполненный буфер уходит ядру, дальше заполняем второй (дождавшись его прошлой записи)
+void UringFileWriter::submit_current()
+{
+    if (used == 0)
+        return;
+
+    io_uring_sqe *sqe = ring->available ? ring->uring.getSqe() : nullptr;
+    if (!sqe)
+    {
+        write_plain(ring->buffers[current], used, offset);
+    }
+    else
+    {
+        sqe->opcode = IORING_OP_WRITE_FIXED;
+        sqe->fd = file_fd;
+        sqe->addr = reinterpret_cast<uint64_t>(ring->buffers[current]);
+        sqe->len = static_cast<unsigned>(used);
+        sqe->off = offset;
+        sqe->buf_index = static_cast<uint16_t>(current);
+        sqe->user_data = current;
+        in_flight[current] = true;
+        flight_size[current] = used;
+        flight_offset[current] = offset;
+        ring->uring.submit();
+    }
+
+    offset += used;
+    used = 0;
+    current ^= 1;
+    while (in_flight[current])
+        wait_one();
+}
+
+void UringFileWriter::wait_one()
+{
+    io_uring_cqe *cqe = ring->uring.peekCqe();
+    while (!cqe)
+    {
+        int rc = ring->uring.submit(1);
+        if (rc < 0 && rc != -EINTR)
+        {
+            // завершение так и не пришло: буферы трогать нельзя, остаток - мимо кольца
+            failed = true;
+            ring->available = false;
+            in_flight[0] = in_flight[1] = false;
+            return;
+        }
+        cqe = ring->uring.peekCqe();
+    }
+
+    unsigned index = static_cast<unsigned>(cqe->user_data) & 1;
+    int res = cqe->res;
+    ring->uring.seenCqe();
+    in_flight[index] = false;
+
+    if (res < 0)
+    {
+        // например, файловая система без поддержки - пишем тот же кусок обычным путём
+        write_plain(ring->buffers[index], flight_size[index], flight_offset[index]);
+        return;
+    }
+    size_t written = static_cast<size_t>(res);
+    if (written < flight_size[index])
+        write_plain(ring->buffers[index] + written, flight_size[index] - written, flight_offset[index] + written);
+}
+
+void UringFileWriter::write_plain(const char *data, size_t size, unsigned long long at)
+{
+    while (size > 0)
+    {
+        ssize_t n = ::pwrite(file_fd, data, size, static_cast<off_t>(at));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+        {
+            failed = true;
+            return;
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+        at += static_cast<unsigned long long>(n);
+    }
+}
+
+bool UringFileWriter::close()
+{
+    if (file_fd < 0)
+        return false;
+    submit_current();
+    while (in_flight[0] || in_flight[1])
+        wait_one();
+    if (::close(file_fd) < 0)
+        failed = true;
+    file_fd = -1;
+    return !failed;
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <sys/uio.h>
+
+#include <linux/io_uring.h>
+
+// io_uring без liburing: setup/enter/register напрямую через syscall().
+// Заявки копятся в общей очереди отправки (SQ) и уходят в ядро одним
+// io_uring_enter() на весь цикл, завершения читаются из CQ без системных вызовов
+class IoUring
+{
+private:
+    int ring_fd;
+    unsigned entries;
+
+    // SQ: индексы в кольце + сами SQE
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    io_uring_sqe *sqes;
+    unsigned sqe_tail;  // следующая свободная SQE (ядру видна после submit)
+    unsigned to_submit; // заполнено, но ещё не отдано ядру
+
+    // CQ
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    io_uring_cqe *cqes;
+
+    void *sq_ptr;
+    size_t sq_size;
+    void *cq_ptr;
+    size_t cq_size;
+    size_t sqes_size;
+
+public:
+    IoUring();
+    ~IoUring();
+    IoUring(const IoUring &) = delete;
+    IoUring &operator=(const IoUring &) = delete;
+
+    // false - ядро без io_uring (или запрещено seccomp/sysctl), errno сохраняется
+    bool init(unsigned entries, unsigned cq_entries = 0);
+
+    // чистая SQE; если очередь полна - сначала отдаём накопленное ядру
+    io_uring_sqe *getSqe();
+    // отдать накопленные SQE и дождаться wait_nr завершений; -errno при ошибке
+    int submit(unsigned wait_nr = 0);
+
+    io_uring_cqe *peekCqe(); // nullptr - завершений нет
+    void seenCqe();          // освободить место первой CQE
+
+    int registerBuffers(const iovec *iov, unsigned count); // для READ_FIXED/WRITE_FIXED
+    int registerBufferRing(void *ring, unsigned ring_entries, uint16_t group);
+};
+
+// кольцо буферов для multishot recv: ядро само выбирает свободный буфер
+// под пришедшие данные, память не закреплена за каждым простаивающим соединением
+class ProvidedBuffers
+{
+private:
+    io_uring_buf_ring *ring;
+    size_t ring_bytes;
+    char *pool;
+    unsigned count;
+    unsigned buffer_size;
+    uint16_t tail;
+
+public:
+    ProvidedBuffers();
+    ~ProvidedBuffers();
+    ProvidedBuffers(const ProvidedBuffers &) = delete;
+    ProvidedBuffers &operator=(const ProvidedBuffers &) = delete;
+
+    // count - степень двойки
+    bool init(IoUring &uring, uint16_t group, unsigned count, unsigned buffer_size);
+    const char *data(unsigned id) const;
+    void recycle(unsigned id); // вернуть буфер ядру
+};
+
+// запись файла через io_uring: данные копируются в зарегистрированные буферы
+// потока и уходят WRITE_FIXED, пока следующий буфер заполняется.
+// Без io_uring - те же куски обычным pwrite()
+class UringFileWriter
+{
+private:
+    struct ThreadRing; // кольцо и два зарегистрированных буфера на поток
+
+    ThreadRing *ring;
+    int file_fd;
+    unsigned long long offset; // куда ляжет текущий буфер
+    unsigned current;          // заполняемый буфер
+    size_t used;               // байт в текущем буфере
+    bool in_flight[2];         // буфер сейчас пишет ядро
+    size_t flight_size[2];
+    unsigned long long flight_offset[2];
+    bool failed;
+
+    void submit_current();
+    void wait_one(); // одно завершение записи, недописанный хвост - pwrite()
+    void write_plain(const char *data, size_t size, unsigned long long at);
+
+public:
+    UringFileWriter();
+    ~UringFileWriter();
+    UringFileWriter(const UringFileWriter &) = delete;
+    UringFileWriter &operator=(const UringFileWriter &) = delete;
+
+    bool open(const std::string &path); // перезапись файла
+    void write(std::string_view data);
+    bool close(); // дождаться всех записей; false - файл записан не целиком
+
+    UringFileWriter &operator<<(std::string_view data);
+};
@@ -0,0 +1,427 @@
+#include "uring_loop.h"
+#include "logger.h"
+#include "trace.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+using namespace std;
+
+static const unsigned RING_ENTRIES = 1024;
+// на каждое соединение может прийти несколько завершений за цикл (recv, sendmsg)
+static const unsigned CQ_ENTRIES = 8192;
+// буферы multishot recv общие на все соединения: данные сразу копируются в LineReader
+// и буфер возвращается ядру, так что их нужно на пачку завершений, а не на соединение
+static const uint16_t RECV_GROUP = 0;
+static const unsigned RECV_BUFFERS = 256;
+static const unsigned RECV_BUFFER_SIZE = 16 * 1024;
+
+// вид заявки - в младших битах user_data, остальное - указатель на соединение
+enum UringOp : uint64_t
+{
+    OP_ACCEPT = 1,
+    OP_WAKE = 2,
+    OP_RECV = 3,
+    OP_SEND = 4,
+    OP_CANCEL = 5
+};
+static const uint64_t OP_MASK = 7;
+
+static uint64_t make_tag(UringConnection *conn, UringOp op)
+{
+    return reinterpret_cast<uint64_t>(conn) | op;
+}
+
+UringConnection::UringConnection(int fd)
+    : Connection(fd), recv_armed(false), send_armed(false), recv_paused(false), shut(false), msg{},
+      send_submitted_ns(0) {}
+
+UringServer::UringServer(LineHandler handler, FrameHandler frame_handler, size_t workers, size_t max_connections,
+                         atomic<int> &active_connections, atomic<long long> &refused_connections)
+    : handler(handler), frame_handler(frame_handler), pool(workers), max_connections(max_connections),
+      listen_fd(-1), wake_fd(-1), wake_value(0), done_head(nullptr),
+      active_connections(active_connections), refused_connections(refused_connections) {}
+
+UringServer::~UringServer()
+{
+    if (listen_fd >= 0)
+        ::close(listen_fd);
+    if (wake_fd >= 0)
+        ::close(wake_fd);
+}
+
+bool UringServer::supported()
+{
+    IoUring probe;
+    ProvidedBuffers probe_buffers;
+    return probe.init(8) && probe_buffers.init(probe, RECV_GROUP, 1, 64);
+}
+
+bool UringServer::listen(int port)
+{
+    if (!uring.init(RING_ENTRIES, CQ_ENTRIES))
+    {
+        LOG_ERROR("[Server] io_uring_setup: " << strerror(errno));
+        return false;
+    }
+    if (!buffers.init(uring, RECV_GROUP, RECV_BUFFERS, RECV_BUFFER_SIZE))
+    {
+        LOG_ERROR("[Server] io_uring provided buffers (need Linux 6.0+): " << strerror(errno));
+        return false;
+    }
+
+    // сокеты блокирующие: ожидание готовности берёт на себя io_uring
+    listen_fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0)
+    {
+        LOG_ERROR("socket: " << strerror(errno));
+        return false;
+    }
+
+    int reuse = 1;
+    ::setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+
+    if (::bind(listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0)
+    {
+        LOG_ERROR("bind: " << strerror(errno));
+        return false;
+    }
+
+    if (::listen(listen_fd, SOMAXCONN) < 0)
+    {
+        LOG_ERROR("listen: " << strerror(errno));
+        return false;
+    }
+
+    wake_fd = ::eventfd(0, EFD_CLOEXEC);
+    if (wake_fd < 0)
+    {
+        LOG_ERROR("eventfd: " << strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+// SQE есть всегда: getSqe() сам отдаёт накопленное ядру, когда очередь полна
+static io_uring_sqe *next_sqe(IoUring &uring)
+{
+    io_uring_sqe *sqe = uring.getSqe();
+    while (!sqe)
+    {
+        uring.submit(1);
+        sqe = uring.getSqe();
+    }
+    return sqe;
+}
+
+void UringServer::arm_accept()
+{
+    io_uring_sqe *sqe = next_sqe(uring);
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listen_fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT; // одна заявка на все будущие соединения
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = OP_ACCEPT;
+}
+
+void UringServer::arm_wake()
+{
+    io_uring_sqe *sqe = next_sqe(uring);
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = wake_fd;
+    sqe->addr = reinterpret_cast<uint64_t>(&wake_value);
+    sqe->len = sizeof(wake_value);
+    sqe->off = static_cast<uint64_t>(-1);
+    sqe->user_data = OP_WAKE;
+}
+
+void UringServer::arm_recv(UringConnection *conn)
+{
+    io_uring_sqe *sqe = next_sqe(uring);
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = conn->fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT; // заявка живёт, пока не кончатся буферы или соединение
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = RECV_GROUP;
+    sqe->user_data = make_tag(conn, OP_RECV);
+    conn->recv_armed = true;
+    conn->recv_paused = false;
+}
+
+// вся очередь ответов одной заявкой, как flush() у epoll
+void UringServer::arm_send(UringConnection *conn)
+{
+    conn->msg = msghdr{};
+    conn->msg.msg_iov = conn->iov;
+    conn->msg.msg_iovlen = static_cast<size_t>(conn->gatherOutput(conn->iov, MAX_IOV));
+
+    io_uring_sqe *sqe = next_sqe(uring);
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = conn->fd;
+    sqe->addr = reinterpret_cast<uint64_t>(&conn->msg);
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = make_tag(conn, OP_SEND);
+    conn->send_armed = true;
+    conn->send_submitted_ns = tracingEnabled() ? metricsNowNs() : 0;
+}
+
+// обратное давление: multishot recv не приостановить, только снять
+void UringServer::cancel_recv(UringConnection *conn)
+{
+    io_uring_sqe *sqe = next_sqe(uring);
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = make_tag(conn, OP_RECV);
+    sqe->user_data = OP_CANCEL;
+    conn->recv_paused = true;
+}
+
+void UringServer::run()
+{
+    arm_accept();
+    arm_wake();
+    traceThreadName("io_uring loop");
+
+    while (true)
+    {
+        // один системный вызов: отдать все заявки прошлого цикла и дождаться завершений
+        int rc = uring.submit(1);
+        if (rc < 0 && rc != -EINTR && rc != -EBUSY)
+        {
+            errno = -rc;
+            LOG_ERROR("io_uring_enter: " << strerror(errno));
+            return;
+        }
+
+        io_uring_cqe *cqe;
+        while ((cqe = uring.peekCqe()) != nullptr)
+        {
+            uint64_t data = cqe->user_data;
+            int res = cqe->res;
+            uint32_t flags = cqe->flags;
+            uring.seenCqe();
+
+            UringConnection *conn = reinterpret_cast<UringConnection *>(data & ~OP_MASK);
+            switch (data & OP_MASK)
+            {
+            case OP_ACCEPT:
+                on_accept(res, flags);
+                break;
+            case OP_WAKE:
+                drain_done_queue();
+                break;
+            case OP_RECV:
+                on_recv(conn, res, flags);
+                break;
+            case OP_SEND:
+                on_send(conn, res);
+                break;
+            default:
+                break; // завершение отмены - ждём завершения самой recv
+            }
+        }
+    }
+}
+
+void UringServer::on_accept(int res, uint32_t flags)
+{
+    if (!(flags & IORING_CQE_F_MORE))
+        arm_accept(); // multishot снят ядром (ошибка или переполнение CQ)
+
+    if (res < 0)
+    {
+        if (res != -ECONNABORTED && res != -EINTR)
+        {
+            errno = -res;
+            LOG_ERROR("accept: " << strerror(errno));
+        }
+        return;
+    }
+
+    // проверяем, не превышен ли лимит активных клиентов
+    if (static_cast<size_t>(active_connections.load()) >= max_connections)
+    {
+        refused_connections++;
+        LOG_WARN("[Server] Too many clients (" << active_connections.load()
+                 << "), refusing new connection");
+        ::close(res);
+        return;
+    }
+
+    int one = 1;
+    ::setsockopt(res, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    UringConnection *conn = new UringConnection(res);
+    active_connections++;
+    after_io(conn);
+}
+
+void UringServer::on_recv(UringConnection *conn, int res, uint32_t flags)
+{
+    if (!(flags & IORING_CQE_F_MORE))
+        conn->recv_armed = false;
+
+    {
+        lock_guard<mutex> lock(conn->mtx);
+        if (res > 0)
+        {
+            // recv уже выполнило ядро: на трассе - копия из кольца буферов
+            TraceScope span(TRACE_SOCKET_READ);
+            span.setValue(static_cast<uint64_t>(res));
+            // одна копия из буфера ядра в буфер соединения, буфер сразу обратно в кольцо
+            unsigned id = flags >> IORING_CQE_BUFFER_SHIFT;
+            conn->in.append(buffers.data(id), static_cast<size_t>(res));
+            buffers.recycle(id);
+            conn->checkSize();
+        }
+        else if (res == 0)
+        {
+            conn->peer_closed = true; // клиент закрыл соединение, допишем ответы
+        }
+        else if (res != -ENOBUFS && res != -ECANCELED && !conn->shut)
+        {
+            // ENOBUFS - все буферы в работе, ECANCELED - наша пауза: перевзведёт after_io
+            errno = -res;
+            LOG_WARN("[Server] recv error: " << strerror(errno));
+            conn->broken = true;
+        }
+    }
+    after_io(conn);
+}
+
+void UringServer::on_send(UringConnection *conn, int res)
+{
+    conn->send_armed = false;
+    {
+        lock_guard<mutex> lock(conn->mtx);
+        if (res >= 0)
+        {
+            // sendmsg отработал в ядре; отрезок от заявки до завершения
+            if (tracingEnabled() && conn->send_submitted_ns)
+                traceSpan(TRACE_SOCKET_WRITE, conn->send_submitted_ns, metricsNowNs(), static_cast<uint64_t>(res));
+            conn->consumeOutput(static_cast<size_t>(res)); // остаток уйдёт следующей заявкой
+        }
+        else if (!conn->shut)
+        {
+            errno = -res;
+            LOG_WARN("[Server] send error: " << strerror(errno));
+            conn->broken = true;
+        }
+    }
+    after_io(conn);
+}
+
+// общий шаг после любого завершения: отдать запросы воркеру, взвести recv/sendmsg, закрыть
+void UringServer::after_io(UringConnection *conn)
+{
+    bool close_now = false;
+    {
+        lock_guard<mutex> lock(conn->mtx);
+
+        conn->checkInput();
+
+        if (conn->broken)
+        {
+            // shutdown() завершает висящие recv/sendmsg, удаляем после их завершений
+            if (!conn->shut)
+            {
+                ::shutdown(conn->fd, SHUT_RDWR);
+                conn->shut = true;
+            }
+            close_now = !conn->busy && !conn->recv_armed && !conn->send_armed;
+        }
+        else
+        {
+            bool has_request = conn->hasRequest();
+            if (!conn->busy && has_request)
+            {
+                conn->busy = true;
+                pool.submit([this, conn]
+                            { process(conn); });
+            }
+
+            if (conn->out_pending > 0 && !conn->send_armed)
+                arm_send(conn);
+
+            bool want_read = conn->wantsInput();
+            if (want_read && !conn->recv_armed)
+                arm_recv(conn);
+            else if (!want_read && conn->recv_armed && !conn->recv_paused && !conn->peer_closed)
+                cancel_recv(conn);
+
+            close_now = !conn->busy && conn->peer_closed && !has_request && conn->out_pending == 0 &&
+                        !conn->recv_armed && !conn->send_armed;
+        }
+    }
+
+    if (close_now)
+        destroy(conn);
+}
+
+// поток пула: ответы только ставим в очередь - sendmsg-заявки подаёт реактор,
+// иначе прямой send() воркера обогнал бы заявку, уже висящую в ядре
+void UringServer::process(UringConnection *conn)
+{
+    OutChunk *head = nullptr;
+    OutChunk *tail = nullptr;
+    size_t bytes = conn->runBatch(handler, frame_handler, head, tail);
+    if (head)
+    {
+        lock_guard<mutex> lock(conn->mtx);
+        conn->enqueueOutput(head, tail, bytes);
+    }
+
+    // busy снимает реактор, когда заберёт соединение из очереди
+    {
+        lock_guard<mutex> lock(done_mtx);
+        conn->done_next = done_head;
+        done_head = conn;
+    }
+    uint64_t one = 1;
+    ssize_t written = ::write(wake_fd, &one, sizeof(one));
+    (void)written;
+}
+
+void UringServer::drain_done_queue()
+{
+    arm_wake();
+
+    UringConnection *list = nullptr;
+    {
+        lock_guard<mutex> lock(done_mtx);
+        list = done_head;
+        done_head = nullptr;
+    }
+
+    while (list)
+    {
+        UringConnection *conn = list;
+        list = static_cast<UringConnection *>(list->done_next);
+        conn->done_next = nullptr;
+        {
+            lock_guard<mutex> lock(conn->mtx);
+            conn->busy = false;
+        }
+        after_io(conn);
+    }
+}
+
+void UringServer::destroy(UringConnection *conn)
+{
+    ::close(conn->fd);
+    delete conn;
+    active_connections--;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <sys/socket.h>
+
+#include "event_loop.h"
+#include "uring.h"
+#include "worker_pool.h"
+
+// соединение io_uring-реактора: операции над сокетом висят в ядре,
+// пока не придёт их завершение, поэтому удалять можно только без заявок в полёте
+struct UringConnection : Connection
+{
+    // трогает только поток реактора
+    bool recv_armed;   // multishot recv ждёт данных
+    bool send_armed;   // sendmsg в полёте
+    bool recv_paused;  // recv отменён из-за обратного давления
+    bool shut;         // сделан shutdown(), ждём завершения заявок
+    iovec iov[MAX_IOV]; // живут, пока sendmsg в полёте
+    msghdr msg;
+    long long send_submitted_ns; // для трассировки: когда взведён sendmsg (0 - не замеряли)
+
+    explicit UringConnection(int fd);
+};
+
+// тот же реактор + пул воркеров, что и EpollServer, но на io_uring:
+// multishot accept и multishot recv с кольцом буферов ядра, ответы - sendmsg-заявками;
+// все заявки цикла уходят в ядро одним io_uring_enter(), который и ждёт завершений
+class UringServer
+{
+private:
+    LineHandler handler;
+    FrameHandler frame_handler;
+    WorkerPool pool;
+    size_t max_connections;
+
+    int listen_fd;
+    int wake_fd;          // eventfd: воркер сообщает реактору о готовых ответах
+    uint64_t wake_value;  // сюда читает заявка на wake_fd
+    IoUring uring;
+    ProvidedBuffers buffers; // объявлено после uring: снимается раньше кольца
+
+    std::mutex done_mtx;
+    UringConnection *done_head; // соединения, обработанные воркерами
+
+    std::atomic<int> &active_connections;
+    std::atomic<long long> &refused_connections;
+
+    void arm_accept();
+    void arm_wake();
+    void arm_recv(UringConnection *conn);
+    void arm_send(UringConnection *conn);
+    void cancel_recv(UringConnection *conn);
+
+    void on_accept(int res, uint32_t flags);
+    void on_recv(UringConnection *conn, int res, uint32_t flags);
+    void on_send(UringConnection *conn, int res);
+    void drain_done_queue();
+
+    void process(UringConnection *conn); // выполняется в потоке пула
+    void after_io(UringConnection *conn);
+    void destroy(UringConnection *conn);
+
+public:
+    UringServer(LineHandler handler, FrameHandler frame_handler, size_t workers, size_t max_connections,
+                std::atomic<int> &active_connections, std::atomic<long long> &refused_connections);
+    ~UringServer();
+    UringServer(const UringServer &) = delete;
+    UringServer &operator=(const UringServer &) = delete;
+
+    // ядро умеет io_uring с кольцом буферов (Linux 6.0+) и его не запретили
+    static bool supported();
+
+    bool listen(int port);
+    void run(); // цикл реактора, не возвращается
+};
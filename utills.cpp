@@ -12,3 +12,39 @@ string trim(const string &str)
     size_t last = str.find_last_not_of(" \t\n\r");
     return str.substr(first, last - first + 1);
 }
+
+size_t findMatchingBracket(const string &s, size_t open_pos)
+{
+    if (open_pos >= s.size())
+        return string::npos;
+    char open_char = s[open_pos];
+    char close_char = (open_char == '{') ? '}' : (open_char == '[') ? ']' : 0;
+    if (close_char == 0)
+        return string::npos;
+
+    int count = 0;
+    bool in_string = false;
+    for (size_t i = open_pos; i < s.size(); ++i)
+    {
+        char c = s[i];
+        if (c == '"')
+            in_string = !in_string;
+        if (in_string)
+            continue;
+        if (c == open_char)
+            count++;
+        else if (c == close_char)
+        {
+            count--;
+            if (count == 0)
+                return i;
+        }
+    }
+    return string::npos;
+}
+
+size_t stringHeapBytes(const string &s)
+{
+    static const size_t inline_capacity = string().capacity();
+    return s.capacity() > inline_capacity ? s.capacity() + 1 : 0;
+}
@@ -1,4 +1,9 @@
 #pragma once
 #include <string>
+#include <cstddef>
 
-std::string trim(const std::string &str);
\ No newline at end of file
+std::string trim(const std::string &str);
+// позиция парной закрывающей скобки для s[open_pos] ('{' или '['), npos если нет
+size_t findMatchingBracket(const std::string &s, size_t open_pos);
+// сколько строка занимает в куче (короткие лежат внутри самого объекта)
+size_t stringHeapBytes(const std::string &s);
\ No newline at end of file
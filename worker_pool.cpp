@@ -0,0 +1,71 @@
+#include "worker_pool.h"
+#include "trace.h"
+
+using namespace std;
+
+WorkerPool::WorkerPool(size_t threads_count)
+    : threads(nullptr), thread_count(threads_count == 0 ? 1 : threads_count),
+      head(nullptr), tail(nullptr), stopping(false)
+{
+    threads = new thread[thread_count];
+    for (size_t i = 0; i < thread_count; i++)
+    {
+        threads[i] = thread([this]
+                            { worker_loop(); });
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        lock_guard<mutex> lock(mtx);
+        stopping = true;
+    }
+    cv.notify_all();
+    for (size_t i = 0; i < thread_count; i++)
+    {
+        threads[i].join();
+    }
+    delete[] threads;
+}
+
+void WorkerPool::submit(function<void()> fn)
+{
+    Task *task = new Task{std::move(fn), nullptr};
+    {
+        lock_guard<mutex> lock(mtx);
+        if (tail)
+            tail->next = task;
+        else
+            head = task;
+        tail = task;
+    }
+    cv.notify_one();
+}
+
+size_t WorkerPool::getThreadCount() const
+{
+    return thread_count;
+}
+
+void WorkerPool::worker_loop()
+{
+    traceThreadName("worker");
+    while (true)
+    {
+        Task *task = nullptr;
+        {
+            unique_lock<mutex> lock(mtx);
+            cv.wait(lock, [this]
+                    { return stopping || head != nullptr; });
+            if (!head)
+                return; // stopping и очередь пуста
+            task = head;
+            head = head->next;
+            if (!head)
+                tail = nullptr;
+        }
+        task->fn();
+        delete task;
+    }
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// пул из фиксированного числа потоков с общей очередью задач
+class WorkerPool
+{
+private:
+    struct Task
+    {
+        std::function<void()> fn;
+        Task *next;
+    };
+
+    std::thread *threads;
+    size_t thread_count;
+    Task *head; // очередь FIFO
+    Task *tail;
+    bool stopping;
+    std::mutex mtx;
+    std::condition_variable cv;
+
+    void worker_loop();
+
+public:
+    explicit WorkerPool(size_t threads);
+    ~WorkerPool(); // дожидается выполнения уже поставленных задач
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    void submit(std::function<void()> fn);
+    size_t getThreadCount() const;
+};